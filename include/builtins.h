@@ -131,6 +131,7 @@ static struct {
   { .module = "os",         .name = "rewinddir",                .value = BUILTIN(builtin_os_rewinddir)           },
   { .module = "os",         .name = "read",                     .value = BUILTIN(builtin_os_read)                },
   { .module = "os",         .name = "write",                    .value = BUILTIN(builtin_os_write)               },
+  { .module = "os",         .name = "writev",                   .value = BUILTIN(builtin_os_writev)              },
   { .module = "os",         .name = "pread",                    .value = BUILTIN(builtin_os_pread)               },
   { .module = "os",         .name = "pwrite",                   .value = BUILTIN(builtin_os_pwrite)              },
   { .module = "os",         .name = "sendfile",                 .value = BUILTIN(builtin_os_sendfile)            },
@@ -298,6 +299,9 @@ static struct {
   { .module = "os",         .name = "EPOLLET",                  .value = INT(EPOLLET)                            },
   { .module = "os",         .name = "EPOLLOUT",                 .value = INT(EPOLLOUT)                           },
   { .module = "os",         .name = "EPOLLHUP",                 .value = INT(EPOLLHUP)                           },
+  { .module = "os",         .name = "EPOLLERR",                 .value = INT(EPOLLERR)                           },
+  { .module = "os",         .name = "EPOLLRDHUP",               .value = INT(EPOLLRDHUP)                         },
+  { .module = "os",         .name = "EPOLLONESHOT",             .value = INT(EPOLLONESHOT)                       },
 
   { .module = "os",         .name = "eventfd",                  .value = BUILTIN(builtin_os_eventfd)             },
   { .module = "os",         .name = "EFD_CLOEXEC",              .value = INT(EFD_CLOEXEC)                        },
@@ -610,7 +614,16 @@ static struct {
 
   { .module = "json",       .name = "parse",                    .value = BUILTIN(builtin_json_parse)             },
   { .module = "json",       .name = "parse!",                   .value = BUILTIN(builtin_json_parse_xD)          },
+  { .module = "json",       .name = "feed",                     .value = BUILTIN(builtin_json_feed)              },
+  { .module = "json",       .name = "index",                    .value = BUILTIN(builtin_json_index)             },
+  { .module = "json",       .name = "nodeChild",                .value = BUILTIN(builtin_json_node_child)        },
+  { .module = "json",       .name = "nodePath",                 .value = BUILTIN(builtin_json_node_path)         },
+  { .module = "json",       .name = "nodeKind",                 .value = BUILTIN(builtin_json_node_kind)         },
+  { .module = "json",       .name = "nodeCount",                .value = BUILTIN(builtin_json_node_count)        },
+  { .module = "json",       .name = "nodeChildren",             .value = BUILTIN(builtin_json_node_children)     },
+  { .module = "json",       .name = "nodeValue",                .value = BUILTIN(builtin_json_node_value)        },
   { .module = "json",       .name = "encode",                   .value = BUILTIN(builtin_json_encode)            },
+  { .module = "json",       .name = "encodeInto",               .value = BUILTIN(builtin_json_encode_into)       },
 #ifdef SIGHUP
   { .module = "os",         .name = "SIGHUP",                   .value = INT(SIGHUP)                             },
 #endif
@@ -871,6 +884,8 @@ static struct {
   { .module = "ty",         .name = "lock",                     .value = BUILTIN(builtin_ty_lock)                },
   { .module = "ty",         .name = "unlock",                   .value = BUILTIN(builtin_ty_unlock)              },
   { .module = "ty",         .name = "gc",                       .value = BUILTIN(builtin_ty_gc)                  },
+  { .module = "ty",         .name = "gcStats",                  .value = BUILTIN(builtin_ty_gc_stats)            },
+  { .module = "ty",         .name = "regexCache",               .value = BUILTIN(builtin_ty_regex_cache)         },
   { .module = "ty",         .name = "bt",                       .value = BUILTIN(builtin_ty_bt)                  },
   { .module = "ty",         .name = "trace",                    .value = BUILTIN(builtin_ty_trace)               },
   { .module = "ty",         .name = "stack-ctx",                .value = BUILTIN(builtin_ty_stack_ctx)           },
@@ -886,6 +901,33 @@ static struct {
   { .module = "ty/mod",     .name = "imports",                   .value = BUILTIN(builtin_ty_mod_imports)        },
   { .module = "ty/mod",     .name = "lookup",                    .value = BUILTIN(builtin_ty_mod_lookup)         },
 
+  { .module = "ty/profile", .name = "start",                    .value = BUILTIN(builtin_ty_profile_start)       },
+  { .module = "ty/profile", .name = "stop",                     .value = BUILTIN(builtin_ty_profile_stop)        },
+  { .module = "ty/profile", .name = "running",                  .value = BUILTIN(builtin_ty_profile_running)     },
+  { .module = "ty/profile", .name = "reset",                    .value = BUILTIN(builtin_ty_profile_reset)       },
+  { .module = "ty/profile", .name = "report",                   .value = BUILTIN(builtin_ty_profile_report)      },
+  { .module = "ty/profile", .name = "samples",                  .value = BUILTIN(builtin_ty_profile_samples)     },
+  { .module = "ty/profile", .name = "folded",                   .value = BUILTIN(builtin_ty_profile_folded)      },
+  { .module = "ty/profile", .name = "pprof",                    .value = BUILTIN(builtin_ty_profile_pprof)       },
+  { .module = "ty/profile", .name = "heapStart",                .value = BUILTIN(builtin_ty_profile_heap_start)  },
+  { .module = "ty/profile", .name = "heapStop",                 .value = BUILTIN(builtin_ty_profile_heap_stop)   },
+  { .module = "ty/profile", .name = "heapRunning",              .value = BUILTIN(builtin_ty_profile_heap_running) },
+  { .module = "ty/profile", .name = "heapReset",                .value = BUILTIN(builtin_ty_profile_heap_reset)  },
+  { .module = "ty/profile", .name = "heapReport",               .value = BUILTIN(builtin_ty_profile_heap_report) },
+  { .module = "ty/profile", .name = "heapPprof",                .value = BUILTIN(builtin_ty_profile_heap_pprof)  },
+  { .module = "ty/profile", .name = "counters",                 .value = BUILTIN(builtin_ty_profile_counters)    },
+  { .module = "ty/profile", .name = "jitCode",                  .value = BUILTIN(builtin_ty_profile_jit_code)    },
+
+  { .module = "ty/tracing", .name = "start",                    .value = BUILTIN(builtin_ty_tracing_start)   },
+  { .module = "ty/tracing", .name = "stop",                     .value = BUILTIN(builtin_ty_tracing_stop)    },
+  { .module = "ty/tracing", .name = "running",                  .value = BUILTIN(builtin_ty_tracing_running) },
+  { .module = "ty/tracing", .name = "reset",                    .value = BUILTIN(builtin_ty_tracing_reset)   },
+  { .module = "ty/tracing", .name = "json",                     .value = BUILTIN(builtin_ty_tracing_json)    },
+  { .module = "ty/tracing", .name = "span",                     .value = BUILTIN(builtin_ty_tracing_span)    },
+  { .module = "ty/tracing", .name = "begin",                    .value = BUILTIN(builtin_ty_tracing_begin)   },
+  { .module = "ty/tracing", .name = "end",                      .value = BUILTIN(builtin_ty_tracing_end)     },
+  { .module = "ty/tracing", .name = "instant",                  .value = BUILTIN(builtin_ty_tracing_instant) },
+
   { .module = "ty/types",   .name = "info",                     .value = BUILTIN(builtin_ty_type_info)           },
   { .module = "ty/types",   .name = "type",                     .value = BUILTIN(builtin_ty_type_type)           },
   { .module = "ty/types",   .name = "resolve",                  .value = BUILTIN(builtin_ty_type_resolve)        },
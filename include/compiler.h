@@ -539,6 +539,9 @@ CompilerCurrentModule(Ty *ty);
 bool
 CompilerReloadModule(Ty *ty, Module *mod, char const *source);
 
+bool
+CompilerPatchModule(Ty *ty, Module *mod, char const *source);
+
 Symbol *
 CompilerFindDefinition(Ty *ty, Module *mod, i32 line, i32 col);
 
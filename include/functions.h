@@ -79,7 +79,16 @@ BUILTIN_FUNCTION(setenv);
 BUILTIN_FUNCTION(locale_setlocale);
 BUILTIN_FUNCTION(json_parse);
 BUILTIN_FUNCTION(json_parse_xD);
+BUILTIN_FUNCTION(json_feed);
+BUILTIN_FUNCTION(json_index);
+BUILTIN_FUNCTION(json_node_child);
+BUILTIN_FUNCTION(json_node_path);
+BUILTIN_FUNCTION(json_node_kind);
+BUILTIN_FUNCTION(json_node_count);
+BUILTIN_FUNCTION(json_node_children);
+BUILTIN_FUNCTION(json_node_value);
 BUILTIN_FUNCTION(json_encode);
+BUILTIN_FUNCTION(json_encode_into);
 BUILTIN_FUNCTION(md5);
 BUILTIN_FUNCTION(sha1);
 BUILTIN_FUNCTION(sha256);
@@ -119,6 +128,7 @@ BUILTIN_FUNCTION(os_symlink);
 BUILTIN_FUNCTION(os_read);
 BUILTIN_FUNCTION(os_write);
 BUILTIN_FUNCTION(os_sendfile);
+BUILTIN_FUNCTION(os_writev);
 BUILTIN_FUNCTION(os_splice);
 BUILTIN_FUNCTION(os_copy_file_range);
 BUILTIN_FUNCTION(os_fsync);
@@ -342,10 +352,37 @@ BUILTIN_FUNCTION(ty_strip_source);
 BUILTIN_FUNCTION(ty_get_source);
 BUILTIN_FUNCTION(ty_gensym);
 BUILTIN_FUNCTION(ty_gc);
+BUILTIN_FUNCTION(ty_gc_stats);
+BUILTIN_FUNCTION(ty_regex_cache);
 BUILTIN_FUNCTION(ty_bt);
 BUILTIN_FUNCTION(ty_trace);
 BUILTIN_FUNCTION(ty_stack_ctx);
 BUILTIN_FUNCTION(ty_coro);
+BUILTIN_FUNCTION(ty_profile_start);
+BUILTIN_FUNCTION(ty_profile_stop);
+BUILTIN_FUNCTION(ty_profile_running);
+BUILTIN_FUNCTION(ty_profile_reset);
+BUILTIN_FUNCTION(ty_profile_report);
+BUILTIN_FUNCTION(ty_profile_samples);
+BUILTIN_FUNCTION(ty_profile_folded);
+BUILTIN_FUNCTION(ty_profile_pprof);
+BUILTIN_FUNCTION(ty_profile_heap_start);
+BUILTIN_FUNCTION(ty_profile_heap_stop);
+BUILTIN_FUNCTION(ty_profile_heap_running);
+BUILTIN_FUNCTION(ty_profile_heap_reset);
+BUILTIN_FUNCTION(ty_profile_heap_report);
+BUILTIN_FUNCTION(ty_profile_heap_pprof);
+BUILTIN_FUNCTION(ty_profile_counters);
+BUILTIN_FUNCTION(ty_profile_jit_code);
+BUILTIN_FUNCTION(ty_tracing_start);
+BUILTIN_FUNCTION(ty_tracing_stop);
+BUILTIN_FUNCTION(ty_tracing_running);
+BUILTIN_FUNCTION(ty_tracing_reset);
+BUILTIN_FUNCTION(ty_tracing_json);
+BUILTIN_FUNCTION(ty_tracing_span);
+BUILTIN_FUNCTION(ty_tracing_begin);
+BUILTIN_FUNCTION(ty_tracing_end);
+BUILTIN_FUNCTION(ty_tracing_instant);
 BUILTIN_FUNCTION(ty_type_type);
 BUILTIN_FUNCTION(ty_type_resolve);
 BUILTIN_FUNCTION(ty_type_info);
@@ -12,6 +12,7 @@
 #include "vec.h"
 #include "log.h"
 #include "alloc.h"
+#include "sampler.h"
 
 void
 DoGC(Ty *ty);
@@ -75,6 +76,23 @@ gc(Ty *ty);
 inline static void *
 mrealloc(void *p, usize n);
 
+// See the allocation profiler in sampler.c
+inline static void
+SampleAlloc(Ty *ty, struct alloc const *a)
+{
+        if (UNLIKELY((ty->heap_sample_left -= a->size) < 0)) {
+                sampler_heap_alloc(ty, a);
+        }
+}
+
+inline static void
+ForgetSampledAlloc(struct alloc const *a)
+{
+        if (UNLIKELY(atomic_load_explicit(&HeapSamplesLive, memory_order_relaxed) != 0)) {
+                sampler_heap_free(a);
+        }
+}
+
 inline static void *
 gc_resize_unchecked(Ty *ty, void *p, usize n) {
         struct alloc *a;
@@ -89,6 +107,10 @@ gc_resize_unchecked(Ty *ty, void *p, usize n) {
         MemoryUsed += n;
         AddToTotalBytes(n);
 
+        if (a != NULL) {
+                ForgetSampledAlloc(a);
+        }
+
         a = ty_realloc(a, sizeof *a + n);
         if (UNLIKELY(a == NULL)) {
                 panic("Out of memory!");
@@ -96,6 +118,12 @@ gc_resize_unchecked(Ty *ty, void *p, usize n) {
 
         a->size = n;
 
+        if (p == NULL) {
+                a->type = GC_ANY;
+        }
+
+        SampleAlloc(ty, a);
+
         return a->data;
 }
 
@@ -134,6 +162,8 @@ gc_alloc(Ty *ty, usize n)
         atomic_init(&a->mark, false);
         atomic_init(&a->hard, 0);
 
+        SampleAlloc(ty, a);
+
         return a->data;
 }
 
@@ -152,6 +182,8 @@ gc_alloc0(Ty *ty, usize n)
         a->size = n;
         a->type = GC_ANY;
 
+        SampleAlloc(ty, a);
+
         return a->data;
 }
 
@@ -171,6 +203,8 @@ gc_alloc_unchecked(Ty *ty, usize n)
         atomic_init(&a->mark, false);
         atomic_init(&a->hard, 0);
 
+        SampleAlloc(ty, a);
+
         return a->data;
 }
 
@@ -188,6 +222,8 @@ gc_alloc0_unchecked(Ty *ty, usize n)
         a->size = n;
         a->type = GC_ANY;
 
+        SampleAlloc(ty, a);
+
         return a->data;
 }
 
@@ -213,6 +249,7 @@ gc_alloc_object(Ty *ty, usize n, char type)
         a->size = n;
 
         AddAlloc(ty, a);
+        SampleAlloc(ty, a);
 
         return a->data;
 }
@@ -238,6 +275,7 @@ gc_alloc_object_unchecked(Ty *ty, usize n, char type)
         a->size = n;
 
         AddAlloc(ty, a);
+        SampleAlloc(ty, a);
 
         return a->data;
 }
@@ -262,6 +300,7 @@ gc_alloc_object0(Ty *ty, usize n, char type)
         a->size = n;
 
         AddAlloc(ty, a);
+        SampleAlloc(ty, a);
 
         return a->data;
 }
@@ -285,6 +324,7 @@ gc_alloc_object0_unchecked(Ty *ty, usize n, char type)
         a->size = n;
 
         AddAlloc(ty, a);
+        SampleAlloc(ty, a);
 
         return a->data;
 }
@@ -317,6 +357,7 @@ gc_free(Ty *ty, void *p)
                 } else {
                         MemoryUsed -= a->size;
                 }
+                ForgetSampledAlloc(a);
                 ty_free(a);
         }
 }
@@ -341,6 +382,10 @@ gc_resize(Ty *ty, void *p, usize n) {
 
         CheckUsed(ty);
 
+        if (a != NULL) {
+                ForgetSampledAlloc(a);
+        }
+
         a = ty_realloc(a, sizeof *a + n);
         if (UNLIKELY(a == NULL)) {
                 panic("Out of memory!");
@@ -348,6 +393,12 @@ gc_resize(Ty *ty, void *p, usize n) {
 
         a->size = n;
 
+        if (p == NULL) {
+                a->type = GC_ANY;
+        }
+
+        SampleAlloc(ty, a);
+
         return a->data;
 }
 
@@ -3,15 +3,56 @@
 
 #include "ty.h"
 
+typedef struct {
+        usize max_depth;
+        usize max_size;
+        bool array;
+        bool xd;
+        bool final;
+} JsonFeedOptions;
+
+typedef struct {
+        int indent;
+        int precision;
+        bool single;
+} JsonWriteOptions;
+
 Value
 json_parse(Ty *ty, char const *s, usize n);
 
 Value
 json_parse_xD(Ty *ty, char const *s, usize n);
 
+Value
+json_feed(Ty *ty, Blob *buf, imax *state, JsonFeedOptions const *opts);
+
+Value
+json_index(Ty *ty, char const *s, usize n);
+
+Value
+json_lazy_child(Ty *ty, Value const *src, Value const *index, imax at, Value const *key);
+
+Value
+json_lazy_path(Ty *ty, Value const *src, Value const *index, imax at, char const *path, usize n);
+
+Value
+json_lazy_kind(Ty *ty, Value const *src, Value const *index, imax at);
+
+Value
+json_lazy_count(Ty *ty, Value const *src, Value const *index, imax at);
+
+Value
+json_lazy_children(Ty *ty, Value const *src, Value const *index, imax at);
+
+Value
+json_lazy_value(Ty *ty, Value const *src, Value const *index, imax at, bool records);
+
 Value
 json_encode(Ty *ty, Value const *v);
 
+imax
+json_write(Ty *ty, int fd, Blob *blob, Value const *v, JsonWriteOptions const *opts);
+
 bool
 json_dump(Ty *ty, Value const  *v, byte_vector *out);
 
@@ -20,6 +20,15 @@ parse_ex(
         TokenVector *tokens_out
 );
 
+struct statement *
+parse_at(
+        Ty *,
+        char const *source,
+        char const *file,
+        Location const *where,
+        TokenVector *tokens_io
+);
+
 Token
 parse_get_token(Ty *ty, int i);
 
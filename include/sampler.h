@@ -0,0 +1,84 @@
+#ifndef SAMPLER_H_INCLUDED
+#define SAMPLER_H_INCLUDED
+
+#include "ty.h"
+
+#define SAMPLER_DEFAULT_HZ 1000
+#define SAMPLER_HEAP_DEFAULT_RATE (512 * 1024)
+#define SAMPLER_COUNTERS 3
+
+extern _Atomic(usize) HeapSamplesLive;
+
+bool
+sampler_start(int hz);
+
+bool
+sampler_stop(void);
+
+bool
+sampler_running(void);
+
+void
+sampler_reset(void);
+
+void
+sampler_thread_exit(void);
+
+void
+sampler_report(Ty *ty, byte_vector *out);
+
+Value
+sampler_samples(Ty *ty);
+
+void
+sampler_folded(Ty *ty, byte_vector *out);
+
+void
+sampler_pprof(Ty *ty, byte_vector *out);
+
+void
+sampler_jit_code(void const *code, usize size, Expr const *expr, char const *name);
+
+bool
+sampler_perf_map(void);
+
+void
+sampler_set_output(char const *path);
+
+void
+sampler_dump(void);
+
+bool
+sampler_heap_start(isize rate);
+
+bool
+sampler_heap_stop(void);
+
+bool
+sampler_heap_running(void);
+
+void
+sampler_heap_reset(void);
+
+void
+sampler_heap_alloc(Ty *ty, struct alloc const *a);
+
+void
+sampler_heap_free(struct alloc const *a);
+
+void
+sampler_heap_report(Ty *ty, byte_vector *out);
+
+void
+sampler_heap_pprof(Ty *ty, byte_vector *out);
+
+void
+sampler_heap_set_output(char const *path);
+
+void
+sampler_heap_dump(void);
+
+bool
+sampler_counters(i64 *out);
+
+#endif
@@ -27,7 +27,9 @@
         X(NAMESPACE,   Namespace,  5)  \
         X(ACTIVE,      Active,     6)  \
         X(FUNCTION,    Function,   7)  \
-        X(RELOADING,   Reloading,  8)
+        X(RELOADING,   Reloading,  8)  \
+        X(CATCH,       Catch,      9)  \
+        X(CAUGHT,      Caught,    10)
 
 
 #define X(f, _, i) SCOPE_##f = (1 << i),
@@ -0,0 +1,417 @@
+#ifndef SORT_H_INCLUDED
+#define SORT_H_INCLUDED
+
+#include "ty.h"
+
+/*
+ * Pattern-defeating quicksort (Orson Peters), with the branchless block
+ * partitioning from BlockQuicksort.
+ *
+ * DEFINE_PDQSORT(name, T, LESS) defines
+ *
+ *     static void name(Ty *ty, T *xs, usize n);
+ *
+ * LESS(a, b) receives two `T *` and must implement a strict weak ordering.
+ * `ty` is in scope, so LESS may call back into the VM, but it should be as
+ * cheap as possible: the partition loop evaluates it for every element
+ * without branching on the result.
+ *
+ * The sort is not stable.
+ */
+
+#define PDQ_INSERTION_SORT_THRESHOLD 24
+#define PDQ_NINTHER_THRESHOLD        128
+#define PDQ_PARTIAL_INSERTION_LIMIT  8
+#define PDQ_BLOCK_SIZE               64
+
+#define DEFINE_PDQSORT(NAME, T, LESS)                                                              \
+inline static void                                                                                 \
+NAME##_swap(T *a, T *b)                                                                            \
+{                                                                                                  \
+        T t = *a;                                                                                  \
+        *a = *b;                                                                                   \
+        *b = t;                                                                                    \
+}                                                                                                  \
+                                                                                                   \
+inline static void                                                                                 \
+NAME##_sort2(Ty *ty, T *a, T *b)                                                                   \
+{                                                                                                  \
+        if (LESS(b, a)) {                                                                          \
+                NAME##_swap(a, b);                                                                 \
+        }                                                                                          \
+}                                                                                                  \
+                                                                                                   \
+inline static void                                                                                 \
+NAME##_sort3(Ty *ty, T *a, T *b, T *c)                                                             \
+{                                                                                                  \
+        NAME##_sort2(ty, a, b);                                                                    \
+        NAME##_sort2(ty, b, c);                                                                    \
+        NAME##_sort2(ty, a, b);                                                                    \
+}                                                                                                  \
+                                                                                                   \
+static void                                                                                        \
+NAME##_insertion(Ty *ty, T *begin, T *end, bool guarded)                                           \
+{                                                                                                  \
+        for (T *cur = begin + 1; cur < end; ++cur) {                                               \
+                if (LESS(cur, cur - 1)) {                                                          \
+                        T tmp = *cur;                                                              \
+                        T *sift = cur;                                                             \
+                        do {                                                                       \
+                                *sift = *(sift - 1);                                               \
+                                sift -= 1;                                                         \
+                        } while ((!guarded || sift != begin) && LESS(&tmp, sift - 1));             \
+                        *sift = tmp;                                                               \
+                }                                                                                  \
+        }                                                                                          \
+}                                                                                                  \
+                                                                                                   \
+static bool                                                                                        \
+NAME##_partial_insertion(Ty *ty, T *begin, T *end)                                                 \
+{                                                                                                  \
+        usize moved = 0;                                                                           \
+                                                                                                   \
+        for (T *cur = begin + 1; cur < end; ++cur) {                                               \
+                if (moved > PDQ_PARTIAL_INSERTION_LIMIT) {                                         \
+                        return false;                                                              \
+                }                                                                                  \
+                if (LESS(cur, cur - 1)) {                                                          \
+                        T tmp = *cur;                                                              \
+                        T *sift = cur;                                                             \
+                        do {                                                                       \
+                                *sift = *(sift - 1);                                               \
+                                sift -= 1;                                                         \
+                        } while (sift != begin && LESS(&tmp, sift - 1));                           \
+                        *sift = tmp;                                                               \
+                        moved += cur - sift;                                                       \
+                }                                                                                  \
+        }                                                                                          \
+                                                                                                   \
+        return true;                                                                               \
+}                                                                                                  \
+                                                                                                   \
+static void                                                                                        \
+NAME##_sift_down(Ty *ty, T *xs, usize i, usize n)                                                  \
+{                                                                                                  \
+        for (;;) {                                                                                 \
+                usize child = 2 * i + 1;                                                           \
+                if (child >= n) {                                                                  \
+                        break;                                                                     \
+                }                                                                                  \
+                if (child + 1 < n && LESS(&xs[child], &xs[child + 1])) {                           \
+                        child += 1;                                                                \
+                }                                                                                  \
+                if (!LESS(&xs[i], &xs[child])) {                                                   \
+                        break;                                                                     \
+                }                                                                                  \
+                NAME##_swap(&xs[i], &xs[child]);                                                   \
+                i = child;                                                                         \
+        }                                                                                          \
+}                                                                                                  \
+                                                                                                   \
+static void                                                                                        \
+NAME##_heapsort(Ty *ty, T *begin, T *end)                                                          \
+{                                                                                                  \
+        usize n = end - begin;                                                                     \
+                                                                                                   \
+        for (usize i = n / 2; i-- > 0;) {                                                          \
+                NAME##_sift_down(ty, begin, i, n);                                                 \
+        }                                                                                          \
+                                                                                                   \
+        while (n > 1) {                                                                            \
+                NAME##_swap(&begin[0], &begin[--n]);                                               \
+                NAME##_sift_down(ty, begin, 0, n);                                                 \
+        }                                                                                          \
+}                                                                                                  \
+                                                                                                   \
+/* Moves num elements between the two blocks. With use_swaps == false this                         \
+ * does a single cyclic permutation, which is cheaper when the number of                           \
+ * misplaced elements on each side differs. */                                                     \
+inline static void                                                                                 \
+NAME##_swap_offsets(                                                                               \
+        T *first,                                                                                  \
+        T *last,                                                                                   \
+        u8 const *offsets_l,                                                                       \
+        u8 const *offsets_r,                                                                       \
+        usize num,                                                                                 \
+        bool use_swaps                                                                             \
+)                                                                                                  \
+{                                                                                                  \
+        if (use_swaps) {                                                                           \
+                for (usize i = 0; i < num; ++i) {                                                  \
+                        NAME##_swap(first + offsets_l[i], last - offsets_r[i]);                    \
+                }                                                                                  \
+        } else if (num > 0) {                                                                      \
+                T *l = first + offsets_l[0];                                                       \
+                T *r = last - offsets_r[0];                                                        \
+                T tmp = *l;                                                                        \
+                *l = *r;                                                                           \
+                for (usize i = 1; i < num; ++i) {                                                  \
+                        l = first + offsets_l[i];                                                  \
+                        *r = *l;                                                                   \
+                        r = last - offsets_r[i];                                                   \
+                        *l = *r;                                                                   \
+                }                                                                                  \
+                *r = tmp;                                                                          \
+        }                                                                                          \
+}                                                                                                  \
+                                                                                                   \
+/* Partitions [begin, end) around *begin. Elements equal to the pivot end                          \
+ * up on the right. Uses BlockQuicksort-style offset buffers so that the                           \
+ * comparisons don't feed into branches. */                                                        \
+static T *                                                                                         \
+NAME##_partition_right(Ty *ty, T *begin, T *end, bool *already_partitioned)                        \
+{                                                                                                  \
+        T pivot = *begin;                                                                          \
+        T *first = begin;                                                                          \
+        T *last = end;                                                                             \
+                                                                                                   \
+        do {                                                                                       \
+                ++first;                                                                           \
+        } while (LESS(first, &pivot));                                                             \
+                                                                                                   \
+        if (first - 1 == begin) {                                                                  \
+                while (first < last) {                                                             \
+                        --last;                                                                    \
+                        if (LESS(last, &pivot)) {                                                  \
+                                break;                                                             \
+                        }                                                                          \
+                }                                                                                  \
+        } else {                                                                                   \
+                do {                                                                               \
+                        --last;                                                                    \
+                } while (!LESS(last, &pivot));                                                     \
+        }                                                                                          \
+                                                                                                   \
+        *already_partitioned = (first >= last);                                                    \
+                                                                                                   \
+        if (!*already_partitioned) {                                                               \
+                NAME##_swap(first, last);                                                          \
+                ++first;                                                                           \
+                                                                                                   \
+                u8 offsets_l_buf[PDQ_BLOCK_SIZE];                                                  \
+                u8 offsets_r_buf[PDQ_BLOCK_SIZE];                                                  \
+                u8 *offsets_l = offsets_l_buf;                                                     \
+                u8 *offsets_r = offsets_r_buf;                                                     \
+                                                                                                   \
+                T *offsets_l_base = first;                                                         \
+                T *offsets_r_base = last;                                                          \
+                usize num_l = 0;                                                                   \
+                usize num_r = 0;                                                                   \
+                usize start_l = 0;                                                                 \
+                usize start_r = 0;                                                                 \
+                                                                                                   \
+                while (first < last) {                                                             \
+                        usize num_unknown = last - first;                                          \
+                        usize left_split = 0;                                                      \
+                        usize right_split = 0;                                                     \
+                                                                                                   \
+                        if (num_l == 0) {                                                          \
+                                left_split = (num_r == 0) ? num_unknown / 2 : num_unknown;         \
+                        }                                                                          \
+                                                                                                   \
+                        if (num_r == 0) {                                                          \
+                                right_split = num_unknown - left_split;                            \
+                        }                                                                          \
+                                                                                                   \
+                        if (left_split >= PDQ_BLOCK_SIZE) {                                        \
+                                left_split = PDQ_BLOCK_SIZE;                                       \
+                        }                                                                          \
+                        for (usize i = 0; i < left_split; ++i) {                                   \
+                                offsets_l[num_l] = i;                                              \
+                                num_l += !LESS(first, &pivot);                                     \
+                                ++first;                                                           \
+                        }                                                                          \
+                                                                                                   \
+                        if (right_split >= PDQ_BLOCK_SIZE) {                                       \
+                                right_split = PDQ_BLOCK_SIZE;                                      \
+                        }                                                                          \
+                        for (usize i = 0; i < right_split;) {                                      \
+                                offsets_r[num_r] = ++i;                                            \
+                                --last;                                                            \
+                                num_r += LESS(last, &pivot);                                       \
+                        }                                                                          \
+                                                                                                   \
+                        usize num = (num_l < num_r) ? num_l : num_r;                               \
+                        NAME##_swap_offsets(                                                       \
+                                offsets_l_base,                                                    \
+                                offsets_r_base,                                                    \
+                                offsets_l + start_l,                                               \
+                                offsets_r + start_r,                                               \
+                                num,                                                               \
+                                num_l == num_r                                                     \
+                        );                                                                         \
+                        num_l -= num;                                                              \
+                        num_r -= num;                                                              \
+                        start_l += num;                                                            \
+                        start_r += num;                                                            \
+                                                                                                   \
+                        if (num_l == 0) {                                                          \
+                                start_l = 0;                                                       \
+                                offsets_l_base = first;                                            \
+                        }                                                                          \
+                                                                                                   \
+                        if (num_r == 0) {                                                          \
+                                start_r = 0;                                                       \
+                                offsets_r_base = last;                                             \
+                        }                                                                          \
+                }                                                                                  \
+                                                                                                   \
+                if (num_l > 0) {                                                                   \
+                        offsets_l += start_l;                                                      \
+                        while (num_l-- > 0) {                                                      \
+                                NAME##_swap(offsets_l_base + offsets_l[num_l], --last);            \
+                        }                                                                          \
+                        first = last;                                                              \
+                }                                                                                  \
+                                                                                                   \
+                if (num_r > 0) {                                                                   \
+                        offsets_r += start_r;                                                      \
+                        while (num_r-- > 0) {                                                      \
+                                NAME##_swap(offsets_r_base - offsets_r[num_r], first);             \
+                                ++first;                                                           \
+                        }                                                                          \
+                        last = first;                                                              \
+                }                                                                                  \
+        }                                                                                          \
+                                                                                                   \
+        T *pivot_pos = first - 1;                                                                  \
+        *begin = *pivot_pos;                                                                       \
+        *pivot_pos = pivot;                                                                        \
+                                                                                                   \
+        return pivot_pos;                                                                          \
+}                                                                                                  \
+                                                                                                   \
+/* Partitions [begin, end) so that elements equal to the pivot end up on the                       \
+ * left. Used when the pivot is known to equal its left neighbour, which                           \
+ * makes runs of equal elements collapse in linear time. */                                        \
+static T *                                                                                         \
+NAME##_partition_left(Ty *ty, T *begin, T *end)                                                    \
+{                                                                                                  \
+        T pivot = *begin;                                                                          \
+        T *first = begin;                                                                          \
+        T *last = end;                                                                             \
+                                                                                                   \
+        do {                                                                                       \
+                --last;                                                                            \
+        } while (LESS(&pivot, last));                                                              \
+                                                                                                   \
+        if (last + 1 == end) {                                                                     \
+                while (first < last) {                                                             \
+                        ++first;                                                                   \
+                        if (LESS(&pivot, first)) {                                                 \
+                                break;                                                             \
+                        }                                                                          \
+                }                                                                                  \
+        } else {                                                                                   \
+                do {                                                                               \
+                        ++first;                                                                   \
+                } while (!LESS(&pivot, first));                                                    \
+        }                                                                                          \
+                                                                                                   \
+        while (first < last) {                                                                     \
+                NAME##_swap(first, last);                                                          \
+                do {                                                                               \
+                        --last;                                                                    \
+                } while (LESS(&pivot, last));                                                      \
+                do {                                                                               \
+                        ++first;                                                                   \
+                } while (!LESS(&pivot, first));                                                    \
+        }                                                                                          \
+                                                                                                   \
+        T *pivot_pos = last;                                                                       \
+        *begin = *pivot_pos;                                                                       \
+        *pivot_pos = pivot;                                                                        \
+                                                                                                   \
+        return pivot_pos;                                                                          \
+}                                                                                                  \
+                                                                                                   \
+static void                                                                                        \
+NAME##_loop(Ty *ty, T *begin, T *end, int bad_allowed, bool leftmost)                              \
+{                                                                                                  \
+        for (;;) {                                                                                 \
+                usize size = end - begin;                                                          \
+                                                                                                   \
+                if (size < PDQ_INSERTION_SORT_THRESHOLD) {                                         \
+                        NAME##_insertion(ty, begin, end, leftmost);                                \
+                        return;                                                                    \
+                }                                                                                  \
+                                                                                                   \
+                usize s2 = size / 2;                                                               \
+                if (size > PDQ_NINTHER_THRESHOLD) {                                                \
+                        NAME##_sort3(ty, begin, begin + s2, end - 1);                              \
+                        NAME##_sort3(ty, begin + 1, begin + (s2 - 1), end - 2);                    \
+                        NAME##_sort3(ty, begin + 2, begin + (s2 + 1), end - 3);                    \
+                        NAME##_sort3(ty, begin + s2 - 1, begin + s2, begin + s2 + 1);              \
+                        NAME##_swap(begin, begin + s2);                                            \
+                } else {                                                                           \
+                        NAME##_sort3(ty, begin + s2, begin, end - 1);                              \
+                }                                                                                  \
+                                                                                                   \
+                if (!leftmost && !LESS(begin - 1, begin)) {                                        \
+                        begin = NAME##_partition_left(ty, begin, end) + 1;                         \
+                        continue;                                                                  \
+                }                                                                                  \
+                                                                                                   \
+                bool already_partitioned;                                                          \
+                T *pivot_pos = NAME##_partition_right(ty, begin, end, &already_partitioned);       \
+                                                                                                   \
+                usize l_size = pivot_pos - begin;                                                  \
+                usize r_size = end - (pivot_pos + 1);                                              \
+                                                                                                   \
+                if (l_size < size / 8 || r_size < size / 8) {                                      \
+                        if (--bad_allowed == 0) {                                                  \
+                                NAME##_heapsort(ty, begin, end);                                   \
+                                return;                                                            \
+                        }                                                                          \
+                                                                                                   \
+                        if (l_size >= PDQ_INSERTION_SORT_THRESHOLD) {                              \
+                                NAME##_swap(begin, begin + l_size / 4);                            \
+                                NAME##_swap(pivot_pos - 1, pivot_pos - l_size / 4);                \
+                                if (l_size > PDQ_NINTHER_THRESHOLD) {                              \
+                                        NAME##_swap(begin + 1, begin + (l_size / 4 + 1));          \
+                                        NAME##_swap(begin + 2, begin + (l_size / 4 + 2));          \
+                                        NAME##_swap(pivot_pos - 2, pivot_pos - (l_size / 4 + 1));  \
+                                        NAME##_swap(pivot_pos - 3, pivot_pos - (l_size / 4 + 2));  \
+                                }                                                                  \
+                        }                                                                          \
+                                                                                                   \
+                        if (r_size >= PDQ_INSERTION_SORT_THRESHOLD) {                              \
+                                NAME##_swap(pivot_pos + 1, pivot_pos + (1 + r_size / 4));          \
+                                NAME##_swap(end - 1, end - r_size / 4);                            \
+                                if (r_size > PDQ_NINTHER_THRESHOLD) {                              \
+                                        NAME##_swap(pivot_pos + 2, pivot_pos + (2 + r_size / 4));  \
+                                        NAME##_swap(pivot_pos + 3, pivot_pos + (3 + r_size / 4));  \
+                                        NAME##_swap(end - 2, end - (1 + r_size / 4));              \
+                                        NAME##_swap(end - 3, end - (2 + r_size / 4));              \
+                                }                                                                  \
+                        }                                                                          \
+                } else if (                                                                        \
+                        already_partitioned                                                        \
+                     && NAME##_partial_insertion(ty, begin, pivot_pos)                             \
+                     && NAME##_partial_insertion(ty, pivot_pos + 1, end)                           \
+                ) {                                                                                \
+                        return;                                                                    \
+                }                                                                                  \
+                                                                                                   \
+                NAME##_loop(ty, begin, pivot_pos, bad_allowed, leftmost);                          \
+                begin = pivot_pos + 1;                                                             \
+                leftmost = false;                                                                  \
+        }                                                                                          \
+}                                                                                                  \
+                                                                                                   \
+static void                                                                                        \
+NAME(Ty *ty, T *xs, usize n)                                                                       \
+{                                                                                                  \
+        if (n < 2) {                                                                               \
+                return;                                                                            \
+        }                                                                                          \
+                                                                                                   \
+        int log2n = 0;                                                                             \
+        while ((n >> log2n) > 1) {                                                                 \
+                log2n += 1;                                                                        \
+        }                                                                                          \
+                                                                                                   \
+        NAME##_loop(ty, xs, xs + n, log2n, true);                                                  \
+}
+
+#endif
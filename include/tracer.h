@@ -0,0 +1,52 @@
+#ifndef TRACER_H_INCLUDED
+#define TRACER_H_INCLUDED
+
+#include "ty.h"
+
+extern atomic_bool Tracing;
+
+#define TRACING() UNLIKELY(atomic_load_explicit(&Tracing, memory_order_relaxed))
+
+bool
+tracer_start(void);
+
+bool
+tracer_stop(void);
+
+void
+tracer_reset(void);
+
+u64
+tracer_now(void);
+
+void
+tracer_begin(char const *name, char const *cat);
+
+void
+tracer_end(void);
+
+void
+tracer_complete(char const *name, char const *cat, u64 start, char const *detail);
+
+void
+tracer_instant(char const *name, char const *cat, char const *detail);
+
+void
+tracer_unlocked(bool blocked);
+
+void
+tracer_locked(void);
+
+char const *
+tracer_intern(char const *s, usize n);
+
+void
+tracer_json(byte_vector *out);
+
+void
+tracer_set_output(char const *path);
+
+void
+tracer_dump(void);
+
+#endif
@@ -126,12 +126,32 @@ typedef struct blob {
 
 typedef struct regex {
         pcre2_code *pcre2;
+        // JIT-compiled copy of pcre2, made the first time the regex is
+        // matched against; pcre2 itself if JIT compilation failed
+        _Atomic(pcre2_code *) jit;
         char const *pattern;
         bool gc;
         bool detailed;
         u32 ncap;
 } Regex;
 
+typedef struct {
+        u64    hash;
+        u64    used;
+        u32    options;
+        u32    len;
+        Regex *re;
+} RegexCacheEntry;
+
+typedef struct {
+        TyMutex lock;
+        vec(RegexCacheEntry) entries;
+        u64 tick;
+        u64 hits;
+        u64 misses;
+        u64 evictions;
+} RegexCache;
+
 typedef struct {
         char *name;
         char *proto;
@@ -523,6 +543,7 @@ typedef struct thread_group {
         TyCondVar   GCPhaseCond;
         int         GCPhase;
 
+        RegexCache  Regexes;
 } ThreadGroup;
 
 struct thread {
@@ -616,6 +637,7 @@ struct try {
 
         bool executing;
         bool need_trace;
+        bool catch_all;
 
         u8 state;
 
@@ -742,6 +764,7 @@ typedef struct ty {
 
         isize memory_used;
         isize memory_limit;
+        isize heap_sample_left;
 
         AllocList allocs;
         ThreadGroup *group;
@@ -891,6 +914,7 @@ extern bool NoJIT;
 extern bool CompileOnly;
 extern bool AllowErrors;
 extern bool InteractiveSession;
+extern bool TypeStats;
 
 extern u64 TypeCheckCounter;
 extern u64 TypeAllocCounter;
@@ -1411,6 +1435,18 @@ enum {
 
 #define STACK (ty->stack)
 
+pcre2_code *
+regex_jit(Regex const *re);
+
+// The code to match re with: regexes are only JIT-compiled once they're
+// actually used, which most of the ones in a program's source never are
+inline static pcre2_code *
+regex_code(Regex const *re)
+{
+        pcre2_code *code = atomic_load_explicit(&re->jit, memory_order_acquire);
+        return LIKELY(code != NULL) ? code : regex_jit(re);
+}
+
 inline static void *
 mrealloc(void *p, usize n)
 {
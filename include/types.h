@@ -154,6 +154,7 @@ struct type {
                 char const *str;
         };
         Expr const *src;
+        Type *canon;
 };
 
 struct type_env {
@@ -485,6 +486,18 @@ types_reset(Ty *ty);
 void
 types_reset_names(Ty *ty);
 
+void
+types_forget_checks(Ty *ty);
+
+int
+types_stats_begin(Ty *ty, char const *module);
+
+void
+types_stats_end(Ty *ty, int depth);
+
+void
+types_stats_dump(void);
+
 inline static Type *
 iterable_type_for(Ty *ty, Expr const *e, Type *t0)
 {
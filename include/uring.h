@@ -0,0 +1,7 @@
+#ifndef URING_H_INCLUDED
+#define URING_H_INCLUDED
+
+void
+uring_load(Ty *ty);
+
+#endif
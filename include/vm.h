@@ -34,6 +34,9 @@ Forget(Ty *ty, Value *v, AllocList *allocs);
 void
 DoGC(Ty *ty);
 
+void
+GCStats(u64 *count, u64 *pause, u64 *max_pause);
+
 void
 DoTargetMember(Ty *ty, Value v, i32 z);
 
@@ -231,6 +234,28 @@ ActiveFun(Ty *ty)
         return FrameFun(ty, vvL(ty->st->frames));
 }
 
+void
+GrowFrameStack(FrameStack *frames);
+
+/*
+ * The sampler's SIGPROF handler walks the frame stack of the thread it
+ * interrupts, so a frame is filled in before it's counted, and the stack
+ * never grows in place (see GrowFrameStack()).
+ */
+inline static void
+PushFrame(Ty *ty, Frame frame)
+{
+        FrameStack *frames = &ty->st->frames;
+
+        if (UNLIKELY(vN(*frames) == vC(*frames))) {
+                GrowFrameStack(frames);
+        }
+
+        *vZ(*frames) = frame;
+        atomic_signal_fence(memory_order_release);
+        vN(*frames) += 1;
+}
+
 Value
 TyActiveGenerator(Ty *ty);
 
@@ -1,6 +1,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <math.h>
 
 #include "value.h"
 #include "gc.h"
@@ -10,6 +11,7 @@
 #include "operators.h"
 #include "xd.h"
 #include "vm.h"
+#include "sort.h"
 #include "ty.h"
 
 static Value
@@ -44,51 +46,323 @@ compare_default(void const *v1, void const *v2, void *ty)
 
 static int
 #if defined(__APPLE__) || defined(_WIN32)
-compare_by(void *ctx_, void const *v1, void const *v2)
+compare_by2(void *ctx_, void const *v1, void const *v2)
 #elif defined(__linux__)
-compare_by(void const *v1, void const *v2, void *ctx_)
+compare_by2(void const *v1, void const *v2, void *ctx_)
 #endif
 {
         SortContext *ctx = ctx_;
         Ty *ty = ctx->ty;
 
-        Value k1 = vm_call1(ty, &ctx->f, (Value *)v1);
-        gP(&k1);
+        Value v = vm_eval_function(ty, &ctx->f, v1, v2, NULL);
+        gP(&v);
 
-        Value k2 = vm_call1(ty, &ctx->f, (Value *)v2);
-        gP(&k2);
+        int result;
 
-        int result = value_compare(ty, &k1, &k2);
+        if (v.type == VALUE_INTEGER)
+                result = v.z;
+        else
+                result = value_truthy(ty, &v) ? 1 : -1;
 
-        gX();
         gX();
 
         return result;
 }
 
+/*
+ * Arrays whose elements are all Ints, all (non-NaN) Floats or all Strings are
+ * sorted without going through value_compare(): we know the ordering up front
+ * so we can use a specialised comparator (or no comparator at all, in the
+ * case of radix sort).
+ */
+enum {
+        SORT_GENERIC,
+        SORT_INT,
+        SORT_REAL,
+        SORT_STRING
+};
+
+#define RADIX_SORT_THRESHOLD 256
+
+typedef struct {
+        u64 prefix;
+        Value key;
+        usize i;
+} SortItem;
+
+inline static int
+sort_class(Value const *v)
+{
+        switch (v->type & ~VALUE_TAGGED) {
+        case VALUE_INTEGER: return SORT_INT;
+        case VALUE_REAL:    return isnan(v->real) ? SORT_GENERIC : SORT_REAL;
+        case VALUE_STRING:  return SORT_STRING;
+        default:            return SORT_GENERIC;
+        }
+}
+
+static int
+sort_class_of(Value const *xs, usize n, usize stride)
+{
+        if (n == 0) {
+                return SORT_GENERIC;
+        }
+
+        int class = sort_class(xs);
+
+        for (usize i = 1; i < n && class != SORT_GENERIC; ++i) {
+                xs = (Value const *)((char const *)xs + stride);
+                if (sort_class(xs) != class) {
+                        return SORT_GENERIC;
+                }
+        }
+
+        return class;
+}
+
+/* First 8 bytes of the string as a big-endian integer, zero-padded */
+inline static u64
+string_prefix(Value const *s)
+{
+        u8 const *str = ss(*s);
+        usize n = min(sN(*s), 8);
+        u64 prefix = 0;
+
+        for (usize i = 0; i < 8; ++i) {
+                prefix = (prefix << 8) | ((i < n) ? str[i] : 0);
+        }
+
+        return prefix;
+}
+
+inline static int
+string_compare(Value const *a, Value const *b)
+{
+        int c = memcmp(ss(*a), ss(*b), min(sN(*a), sN(*b)));
+        return (c != 0) ? c : ((sN(*a) > sN(*b)) - (sN(*a) < sN(*b)));
+}
+
+inline static bool
+string_item_less(SortItem const *a, SortItem const *b)
+{
+        if (a->prefix != b->prefix) {
+                return a->prefix < b->prefix;
+        }
+
+        int c = string_compare(&a->key, &b->key);
+
+        return (c != 0) ? (c < 0) : (a->i < b->i);
+}
+
+#define INT_LESS(a, b)  ((a)->z < (b)->z)
+#define REAL_LESS(a, b) ((a)->real < (b)->real)
+
+#define ITEM_TIE(a, b) ((a)->i < (b)->i)
+
+#define ITEM_INT_LESS(a, b) (                           \
+        ((a)->key.z != (b)->key.z)                      \
+      ? ((a)->key.z < (b)->key.z)                       \
+      : ITEM_TIE(a, b)                                  \
+)
+
+#define ITEM_REAL_LESS(a, b) (                          \
+        ((a)->key.real != (b)->key.real)                \
+      ? ((a)->key.real < (b)->key.real)                 \
+      : ITEM_TIE(a, b)                                  \
+)
+
+#define ITEM_STRING_LESS(a, b) string_item_less((a), (b))
+
+DEFINE_PDQSORT(pdqsort_ints, Value, INT_LESS)
+DEFINE_PDQSORT(pdqsort_reals, Value, REAL_LESS)
+DEFINE_PDQSORT(pdqsort_int_items, SortItem, ITEM_INT_LESS)
+DEFINE_PDQSORT(pdqsort_real_items, SortItem, ITEM_REAL_LESS)
+DEFINE_PDQSORT(pdqsort_string_items, SortItem, ITEM_STRING_LESS)
+
 static int
 #if defined(__APPLE__) || defined(_WIN32)
-compare_by2(void *ctx_, void const *v1, void const *v2)
+compare_items(void *ty, void const *p1, void const *p2)
 #elif defined(__linux__)
-compare_by2(void const *v1, void const *v2, void *ctx_)
+compare_items(void const *p1, void const *p2, void *ty)
 #endif
 {
-        SortContext *ctx = ctx_;
-        Ty *ty = ctx->ty;
+        SortItem const *a = p1;
+        SortItem const *b = p2;
 
-        Value v = vm_eval_function(ty, &ctx->f, v1, v2, NULL);
-        gP(&v);
+        int c = value_compare(ty, &a->key, &b->key);
 
-        int result;
+        return (c != 0) ? c : (a->i > b->i) - (a->i < b->i);
+}
 
-        if (v.type == VALUE_INTEGER)
-                result = v.z;
-        else
-                result = value_truthy(ty, &v) ? 1 : -1;
+/* LSD radix sort on the (sign-flipped) 64-bit integer value */
+static void
+radix_sort_ints(Ty *ty, Value *xs, usize n)
+{
+#define RADIX_KEY(v) ((u64)(v).z ^ (UINT64_C(1) << 63))
+        SCRATCH_SAVE();
 
-        gX();
+        usize (*counts)[256] = smA0(8 * sizeof *counts);
 
-        return result;
+        for (usize i = 0; i < n; ++i) {
+                u64 k = RADIX_KEY(xs[i]);
+                for (int d = 0; d < 8; ++d) {
+                        counts[d][(k >> (8 * d)) & 0xFF] += 1;
+                }
+        }
+
+        Value *src = xs;
+        Value *dst = smA(n * sizeof (Value));
+
+        for (int d = 0; d < 8; ++d) {
+                int shift = 8 * d;
+
+                // Every element has the same digit here, so this pass is a no-op
+                if (counts[d][(RADIX_KEY(src[0]) >> shift) & 0xFF] == n) {
+                        continue;
+                }
+
+                usize offset = 0;
+                for (int b = 0; b < 256; ++b) {
+                        usize c = counts[d][b];
+                        counts[d][b] = offset;
+                        offset += c;
+                }
+
+                for (usize i = 0; i < n; ++i) {
+                        dst[counts[d][(RADIX_KEY(src[i]) >> shift) & 0xFF]++] = src[i];
+                }
+
+                Value *t = src;
+                src = dst;
+                dst = t;
+        }
+
+        if (src != xs) {
+                memcpy(xs, src, n * sizeof (Value));
+        }
+
+        SCRATCH_RESTORE();
+#undef RADIX_KEY
+}
+
+/*
+ * Sorts the items by key (ties broken by original index, so the result is
+ * stable) and then applies the resulting permutation to xs.
+ */
+static void
+sort_items(Ty *ty, Value *xs, SortItem *items, usize n)
+{
+        switch (sort_class_of(&items[0].key, n, sizeof (SortItem))) {
+        case SORT_INT:
+                pdqsort_int_items(ty, items, n);
+                break;
+
+        case SORT_REAL:
+                pdqsort_real_items(ty, items, n);
+                break;
+
+        case SORT_STRING:
+                for (usize i = 0; i < n; ++i) {
+                        items[i].prefix = string_prefix(&items[i].key);
+                }
+                pdqsort_string_items(ty, items, n);
+                break;
+
+        default:
+                rqsort(items, n, sizeof (SortItem), compare_items, ty);
+        }
+
+        SCRATCH_SAVE();
+
+        Value *sorted = smA(n * sizeof (Value));
+
+        for (usize i = 0; i < n; ++i) {
+                sorted[i] = xs[items[i].i];
+        }
+
+        memcpy(xs, sorted, n * sizeof (Value));
+
+        SCRATCH_RESTORE();
+}
+
+static void
+sort_values(Ty *ty, Value *xs, usize n)
+{
+        SortItem *items;
+
+        if (n < 2) {
+                return;
+        }
+
+        switch (sort_class_of(xs, n, sizeof (Value))) {
+        case SORT_INT:
+                if (n >= RADIX_SORT_THRESHOLD) {
+                        radix_sort_ints(ty, xs, n);
+                } else {
+                        pdqsort_ints(ty, xs, n);
+                }
+                break;
+
+        case SORT_REAL:
+                pdqsort_reals(ty, xs, n);
+                break;
+
+        case SORT_STRING:
+                SCRATCH_SAVE();
+                items = smA(n * sizeof (SortItem));
+                for (usize i = 0; i < n; ++i) {
+                        items[i].key = xs[i];
+                        items[i].i = i;
+                }
+                sort_items(ty, xs, items, n);
+                SCRATCH_RESTORE();
+                break;
+
+        default:
+                rqsort(xs, n, sizeof (Value), compare_default, ty);
+        }
+}
+
+/*
+ * Decorate-sort-undecorate: f is called exactly once per element and the
+ * elements are then ordered by the resulting keys.
+ */
+static void
+sort_values_by(Ty *ty, Value *array, usize i, usize n, Value *f)
+{
+        if (n < 2) {
+                return;
+        }
+
+        Value keys = ARRAY(vA());
+        gP(&keys);
+
+        for (usize j = 0; j < n; ++j) {
+                if (i + j >= vN(*array->array)) {
+                        zP("Array.sort(): array was modified during sort");
+                }
+                Value k = vm_call1(ty, f, v_(*array->array, i + j));
+                vAp(keys.array, k);
+        }
+
+        if (i + n > vN(*array->array)) {
+                zP("Array.sort(): array was modified during sort");
+        }
+
+        SCRATCH_SAVE();
+
+        SortItem *items = smA(n * sizeof (SortItem));
+
+        for (usize j = 0; j < n; ++j) {
+                items[j].key = v__(*keys.array, j);
+                items[j].i = j;
+        }
+
+        sort_items(ty, vv(*array->array) + i, items, n);
+
+        SCRATCH_RESTORE();
+
+        gX();
 }
 
 inline static void
@@ -487,8 +761,7 @@ array_sort(Ty *ty, Value *array, int argc, Value *kwargs)
                 if (!CALLABLE(*by)) {
                         zP("Array.sort(): `by` not callable: %s", VSC(by));
                 }
-                ctx.f = *by;
-                rqsort(array->array->items + i, n, sizeof (Value), compare_by, &ctx);
+                sort_values_by(ty, array, i, n, by);
         } else if (cmp != NULL) {
                 if (!CALLABLE(*cmp)) {
                         zP("Array.sort(): `cmp` not callable: %s", VSC(cmp));
@@ -496,7 +769,7 @@ array_sort(Ty *ty, Value *array, int argc, Value *kwargs)
                 ctx.f = *cmp;
                 rqsort(array->array->items + i, n, sizeof (Value), compare_by2, &ctx);
         } else {
-                rqsort(array->array->items + i, n, sizeof (Value), compare_default, ty);
+                sort_values(ty, vv(*array->array) + i, n);
         }
 
         Value *desc = NAMED("desc");
@@ -2074,15 +2347,7 @@ array_sort_on(Ty *ty, Value *array, int argc, Value *kwargs)
         if (!CALLABLE(f))
                 zP("non-function passed to the Array.sortOn()");
 
-        if (array->array->count == 0)
-                return *array;
-
-        SortContext ctx = {
-                .f = f,
-                .ty = ty
-        };
-
-        rqsort(array->array->items, array->array->count, sizeof (Value), compare_by, &ctx);
+        sort_values_by(ty, array, 0, vN(*array->array), &f);
 
         return *array;
 }
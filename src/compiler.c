@@ -365,6 +365,7 @@ static vec(Module *) modules;
 static vec(ProgramAnnotation) annotations;
 static vec(location_vector) location_lists;
 static vec(Expr const *) source_map;
+static U32Vector source_map_free;
 static JumpGroup PreludeAssertionOffsets;
 static Module *MainModule;
 static Module *GlobalModule;
@@ -457,6 +458,9 @@ emit_return_check(Ty *ty, Expr const *f);
 static void
 emit_try_match(Ty *ty, Expr const *pattern, bool skip_tag);
 
+static int
+classify_pattern(Expr const *p);
+
 static void
 EmitFunctionCall(Ty *ty, Expr const *e);
 
@@ -4722,12 +4726,20 @@ symbolize_expression(Ty *ty, Scope *scope, Expr *e)
                                 );
                         } else {
                                 e->type = EXPRESSION_TRACE;
+                                get_try(ty, 0)->need_trace = true;
                         }
                         break;
                 }
 
                 e->symbol = ResolveIdentifier(ty, e);
 
+                if (
+                        (e->symbol->scope != NULL)
+                     && (e->symbol->scope->flags & SCOPE_CATCH)
+                ) {
+                        e->symbol->scope->flags |= SCOPE_CAUGHT;
+                }
+
                 LOG("var %s local", e->local ? "is" : "is NOT");
 
                 if (e->constraint != NULL && false) {
@@ -6299,8 +6311,17 @@ symbolize_statement(Ty *ty, Scope *scope, Stmt *s)
                 get_try(ty, 0)->ctx = TRY_CATCH;
                 for (int i = 0; i < vN(s->try.patterns); ++i) {
                         Scope *catch = scope_new(ty, "(catch)", scope, false);
+                        catch->flags |= SCOPE_CATCH;
                         symbolize_pattern(ty, catch, v__(s->try.patterns, i), NULL, true);
                         symbolize_statement(ty, catch, v__(s->try.handlers, i));
+                        /*
+                         * A handler that never looks at what it caught can't
+                         * ask for its trace either, so the VM can skip copying
+                         * the locals of every unwound frame when it throws.
+                         */
+                        if (catch->flags & SCOPE_CAUGHT) {
+                                get_try(ty, 0)->need_trace = true;
+                        }
                 }
 
                 get_try(ty, 0)->ctx = TRY_CATCH;
@@ -8117,6 +8138,14 @@ emit_super(Ty *ty, Expr const *e)
 static bool
 emit_try(Ty *ty, Stmt const *s, bool want_result)
 {
+        bool catch_all = false;
+
+        for (int i = 0; i < vN(s->try.patterns); ++i) {
+                if (classify_pattern(v__(s->try.patterns, i)) == PAT_WILDCARD) {
+                        catch_all = true;
+                }
+        }
+
         INSN(TRY);
 
         usize catch_offset = vN(STATE.code);
@@ -8128,6 +8157,9 @@ emit_try(Ty *ty, Stmt const *s, bool want_result)
         usize end_offset = vN(STATE.code);
         Ei32(-1);
 
+        Eu1(s->type == STATEMENT_TRY && s->try.need_trace);
+        Eu1(catch_all);
+
         begin_try(ty);
 
         if (s->type == STATEMENT_TRY_CLEAN) {
@@ -12388,6 +12420,7 @@ InjectRedpill(Ty *ty, Stmt *s)
                         super = class_get(ty, ResolveClassSpec(ty, def->super));
 
                         class_set_super(ty, def->symbol, super->i);
+                        types_forget_checks(ty);
 
                         for (int i = 0; i < vN(def->methods); ++i) {
                                 Expr *m = v__(def->methods, i);
@@ -13017,6 +13050,9 @@ compile(Ty *ty, char const *source)
         Stmt **p;
         Location parse_error_location;
 
+        // Type inference starts during parsing, as operators get defined
+        int stats = types_stats_begin(ty, CurrentModuleName(ty));
+
         PushScope(STATE.global);
 
         if (!parse_ex(
@@ -13042,6 +13078,7 @@ compile(Ty *ty, char const *source)
         }
 
         if (!HAVE_COMPILER_FLAG(RESOLVE)) {
+                types_stats_end(ty, stats);
                 goto NoResolve;
         }
 
@@ -13057,6 +13094,8 @@ compile(Ty *ty, char const *source)
                 p = resolve_prog(ty, p);
         }
 
+        types_stats_end(ty, stats);
+
 #if 0
         if (SuggestCompletions || FindDefinition) {
                 for (usize i = 0; p[i] != NULL; ++i) {
@@ -13253,6 +13292,14 @@ NewModule(
         return mod;
 }
 
+/*
+ * Imports are loaded one at a time, on the importing thread, and there's no
+ * cheap way around that. A module can't be parsed until the modules it
+ * imports are loaded, because their macros and operators change how it
+ * parses, and the lexer takes its context from the parser. Loading a module
+ * also runs its top-level code. Everything here goes through STATE and the
+ * shared intern tables, none of which are thread-safe.
+ */
 static Module *
 load_module(Ty *ty, char const *name, Scope *scope)
 {
@@ -13286,7 +13333,10 @@ load_module(Ty *ty, char const *name, Scope *scope)
         PatchModule(ty, module, prog);
         STATE = save;
 
+        // The module's top-level code isn't part of anyone's type checking
+        int stats = types_stats_begin(ty, NULL);
         vm_exec(ty, module->code);
+        types_stats_end(ty, stats);
         class_finalize_all(ty);
 
         TY_CATCH_END();
@@ -13491,6 +13541,7 @@ compiler_load_builtin_modules(Ty *ty)
         load_module(ty, "ty",     get_module_scope("ty"));
         load_module(ty, "ffi",    get_module_scope("ffi"));
         load_module(ty, "os",     get_module_scope("os"));
+        load_module(ty, "json",   get_module_scope("json"));
         load_module(ty, "pretty", NULL);
         if (RunningTests) {
                 load_module(ty, "ty/test", NULL);
@@ -14008,7 +14059,8 @@ inline static char *
 u32
 source_register(Ty *ty, void const *src)
 {
-        for (u32 i = 0; i < vN(source_map); ++i) {
+        while (vN(source_map_free) > 0) {
+                u32 i = *vvX(source_map_free);
                 if (v__(source_map, i) == NULL) {
                         v__(source_map, i) = (Expr const *)src;
                         return i + 1;
@@ -14039,6 +14091,7 @@ ForgetSourceNodesFrom(void const *_base, usize len)
                 uptr expr = (uptr)v__(source_map, i);
                 if (expr >= base && expr < base + len) {
                         v__(source_map, i) = NULL;
+                        xvP(source_map_free, i);
                 }
         }
 }
@@ -18944,6 +18997,8 @@ DumpProgram(
                         READVALUE(n);
                         READVALUE(n);
                         READVALUE(n);
+                        READVALUE(b);
+                        READVALUE(b);
                         break;
                 }
                 CASE(DROP)
@@ -19718,12 +19773,267 @@ CompilerReloadModule(
         PatchModule(ty, mod, prog);
         v00(STATE.code);
 
+        mod->source = source;
         mod->scope->flags &= ~SCOPE_RELOADING;
         mod->flags &= ~MOD_RELOADING;
 
         return true;
 }
 
+inline static i32
+LineColCmp(Location const *loc, i32 line, i32 col)
+{
+        if (loc->line != line) {
+                return (loc->line < line) ? -1 : 1;
+        }
+
+        return (loc->col < col) ? -1 : (loc->col > col);
+}
+
+static void
+RebaseLocation(
+        Location *loc,
+        char const *old,
+        usize old_len,
+        char const *source,
+        usize edit_end,
+        i32 edit_line,
+        isize delta
+)
+{
+        if (loc->s < old || loc->s > old + old_len) {
+                return;
+        }
+
+        usize off = loc->s - old;
+
+        if (off >= edit_end) {
+                off += delta;
+                if (loc->line == edit_line) {
+                        loc->col += delta;
+                }
+        }
+
+        loc->s    = source + off;
+        loc->byte = off;
+}
+
+static isize
+FindStatementToken(TokenVector const *tokens, isize i, Location const *loc)
+{
+        for (; i < vN(*tokens); ++i) {
+                Token const *t = v_(*tokens, i);
+                if (t->ctx != LEX_FAKE && LineColCmp(&t->start, loc->line, loc->col) >= 0) {
+                        return i;
+                }
+        }
+
+        return vN(*tokens);
+}
+
+/*
+ * Apply an edit confined to one line of a single top-level function body
+ * without recompiling the rest of the module: only that function is re-lexed,
+ * re-parsed and re-checked, and the module's tokens are spliced around it.
+ *
+ * Nothing else in the module can have been affected as long as the function's
+ * type comes out the same, so if it doesn't (or the edit is anything else)
+ * we return false and leave the module as it was, and the caller should fall
+ * back to CompilerReloadModule(). Only the analysis is redone: the module's
+ * code isn't re-emitted, and the ASTs of the other statements keep pointing
+ * into the old source, which must therefore outlive the module.
+ */
+bool
+CompilerPatchModule(Ty *ty, Module *mod, char const *source)
+{
+        char const *old = mod->source;
+
+        if (old == NULL || mod->prog == NULL) {
+                return false;
+        }
+
+        usize old_len = strlen(old);
+        usize new_len = strlen(source);
+
+        usize pre = 0;
+        while (pre < old_len && pre < new_len && old[pre] == source[pre]) {
+                pre += 1;
+        }
+
+        usize suf = 0;
+        while (
+                (suf < old_len - pre)
+             && (suf < new_len - pre)
+             && (old[old_len - suf - 1] == source[new_len - suf - 1])
+        ) {
+                suf += 1;
+        }
+
+        if (
+                memchr(old + pre, '\n', old_len - pre - suf) != NULL
+             || memchr(source + pre, '\n', new_len - pre - suf) != NULL
+        ) {
+                return false;
+        }
+
+        isize delta = (isize)new_len - (isize)old_len;
+        usize edit_end = old_len - suf;
+
+        i32 line = 0;
+        usize bol = 0;
+        for (usize i = 0; i < pre; ++i) {
+                if (old[i] == '\n') {
+                        line += 1;
+                        bol = i + 1;
+                }
+        }
+
+        Stmt **prog = mod->prog;
+        Stmt *s0 = NULL;
+        int idx = -1;
+
+        for (int i = 0; prog[i] != NULL; ++i) {
+                if (prog[i]->start.line <= line && prog[i]->end.line >= line) {
+                        if (s0 != NULL) {
+                                return false;
+                        }
+                        s0 = prog[i];
+                        idx = i;
+                }
+        }
+
+        if (
+                (s0 == NULL)
+             || (s0->type != STATEMENT_FUNCTION_DEFINITION)
+             || (s0->ns != NULL)
+             || (s0->value->type != EXPRESSION_FUNCTION)
+             || (s0->value->overload != NULL)
+             || (vN(s0->value->decorators) > 0)
+             || !HasBody(s0->value)
+             || (s0->target->symbol == NULL)
+             || (LineColCmp(&s0->start, line, pre - bol) >= 0)
+             || (LineColCmp(&s0->end, line, edit_end - bol) <= 0)
+        ) {
+                return false;
+        }
+
+        TokenVector const *old_tokens = &mod->tokens;
+
+        isize k = FindStatementToken(old_tokens, 0, &s0->start);
+        isize j = FindStatementToken(old_tokens, k + 1, &s0->end);
+
+        if (k == vN(*old_tokens)) {
+                return false;
+        }
+
+        Location where = v_(*old_tokens, k)->start;
+        if (where.s < old || where.s > old + old_len) {
+                return false;
+        }
+        where.byte = where.s - old;
+        where.s = source + where.byte;
+
+        TokenVector tokens = {0};
+        avPn(tokens, vv(*old_tokens), k);
+
+        Symbol *var = s0->target->symbol;
+        Symbol saved = *var;
+        Stmt *s1 = NULL;
+
+        if (TY_CATCH_ERROR()) {
+                TY_CATCH();
+                *var = saved;
+                return false;
+        }
+
+        STATE = freshstate(ty, mod);
+        STATE.imports = mod->imports;
+
+        PushScope(STATE.global);
+
+        s1 = parse_at(ty, source, CurrentModulePath(ty), &where, &tokens);
+
+        if (
+                (s1 == NULL)
+             || (s1->type != STATEMENT_FUNCTION_DEFINITION)
+             || (s1->value->type != EXPRESSION_FUNCTION)
+             || (vN(s1->value->decorators) > 0)
+             || (s1->target->type != EXPRESSION_IDENTIFIER)
+             || (s1->target->module != NULL)
+             || !s_eq(s1->target->identifier, s0->target->identifier)
+             || (LineColCmp(&s1->start, s0->start.line, s0->start.col) != 0)
+             || (LineColCmp(
+                        &s1->end,
+                        s0->end.line,
+                        s0->end.col + ((s0->end.line == line) ? delta : 0)
+                ) != 0)
+        ) {
+                TY_CATCH_END();
+                return false;
+        }
+
+        s1->pub = s0->pub;
+        s1->doc = s0->doc;
+        s1->value->doc = s0->value->doc;
+        s1->target->symbol = var;
+        var->type = NULL;
+
+        STATE.start = s1->start;
+        STATE.end = s1->end;
+
+        if (HAVE_COMPILER_FLAG(ZFOLD)) {
+                s1 = opt(ty, s1);
+        }
+
+        types_begin(ty);
+        InjectRedpill(ty, s1);
+        types_iter(ty);
+        symbolize_statement(ty, STATE.global, s1);
+        types_iter(ty);
+        types_finish(ty);
+
+        DisableRefinements(ty, STATE.active);
+
+        PopScope();
+
+        TY_CATCH_END();
+
+        if (
+                (vN(STATE.class_ops) > 0)
+             || !s_eq(type_show(ty, var->type), type_show(ty, saved.type))
+        ) {
+                *var = saved;
+                return false;
+        }
+
+        isize m = FindStatementToken(&tokens, k, &s1->end);
+        vN(tokens) = m;
+
+        for (isize i = 0; i < k; ++i) {
+                Token *t = v_(tokens, i);
+                RebaseLocation(&t->start, old, old_len, source, edit_end, line, delta);
+                RebaseLocation(&t->end, old, old_len, source, edit_end, line, delta);
+        }
+
+        for (isize i = j; i < vN(*old_tokens); ++i) {
+                Token t = v__(*old_tokens, i);
+                RebaseLocation(&t.start, old, old_len, source, edit_end, line, delta);
+                RebaseLocation(&t.end, old, old_len, source, edit_end, line, delta);
+                t.start.tok = vN(tokens) + 1;
+                avP(tokens, t);
+        }
+
+        prog[idx] = s1;
+        mod->source = source;
+        mod->tokens = tokens;
+
+        if (HAVE_COMPILER_FLAG(TOKENS)) {
+                annotate_tokens(ty, s1);
+        }
+
+        return true;
+}
+
 Symbol *
 CompilerFindDefinition(Ty *ty, Module *mod, i32 line, i32 col)
 {
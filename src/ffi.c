@@ -335,6 +335,109 @@ closure_func(ffi_cif *cif, void *ret, void **args, void *data)
         }
 }
 
+/*
+ * Most foreign functions only take integers and pointers, or only doubles,
+ * and have few enough arguments that they all go in registers. For those
+ * signatures we can skip ffi_call() entirely: the arguments are unboxed into
+ * registers and the function is called through a C function pointer of the
+ * matching shape.
+ *
+ * The stub is chosen once, when the cif is built by ffi.cif(), and stored
+ * alongside it. Anything else (structs, floats, variadics, an out: buffer)
+ * still goes through libffi.
+ */
+#if defined(__x86_64__) || defined(_M_X64) || defined(__aarch64__) || defined(_M_ARM64)
+  #define FFI_STUBS
+#endif
+
+#define FFI_STUB_MAX_ARGS 6
+
+enum {
+        FFI_STUB_NONE,
+        FFI_STUB_INT,
+        FFI_STUB_INT_F64,
+        FFI_STUB_F64
+};
+
+typedef struct {
+        ffi_cif cif;
+        int     stub;
+        bool    nogil;
+} FfiSignature;
+
+/*
+ * Functions marked nogil are assumed to be short and to never block or call
+ * back into Ty, so we keep holding our lock for the duration of the call.
+ */
+inline static void
+ffi_enter(Ty *ty, FfiSignature const *sig)
+{
+        if (!sig->nogil) {
+                UnlockTy();
+        }
+}
+
+inline static void
+ffi_leave(Ty *ty, FfiSignature const *sig)
+{
+        if (!sig->nogil) {
+                LockTy();
+        }
+}
+
+inline static bool
+is_int_class(ffi_type const *t)
+{
+        switch (t->type) {
+        case FFI_TYPE_INT:
+        case FFI_TYPE_UINT8:
+        case FFI_TYPE_UINT16:
+        case FFI_TYPE_UINT32:
+        case FFI_TYPE_UINT64:
+        case FFI_TYPE_SINT8:
+        case FFI_TYPE_SINT16:
+        case FFI_TYPE_SINT32:
+        case FFI_TYPE_SINT64:
+        case FFI_TYPE_POINTER:
+                return true;
+        }
+
+        return false;
+}
+
+static int
+choose_stub(ffi_cif const *cif, bool variadic)
+{
+#if defined(FFI_STUBS)
+        if (variadic || cif->nargs > FFI_STUB_MAX_ARGS) {
+                return FFI_STUB_NONE;
+        }
+
+        bool ints = true;
+        bool f64s = (cif->nargs > 0);
+
+        for (unsigned i = 0; i < cif->nargs; ++i) {
+                ints = ints && is_int_class(cif->arg_types[i]);
+                f64s = f64s && (cif->arg_types[i]->type == FFI_TYPE_DOUBLE);
+        }
+
+        switch (cif->rtype->type) {
+        case FFI_TYPE_DOUBLE:
+                return ints ? FFI_STUB_INT_F64
+                     : f64s ? FFI_STUB_F64
+                     : FFI_STUB_NONE;
+
+        case FFI_TYPE_VOID:
+                return ints ? FFI_STUB_INT : FFI_STUB_NONE;
+
+        default:
+                return (ints && is_int_class(cif->rtype)) ? FFI_STUB_INT : FFI_STUB_NONE;
+        }
+#else
+        return FFI_STUB_NONE;
+#endif
+}
+
 Value
 cffi_cif(Ty *ty, int argc, Value *kwargs)
 {
@@ -358,7 +461,8 @@ Bad:
                 xvP(ats, ARG(i).ptr);
         }
 
-        ffi_cif *cif = mA(sizeof *cif);
+        FfiSignature *sig = mA(sizeof *sig);
+        ffi_cif *cif = &sig->cif;
 
         Value *nFixed = NAMED("nFixed");
 
@@ -379,6 +483,9 @@ Bad:
                 return NIL;
         }
 
+        sig->stub = choose_stub(cif, nFixed != NULL && nFixed->type != VALUE_NIL);
+        sig->nogil = HAVE_FLAG("nogil");
+
         return PTR(cif);
 }
 
@@ -812,6 +919,96 @@ cffi_store_atomic(Ty *ty, int argc, Value *kwargs)
         return NIL;
 }
 
+#if defined(FFI_STUBS)
+inline static u64
+int_arg(Ty *ty, ffi_type const *t, Value const *v)
+{
+        switch (t->type) {
+        case FFI_TYPE_SINT8:   return (i64)(i8)int_from(v);
+        case FFI_TYPE_SINT16:  return (i64)(i16)int_from(v);
+        case FFI_TYPE_INT:
+        case FFI_TYPE_SINT32:  return (i64)(i32)int_from(v);
+        case FFI_TYPE_UINT8:   return (u8)int_from(v);
+        case FFI_TYPE_UINT16:  return (u16)int_from(v);
+        case FFI_TYPE_UINT32:  return (u32)int_from(v);
+        case FFI_TYPE_POINTER: return (uptr)ptr_from(ty, v);
+        default:               return int_from(v);
+        }
+}
+
+inline static Value
+int_ret(ffi_type const *t, u64 r)
+{
+        switch (t->type) {
+        case FFI_TYPE_INT:     return INTEGER((int)r);
+        case FFI_TYPE_SINT8:   return INTEGER((i8)r);
+        case FFI_TYPE_SINT16:  return INTEGER((i16)r);
+        case FFI_TYPE_SINT32:  return INTEGER((i32)r);
+        case FFI_TYPE_SINT64:  return INTEGER((i64)r);
+        case FFI_TYPE_UINT8:   return INTEGER((u8)r);
+        case FFI_TYPE_UINT16:  return INTEGER((u16)r);
+        case FFI_TYPE_UINT32:  return INTEGER((u32)r);
+        case FFI_TYPE_UINT64:  return INTEGER(r);
+        case FFI_TYPE_POINTER: return (r == 0) ? NIL : PTR((void *)(uptr)r);
+        default:               return NIL;
+        }
+}
+
+#define STUB_CALL(R, T, f, n, a) (                                                 \
+          ((n) == 0) ? ((R (*)(void))(f))()                                        \
+        : ((n) == 1) ? ((R (*)(T))(f))(a[0])                                       \
+        : ((n) == 2) ? ((R (*)(T, T))(f))(a[0], a[1])                              \
+        : ((n) == 3) ? ((R (*)(T, T, T))(f))(a[0], a[1], a[2])                     \
+        : ((n) == 4) ? ((R (*)(T, T, T, T))(f))(a[0], a[1], a[2], a[3])            \
+        : ((n) == 5) ? ((R (*)(T, T, T, T, T))(f))(a[0], a[1], a[2], a[3], a[4])   \
+        :              ((R (*)(T, T, T, T, T, T))(f))(a[0], a[1], a[2], a[3], a[4], a[5]) \
+)
+
+static Value
+stub_call(Ty *ty, FfiSignature const *sig, void (*func)(void), int argc, int first)
+{
+        ffi_cif const *cif = &sig->cif;
+        unsigned n = cif->nargs;
+
+        u64    ints[FFI_STUB_MAX_ARGS];
+        double f64s[FFI_STUB_MAX_ARGS];
+
+        u64    ri;
+        double rf;
+
+        switch (sig->stub) {
+        case FFI_STUB_INT:
+                for (unsigned i = 0; i < n; ++i) {
+                        ints[i] = int_arg(ty, cif->arg_types[i], &ARG(first + i));
+                }
+                ffi_enter(ty, sig);
+                ri = STUB_CALL(u64, u64, func, n, ints);
+                ffi_leave(ty, sig);
+                return int_ret(cif->rtype, ri);
+
+        case FFI_STUB_INT_F64:
+                for (unsigned i = 0; i < n; ++i) {
+                        ints[i] = int_arg(ty, cif->arg_types[i], &ARG(first + i));
+                }
+                ffi_enter(ty, sig);
+                rf = STUB_CALL(double, u64, func, n, ints);
+                ffi_leave(ty, sig);
+                return REAL(rf);
+
+        case FFI_STUB_F64:
+                for (unsigned i = 0; i < n; ++i) {
+                        f64s[i] = float_from(&ARG(first + i));
+                }
+                ffi_enter(ty, sig);
+                rf = STUB_CALL(double, double, func, n, f64s);
+                ffi_leave(ty, sig);
+                return REAL(rf);
+        }
+
+        UNREACHABLE();
+}
+#endif
+
 Value
 cffi_call(Ty *ty, int argc, Value *kwargs)
 {
@@ -824,6 +1021,14 @@ cffi_call(Ty *ty, int argc, Value *kwargs)
                 bP("bad FFI call: %u arguments expected but got %d", cif->nargs, argc - 2);
         }
 
+        FfiSignature const *sig = (FfiSignature const *)cif;
+
+#if defined(FFI_STUBS)
+        if (sig->stub != FFI_STUB_NONE && NAMED("out") == NULL) {
+                return stub_call(ty, sig, func, argc, 2);
+        }
+#endif
+
         vec(void *) args = {0};
 
         SCRATCH_SAVE();
@@ -840,9 +1045,9 @@ cffi_call(Ty *ty, int argc, Value *kwargs)
         Value *out = NAMED("out");
         void  *buf = (out == NULL) ? smA(cif->rtype->size) : ptr_from(ty, out);
 
-        UnlockTy();
+        ffi_enter(ty, sig);
         ffi_call(cif, func, buf, vv(args));
-        LockTy();
+        ffi_leave(ty, sig);
 
         Value ret = (out == NULL) ? load(ty, cif->rtype, buf) : PTR(buf);
 
@@ -865,6 +1070,13 @@ cffi_fun(Ty *ty, int argc, Value *kwargs)
                 xinfo->name = TY_C_STR(ARG(2));
         }
 
+        if (HAVE_FLAG("nogil") && !((FfiSignature *)cif)->nogil) {
+                FfiSignature *sig = mA(sizeof *sig);
+                *sig = *(FfiSignature *)cif;
+                sig->nogil = true;
+                cif = &sig->cif;
+        }
+
         return FOREIGN_FUN(ff, cif, xinfo);
 }
 
@@ -880,6 +1092,14 @@ cffi_fast_call(Ty *ty, Value const *fun, int argc, Value *kwargs)
                 bP("bad FFI call: %u arguments expected but got %d", cif->nargs, argc);
         }
 
+        FfiSignature const *sig = (FfiSignature const *)cif;
+
+#if defined(FFI_STUBS)
+        if (sig->stub != FFI_STUB_NONE && NAMED("out") == NULL) {
+                return stub_call(ty, sig, func, argc, 0);
+        }
+#endif
+
         vec(void *) args = {0};
 
         SCRATCH_SAVE();
@@ -896,9 +1116,9 @@ cffi_fast_call(Ty *ty, Value const *fun, int argc, Value *kwargs)
         Value *out = NAMED("out");
         void  *buf = (out == NULL) ? smA(cif->rtype->size) : ptr_from(ty, out);
 
-        UnlockTy();
+        ffi_enter(ty, sig);
         ffi_call(cif, func, buf, vv(args));
-        LockTy();
+        ffi_leave(ty, sig);
 
         Value ret = (out == NULL) ? load(ty, cif->rtype, buf) : PTR(buf);
 
@@ -74,6 +74,7 @@ typedef struct stat StatStruct;
 #include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <sys/wait.h>
 #include <termios.h>
@@ -97,6 +98,8 @@ extern char **environ;
 #include "class.h"
 #include "compiler.h"
 #include "types.h"
+#include "sampler.h"
+#include "tracer.h"
 
 #ifdef __APPLE__
 #define fputc_unlocked putc_unlocked
@@ -1549,6 +1552,141 @@ BUILTIN_FUNCTION(tuple)
         return tuple;
 }
 
+/*
+ * Patterns passed to regex() as strings are compiled (and JIT-compiled) on
+ * every call, which is expensive for code that builds the same pattern over
+ * and over again. Compiled regexes are kept in a small LRU cache per thread
+ * group, keyed on the pattern and the compile options. Cached Regex objects
+ * are pinned with NOGC() for as long as they stay in the cache.
+ *
+ * The cache lock is never held across an allocation, so a thread that is
+ * waiting on it can't hold up a collection.
+ */
+static _Atomic(usize) RegexCacheCapacity = 128;
+
+#define REGEX_CACHE_DETAILED (1U << 31)
+
+static Regex *
+regex_cache_find(RegexCache *cache, Value const *pattern, u32 options, u64 hash)
+{
+        for (usize i = 0; i < vN(cache->entries); ++i) {
+                RegexCacheEntry *entry = v_(cache->entries, i);
+                if (
+                        entry->hash    == hash
+                     && entry->options == options
+                     && entry->len     == sN(*pattern)
+                     && memcmp(entry->re->pattern, ss(*pattern), sN(*pattern)) == 0
+                ) {
+                        entry->used = ++cache->tick;
+                        return entry->re;
+                }
+        }
+
+        return NULL;
+}
+
+static Regex *
+regex_cache_get(Ty *ty, Value const *pattern, u32 options, u64 hash)
+{
+        RegexCache *cache = &ty->group->Regexes;
+        Regex *re = NULL;
+
+        TyMutexLock(&cache->lock);
+
+        re = regex_cache_find(cache, pattern, options, hash);
+
+        if (re != NULL) {
+                cache->hits += 1;
+        } else {
+                cache->misses += 1;
+        }
+
+        TyMutexUnlock(&cache->lock);
+
+        return re;
+}
+
+static void
+regex_cache_evict(RegexCache *cache, usize capacity)
+{
+        while (vN(cache->entries) > capacity) {
+                usize lru = 0;
+                for (usize i = 1; i < vN(cache->entries); ++i) {
+                        if (v_(cache->entries, i)->used < v_(cache->entries, lru)->used) {
+                                lru = i;
+                        }
+                }
+                OKGC(v_(cache->entries, lru)->re);
+                *v_(cache->entries, lru) = *vvL(cache->entries);
+                vvX(cache->entries);
+                cache->evictions += 1;
+        }
+}
+
+static Regex *
+regex_cache_put(Ty *ty, Regex *re, Value const *pattern, u32 options, u64 hash)
+{
+        RegexCache *cache = &ty->group->Regexes;
+        usize capacity = RegexCacheCapacity;
+
+        if (capacity == 0) {
+                return re;
+        }
+
+        TyMutexLock(&cache->lock);
+
+        /*
+         * Another thread may have compiled the same pattern while we were
+         * doing it ourselves. Prefer the entry that is already cached so that
+         * everyone shares one object.
+         */
+        Regex *cached = regex_cache_find(cache, pattern, options, hash);
+        if (cached != NULL) {
+                re = cached;
+                goto End;
+        }
+
+        regex_cache_evict(cache, capacity - 1);
+
+        NOGC(re);
+        xvP(
+                cache->entries,
+                ((RegexCacheEntry) {
+                        .hash    = hash,
+                        .used    = ++cache->tick,
+                        .options = options,
+                        .len     = sN(*pattern),
+                        .re      = re
+                })
+        );
+
+End:
+        TyMutexUnlock(&cache->lock);
+
+        return re;
+}
+
+static Value
+regex_cache_stats(Ty *ty)
+{
+        RegexCache *cache = &ty->group->Regexes;
+
+        TyMutexLock(&cache->lock);
+        i64 size      = vN(cache->entries);
+        i64 hits      = cache->hits;
+        i64 misses    = cache->misses;
+        i64 evictions = cache->evictions;
+        TyMutexUnlock(&cache->lock);
+
+        return vTn(
+                "capacity",  INTEGER(RegexCacheCapacity),
+                "size",      INTEGER(size),
+                "hits",      INTEGER(hits),
+                "misses",    INTEGER(misses),
+                "evictions", INTEGER(evictions)
+        );
+}
+
 static Value
 doregex(Ty *ty, Value const *pattern, Value const *flags, bool v)
 {
@@ -1570,6 +1708,15 @@ doregex(Ty *ty, Value const *pattern, Value const *flags, bool v)
                 }
         }
 
+        u32 key = options | (v ? REGEX_CACHE_DETAILED : 0);
+        u64 hash = XXH3_64bits(ss(*pattern), sN(*pattern));
+
+        if (RegexCacheCapacity > 0) {
+                Regex *re = regex_cache_get(ty, pattern, key, hash);
+                if (re != NULL) {
+                        return REGEX(re);
+                }
+        }
 
         int err;
         usize off;
@@ -1587,19 +1734,48 @@ doregex(Ty *ty, Value const *pattern, Value const *flags, bool v)
                 return NIL;
         }
 
-        err = pcre2_jit_compile(pcre2, PCRE2_JIT_COMPLETE);
-        if (err < 0) {
-                pcre2_code_free(pcre2);
-                return NIL;
-        }
-
         Regex *re = mAo(sizeof (Regex), GC_REGEX);
         re->pcre2 = pcre2;
+        atomic_init(&re->jit, NULL);
         re->pattern = TY_C_STR(*pattern);
         re->detailed = v;
         re->gc = true;
 
-        return REGEX(re);
+        pcre2_pattern_info(pcre2, PCRE2_INFO_CAPTURECOUNT, &re->ncap);
+
+        return REGEX(regex_cache_put(ty, re, pattern, key, hash));
+}
+
+pcre2_code *
+regex_jit(Regex const *re)
+{
+        Regex *r = (Regex *)re;
+        pcre2_code *code = pcre2_code_copy(r->pcre2);
+
+        // The copy is compiled and only then published, so that another
+        // thread can go on matching with the interpreter in the meantime.
+        // If JIT compilation isn't possible, the interpreter it is for good.
+        if (code == NULL || pcre2_jit_compile(code, PCRE2_JIT_COMPLETE) < 0) {
+                pcre2_code_free(code);
+                code = r->pcre2;
+        }
+
+        pcre2_code *expected = NULL;
+
+        if (!atomic_compare_exchange_strong_explicit(
+                &r->jit,
+                &expected,
+                code,
+                memory_order_acq_rel,
+                memory_order_acquire
+        )) {
+                if (code != r->pcre2) {
+                        pcre2_code_free(code);
+                }
+                code = expected;
+        }
+
+        return code;
 }
 
 BUILTIN_FUNCTION(regex)
@@ -1974,12 +2150,137 @@ BUILTIN_FUNCTION(json_parse_xD)
         return json_parse_xD(ty, (char const *)data, len);
 }
 
+BUILTIN_FUNCTION(json_feed)
+{
+        ASSERT_ARGC("json.feed()", 2);
+
+        Blob *buf = ARGx(0, VALUE_BLOB).blob;
+        imax state = INT_ARG(1);
+
+        Value depth   = KWARG("depth",   INTEGER);
+        Value size    = KWARG("size",    INTEGER);
+        Value array   = KWARG("array",   BOOLEAN);
+        Value records = KWARG("records", BOOLEAN);
+        Value final   = KWARG("final",   BOOLEAN);
+
+        JsonFeedOptions opts = {
+                .max_depth = IsMissing(depth) ? 512       : max(depth.z, 1),
+                .max_size  = IsMissing(size)  ? (64 * MB_1) : max(size.z, 1),
+                .array     = IsMissing(array) || array.boolean,
+                .xd        = !IsMissing(records) && records.boolean,
+                .final     = !IsMissing(final) && final.boolean
+        };
+
+        if (state < 0) {
+                bP("bad state: %"PRIiMAX, state);
+        }
+
+        Value values = json_feed(ty, buf, &state, &opts);
+
+        return vTn(
+                "values", values,
+                "state",  INTEGER(state)
+        );
+}
+
+BUILTIN_FUNCTION(json_index)
+{
+        ASSERT_ARGC("json.index()", 1);
+
+        Value json = ARGx(0, VALUE_STRING, VALUE_BLOB);
+
+        switch (json.type) {
+        case VALUE_STRING:
+                return json_index(ty, (char const *)ss(json), sN(json));
+
+        case VALUE_BLOB:
+                return json_index(ty, (char const *)vv(*json.blob), vN(*json.blob));
+
+        default:
+                UNREACHABLE();
+        }
+}
+
+#define LAZY_ARGS(name, n)                                      \
+        ASSERT_ARGC(name, n);                                   \
+        Value src = ARGx(0, VALUE_STRING, VALUE_BLOB);          \
+        Value index = ARGx(1, VALUE_BLOB);                      \
+        imax at = INT_ARG(2);
+
+BUILTIN_FUNCTION(json_node_child)
+{
+        LAZY_ARGS("json.node-child()", 4);
+        Value key = ARGx(3, VALUE_STRING, VALUE_INTEGER);
+        return json_lazy_child(ty, &src, &index, at, &key);
+}
+
+BUILTIN_FUNCTION(json_node_path)
+{
+        LAZY_ARGS("json.node-path()", 4);
+        Value path = ARGx(3, VALUE_STRING);
+        return json_lazy_path(ty, &src, &index, at, (char const *)ss(path), sN(path));
+}
+
+BUILTIN_FUNCTION(json_node_kind)
+{
+        LAZY_ARGS("json.node-kind()", 3);
+        return json_lazy_kind(ty, &src, &index, at);
+}
+
+BUILTIN_FUNCTION(json_node_count)
+{
+        LAZY_ARGS("json.node-count()", 3);
+        return json_lazy_count(ty, &src, &index, at);
+}
+
+BUILTIN_FUNCTION(json_node_children)
+{
+        LAZY_ARGS("json.node-children()", 3);
+        return json_lazy_children(ty, &src, &index, at);
+}
+
+BUILTIN_FUNCTION(json_node_value)
+{
+        LAZY_ARGS("json.node-value()", 3);
+        Value records = KWARG("records", BOOLEAN);
+        return json_lazy_value(ty, &src, &index, at, !IsMissing(records) && records.boolean);
+}
+
+#undef LAZY_ARGS
+
 BUILTIN_FUNCTION(json_encode)
 {
         ASSERT_ARGC("json.parse()", 1);
         return json_encode(ty, &ARG(0));
 }
 
+BUILTIN_FUNCTION(json_encode_into)
+{
+        ASSERT_ARGC("json.encode-into()", 2);
+
+        Value dst = ARGx(0, VALUE_INTEGER, VALUE_BLOB);
+
+        Value indent    = KWARG("indent",    INTEGER);
+        Value precision = KWARG("precision", INTEGER);
+        Value single    = KWARG("float32",   BOOLEAN);
+
+        JsonWriteOptions opts = {
+                .indent    = IsMissing(indent)    ? 0 : max(min(indent.z, 16), 0),
+                .precision = IsMissing(precision) ? 0 : max(min(precision.z, 17), 0),
+                .single    = !IsMissing(single) && single.boolean
+        };
+
+        imax n = (dst.type == VALUE_BLOB)
+               ? json_write(ty, -1, dst.blob, &ARG(1), &opts)
+               : json_write(ty, dst.z, NULL, &ARG(1), &opts);
+
+        if (n < 0) {
+                bP("value can't be encoded as JSON: %s", VSC(&ARG(1)));
+        }
+
+        return INTEGER(n);
+}
+
 BUILTIN_FUNCTION(sha512)
 {
         ASSERT_ARGC("sha512", 1);
@@ -3043,6 +3344,88 @@ BUILTIN_FUNCTION(os_write)
         return INTEGER(off);
 }
 
+BUILTIN_FUNCTION(os_writev)
+{
+        ASSERT_ARGC("os.writev()", 2);
+
+#ifdef _WIN32
+        NOT_ON_WINDOWS("os.writev()");
+#else
+        int fd = INT_ARG(0);
+        Array *parts = ARGx(1, VALUE_ARRAY).array;
+
+        Value *all = NAMED("all");
+        bool write_all = (all != NULL) && value_truthy(ty, all);
+
+        SCRATCH_SAVE();
+
+        struct iovec *iov = smA(max(vN(*parts), 1) * sizeof *iov);
+        int n = 0;
+
+        for (usize i = 0; i < vN(*parts); ++i) {
+                Value const *part = v_(*parts, i);
+                switch (part->type) {
+                case VALUE_BLOB:
+                        iov[n].iov_base = vv(*part->blob);
+                        iov[n].iov_len = vN(*part->blob);
+                        break;
+                case VALUE_STRING:
+                        iov[n].iov_base = (void *)ss(*part);
+                        iov[n].iov_len = sN(*part);
+                        break;
+                case VALUE_NIL:
+                        continue;
+                default:
+                        zP("os.writev(): expected String or Blob but got: %s", VSC(part));
+                }
+                if (iov[n].iov_len > 0) {
+                        n += 1;
+                }
+        }
+
+        struct iovec *v = iov;
+        usize off = 0;
+
+        UnlockTy();
+        while (n > 0) {
+                isize r = writev(fd, v, min(n, IOV_MAX));
+                if (r < 0 && errno == EINTR) {
+                        continue;
+                }
+                if (r < 0) {
+                        LockTy();
+                        SCRATCH_RESTORE();
+                        return (off == 0) ? INTEGER(r) : INTEGER(off);
+                }
+                if (r == 0) {
+                        break;
+                }
+
+                off += r;
+
+                while (n > 0 && (usize)r >= v->iov_len) {
+                        r -= v->iov_len;
+                        v += 1;
+                        n -= 1;
+                }
+
+                if (n > 0) {
+                        v->iov_base = (char *)v->iov_base + r;
+                        v->iov_len -= r;
+                }
+
+                if (!write_all) {
+                        break;
+                }
+        }
+        LockTy();
+
+        SCRATCH_RESTORE();
+
+        return INTEGER(off);
+#endif
+}
+
 BUILTIN_FUNCTION(os_lseek)
 {
         ASSERT_ARGC("os.lseek()", 3);
@@ -3886,6 +4269,8 @@ BUILTIN_FUNCTION(thread_join)
                 bP("thread has already been joined");
         }
 
+        u64 t0 = TRACING() ? tracer_now() : 0;
+
         if ((argc == 1) || (ARG(1).type == VALUE_NIL)) {
                 UnlockTy();
                 TyThreadJoin(t->t);
@@ -3893,6 +4278,10 @@ BUILTIN_FUNCTION(thread_join)
 
                 t->joined = true;
 
+                if (t0 != 0) {
+                        tracer_complete("thread.join", "thread", t0, NULL);
+                }
+
                 return t->v;
         } else {
                 i64 timeoutMs = MSEC_ARG(1);
@@ -3912,6 +4301,10 @@ BUILTIN_FUNCTION(thread_join)
 
                 t->joined = true;
 
+                if (t0 != 0) {
+                        tracer_complete("thread.join", "thread", t0, NULL);
+                }
+
                 return Some(t->v);
         }
 }
@@ -4288,6 +4681,8 @@ BUILTIN_FUNCTION(thread_send)
 
         Forget(ty, &cv.v, (AllocList *)&cv.as);
 
+        u64 t0 = TRACING() ? tracer_now() : 0;
+
         UnlockTy();
         TyMutexLock(&chan->m);
         LockTy();
@@ -4295,6 +4690,10 @@ BUILTIN_FUNCTION(thread_send)
         TyMutexUnlock(&chan->m);
         TyCondVarSignal(&chan->c);
 
+        if (t0 != 0) {
+                tracer_complete("chan.send", "chan", t0, NULL);
+        }
+
         return NIL;
 }
 
@@ -4304,6 +4703,8 @@ BUILTIN_FUNCTION(thread_recv)
 
         Channel *chan = PTR_ARG(0);
 
+        u64 t0 = TRACING() ? tracer_now() : 0;
+
         UnlockTy();
         TyMutexLock(&chan->m);
         if (argc == 1) {
@@ -4324,6 +4725,10 @@ BUILTIN_FUNCTION(thread_recv)
         }
         LockTy();
 
+        if (t0 != 0) {
+                tracer_complete("chan.recv", "chan", t0, NULL);
+        }
+
         if (chan->q.count == 0) {
                 TyMutexUnlock(&chan->m);
                 return None;
@@ -5456,7 +5861,7 @@ BUILTIN_FUNCTION(os_epoll_ctl)
 
 BUILTIN_FUNCTION(os_epoll_wait)
 {
-        ASSERT_ARGC("os.epoll_wait()", 2);
+        ASSERT_ARGC("os.epoll_wait()", 2, 3);
 
         Value efd = ARG(0);
         if (efd.type != VALUE_INTEGER)
@@ -5466,14 +5871,22 @@ BUILTIN_FUNCTION(os_epoll_wait)
         if (timeout.type != VALUE_INTEGER)
                 zP("the second argument to os.epoll_wait() must be an integer (timeout in ms)");
 
-        struct epoll_event events[32];
+        int max = (argc == 3) ? INT_ARG(2) : 32;
+        if (max <= 0)
+                zP("os.epoll_wait(): max events must be positive, got %d", max);
+
+        SCRATCH_SAVE();
+
+        struct epoll_event *events = smA(max * sizeof *events);
 
         UnlockTy();
-        int n = epoll_wait(efd.z, events, sizeof events / sizeof events[0], timeout.z);
+        int n = epoll_wait(efd.z, events, max, timeout.z);
         LockTy();
 
-        if (n == -1)
+        if (n == -1) {
+                SCRATCH_RESTORE();
                 return NIL;
+        }
 
         struct array *result = vA();
 
@@ -5489,6 +5902,7 @@ BUILTIN_FUNCTION(os_epoll_wait)
         }
 
         gX();
+        SCRATCH_RESTORE();
 
         return ARRAY(result);
 }
@@ -8130,6 +8544,334 @@ BUILTIN_FUNCTION(ty_gc)
         return NIL;
 }
 
+BUILTIN_FUNCTION(ty_gc_stats)
+{
+        ASSERT_ARGC("ty.gcStats()", 0);
+
+        u64 count;
+        u64 pause;
+        u64 max_pause;
+
+        GCStats(&count, &pause, &max_pause);
+
+        return vTn(
+                "runs",     INTEGER(count),
+                "pause",    INTEGER(pause),
+                "maxPause", INTEGER(max_pause)
+        );
+}
+
+BUILTIN_FUNCTION(ty_regex_cache)
+{
+        ASSERT_ARGC("ty.regexCache()", 0);
+
+        Value size = KWARG("size", INTEGER);
+
+        if (!IsMissing(size)) {
+                if (size.z < 0) {
+                        bP("size must be non-negative: %"PRIiMAX, size.z);
+                }
+
+                RegexCache *cache = &ty->group->Regexes;
+
+                TyMutexLock(&cache->lock);
+                RegexCacheCapacity = size.z;
+                regex_cache_evict(cache, size.z);
+                TyMutexUnlock(&cache->lock);
+        }
+
+        return regex_cache_stats(ty);
+}
+
+BUILTIN_FUNCTION(ty_profile_start)
+{
+        ASSERT_ARGC("ty.profile.start()", 0, 1);
+
+        imax hz = (argc == 0) ? SAMPLER_DEFAULT_HZ : ARGx(0, VALUE_INTEGER).z;
+
+        if (hz <= 0 || hz > 1000000) {
+                bP("rate must be between 1 and 1000000 Hz: %"PRIiMAX, hz);
+        }
+
+        return BOOLEAN(sampler_start(hz));
+}
+
+BUILTIN_FUNCTION(ty_profile_stop)
+{
+        ASSERT_ARGC("ty.profile.stop()", 0);
+        return BOOLEAN(sampler_stop());
+}
+
+BUILTIN_FUNCTION(ty_profile_running)
+{
+        ASSERT_ARGC("ty.profile.running()", 0);
+        return BOOLEAN(sampler_running());
+}
+
+BUILTIN_FUNCTION(ty_profile_reset)
+{
+        ASSERT_ARGC("ty.profile.reset()", 0);
+        sampler_reset();
+        return NIL;
+}
+
+BUILTIN_FUNCTION(ty_profile_report)
+{
+        ASSERT_ARGC("ty.profile.report()", 0);
+
+        byte_vector out = {0};
+        sampler_report(ty, &out);
+
+        Value report = vSs(vv(out), vN(out));
+        xvF(out);
+
+        return report;
+}
+
+BUILTIN_FUNCTION(ty_profile_samples)
+{
+        ASSERT_ARGC("ty.profile.samples()", 0);
+        return sampler_samples(ty);
+}
+
+BUILTIN_FUNCTION(ty_profile_folded)
+{
+        ASSERT_ARGC("ty.profile.folded()", 0);
+
+        byte_vector out = {0};
+        sampler_folded(ty, &out);
+
+        Value folded = vSs(vv(out), vN(out));
+        xvF(out);
+
+        return folded;
+}
+
+BUILTIN_FUNCTION(ty_profile_pprof)
+{
+        ASSERT_ARGC("ty.profile.pprof()", 0);
+
+        byte_vector out = {0};
+        sampler_pprof(ty, &out);
+
+        Blob *b = value_blob_new(ty);
+        uvPn(*b, vv(out), vN(out));
+        xvF(out);
+
+        return BLOB(b);
+}
+
+BUILTIN_FUNCTION(ty_profile_heap_start)
+{
+        ASSERT_ARGC("ty.profile.heapStart()", 0, 1);
+
+        imax rate = (argc == 0) ? SAMPLER_HEAP_DEFAULT_RATE : ARGx(0, VALUE_INTEGER).z;
+
+        if (rate <= 0) {
+                bP("sampling interval must be a positive number of bytes: %"PRIiMAX, rate);
+        }
+
+        return BOOLEAN(sampler_heap_start(rate));
+}
+
+BUILTIN_FUNCTION(ty_profile_heap_stop)
+{
+        ASSERT_ARGC("ty.profile.heapStop()", 0);
+        return BOOLEAN(sampler_heap_stop());
+}
+
+BUILTIN_FUNCTION(ty_profile_heap_running)
+{
+        ASSERT_ARGC("ty.profile.heapRunning()", 0);
+        return BOOLEAN(sampler_heap_running());
+}
+
+BUILTIN_FUNCTION(ty_profile_heap_reset)
+{
+        ASSERT_ARGC("ty.profile.heapReset()", 0);
+        sampler_heap_reset();
+        return NIL;
+}
+
+BUILTIN_FUNCTION(ty_profile_heap_report)
+{
+        ASSERT_ARGC("ty.profile.heapReport()", 0);
+
+        byte_vector out = {0};
+        sampler_heap_report(ty, &out);
+
+        Value report = vSs(vv(out), vN(out));
+        xvF(out);
+
+        return report;
+}
+
+BUILTIN_FUNCTION(ty_profile_counters)
+{
+        ASSERT_ARGC("ty.profile.counters()", 0);
+
+        i64 counts[SAMPLER_COUNTERS];
+
+        if (!sampler_counters(counts)) {
+                return NIL;
+        }
+
+        return vTn(
+                "instructions", (counts[0] < 0) ? NIL : INTEGER(counts[0]),
+                "cycles",       (counts[1] < 0) ? NIL : INTEGER(counts[1]),
+                "cacheMisses",  (counts[2] < 0) ? NIL : INTEGER(counts[2])
+        );
+}
+
+BUILTIN_FUNCTION(ty_profile_heap_pprof)
+{
+        ASSERT_ARGC("ty.profile.heapPprof()", 0);
+
+        byte_vector out = {0};
+        sampler_heap_pprof(ty, &out);
+
+        Blob *b = value_blob_new(ty);
+        uvPn(*b, vv(out), vN(out));
+        xvF(out);
+
+        return BLOB(b);
+}
+
+/*
+ * Attributes the machine code in [addr, addr + size) to f, as the JIT does for
+ * everything it compiles. Samples taken while the PC is in that range get a
+ * [jit] frame for f on top.
+ */
+BUILTIN_FUNCTION(ty_profile_jit_code)
+{
+        ASSERT_ARGC("ty.profile.jitCode()", 3);
+
+        Value f = ARGx(0, VALUE_FUNCTION);
+        imax addr = ARGx(1, VALUE_INTEGER).z;
+        imax size = ARGx(2, VALUE_INTEGER).z;
+
+        if (addr < 0 || size <= 0) {
+                bP("invalid code range: %"PRIiMAX" bytes at %"PRIiMAX, size, addr);
+        }
+
+        sampler_jit_code((void const *)(uptr)addr, size, expr_of(&f), name_of(&f));
+
+        return NIL;
+}
+
+BUILTIN_FUNCTION(ty_tracing_start)
+{
+        ASSERT_ARGC("ty.tracing.start()", 0);
+        return BOOLEAN(tracer_start());
+}
+
+BUILTIN_FUNCTION(ty_tracing_stop)
+{
+        ASSERT_ARGC("ty.tracing.stop()", 0);
+        return BOOLEAN(tracer_stop());
+}
+
+BUILTIN_FUNCTION(ty_tracing_running)
+{
+        ASSERT_ARGC("ty.tracing.running()", 0);
+        return BOOLEAN(TRACING());
+}
+
+BUILTIN_FUNCTION(ty_tracing_reset)
+{
+        ASSERT_ARGC("ty.tracing.reset()", 0);
+        tracer_reset();
+        return NIL;
+}
+
+BUILTIN_FUNCTION(ty_tracing_json)
+{
+        ASSERT_ARGC("ty.tracing.json()", 0);
+
+        byte_vector out = {0};
+        tracer_json(&out);
+
+        Value json = vSs(vv(out), vN(out));
+        xvF(out);
+
+        return json;
+}
+
+BUILTIN_FUNCTION(ty_tracing_span)
+{
+        ASSERT_ARGC("ty.tracing.span()", 2);
+
+        Value name = ARGx(0, VALUE_STRING);
+        Value f = ARG(1);
+
+        if (!TRACING()) {
+                return vmC(&f, 0);
+        }
+
+        char const *label = tracer_intern((char const *)ss(name), sN(name));
+        u64 t0 = tracer_now();
+
+        // A span that ends in an exception still took that long
+        if (TY_CATCH_ERROR()) {
+                tracer_complete(label, "user", t0, NULL);
+                TY_RETHROW();
+        }
+
+        Value v = vmC(&f, 0);
+
+        TY_CATCH_END();
+
+        tracer_complete(label, "user", t0, NULL);
+
+        return v;
+}
+
+BUILTIN_FUNCTION(ty_tracing_begin)
+{
+        ASSERT_ARGC("ty.tracing.begin()", 1);
+
+        Value name = ARGx(0, VALUE_STRING);
+
+        if (TRACING()) {
+                tracer_begin(tracer_intern((char const *)ss(name), sN(name)), "user");
+        }
+
+        return NIL;
+}
+
+BUILTIN_FUNCTION(ty_tracing_end)
+{
+        ASSERT_ARGC("ty.tracing.end()", 0);
+
+        if (TRACING()) {
+                tracer_end();
+        }
+
+        return NIL;
+}
+
+BUILTIN_FUNCTION(ty_tracing_instant)
+{
+        ASSERT_ARGC("ty.tracing.instant()", 1, 2);
+
+        Value name = ARGx(0, VALUE_STRING);
+
+        if (!TRACING()) {
+                return NIL;
+        }
+
+        char const *detail = NULL;
+
+        if (argc == 2) {
+                Value s = ARGx(1, VALUE_STRING);
+                detail = tracer_intern((char const *)ss(s), sN(s));
+        }
+
+        tracer_instant(tracer_intern((char const *)ss(name), sN(name)), "user", detail);
+
+        return NIL;
+}
+
 BUILTIN_FUNCTION(ty_bt)
 {
         ASSERT_ARGC("ty.bt()", 0);
@@ -8183,7 +8925,7 @@ BUILTIN_FUNCTION(ty_trace)
 
         for (int i = 0; i < vN(*ctx); ++i) {
                 xvP(*clone, v__(*ctx, i));
-                if (DetailedExceptions) {
+                if (i < vN(ctx->locals)) {
                         ValueVector locals = {0};
                         ValueVector *_locals = v_(ctx->locals, i);
                         xvPv(locals, *_locals);
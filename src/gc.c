@@ -95,6 +95,9 @@ collect(Ty *ty, struct alloc *a)
 
         case GC_REGEX:
                 re = p;
+                if (re->jit != re->pcre2) {
+                        pcre2_code_free(re->jit);
+                }
                 pcre2_code_free(re->pcre2);
                 ty_free((char *)re->pattern);
                 break;
@@ -168,6 +171,7 @@ GCSweepTy(Ty *ty)
                 ) {
                         ty->memory_used -= min(a->size, ty->memory_used);
                         collect(ty, a);
+                        ForgetSampledAlloc(a);
                         ty_free(a);
                 } else {
                         A_STORE(&a->mark, false);
@@ -192,6 +196,7 @@ GCSweep(Ty *ty, AllocList *allocs, isize *used)
                 ) {
                         *used -= min(v__(*allocs, i)->size, *used);
                         collect(ty, v__(*allocs, i));
+                        ForgetSampledAlloc(v__(*allocs, i));
                         ty_free(v__(*allocs, i));
                 } else {
                         A_STORE(&v__(*allocs, i)->mark, false);
@@ -27,6 +27,9 @@
 #include "queue.h"
 #include "itable.h"
 #include "compiler.h"
+#include "cffi.h"
+#include "sampler.h"
+#include "tracer.h"
 
 #define VALUE_SIZE (sizeof (Value))
 
@@ -2284,7 +2287,7 @@ jit_fast_frame(Ty *ty, Value const *fn, Value const *self, int argc)
         }
 
         // Push frame and call return address
-        xvP(ty->st->frames, ((Frame){ .fp = fp, .f = *fn, .ip = NULL }));
+        PushFrame(ty, ((Frame){ .fp = fp, .f = *fn, .ip = NULL }));
         xvP(ty->st->calls, (char *)NULL);
 
         CO_LOG("jit_fast_frame", TERM(33;1), "");
@@ -2513,6 +2516,18 @@ jit_rt_call_builtin_function(Ty *ty, Value *result, BuiltinFunction *func, int a
         vm_check_flags(ty);
 }
 
+// Direct call to a foreign function (global known to be const at JIT compile time)
+static void
+jit_rt_call_foreign_function(Ty *ty, Value *result, int gi, int argc)
+{
+        ptrdiff_t idx = (result - vv(STACK));
+        vN(STACK) = idx + argc;
+        Value val = cffi_fast_call(ty, vm_global(ty, gi), argc, NULL);
+        vN(STACK) = idx + 1;
+        v_L(STACK) = val;
+        vm_check_flags(ty);
+}
+
 static int
 jit_rt_get_fp(Ty *ty)
 {
@@ -4870,6 +4885,25 @@ bc_emit(JitCtx *ctx, char const *code, int code_size)
                                 break;
                         }
 
+                        // Same for a const foreign function: cffi_fast_call() picks the
+                        // native stub for the signature if there is one
+                        if (SymbolIsConst(globals[gi]) && v_(Globals, gi)->type == VALUE_FOREIGN_FUNCTION) {
+                                int result_off = OP_OFF(ctx->sp);
+
+                                jit_emit_mov(asm, BC_A0, BC_TY);
+                                jit_emit_add_imm(asm, BC_A1, BC_OPS, result_off);
+                                jit_emit_load_imm(asm, BC_A2, gi);
+                                jit_emit_load_imm(asm, BC_A3, n);
+                                jit_emit_load_imm(asm, BC_CALL, (iptr)jit_rt_call_foreign_function);
+                                jit_emit_call_reg(asm, BC_CALL);
+
+                                DBG("CALL_GLOBAL(%s) [direct foreign]", VSC(vm_global(ty, gi)));
+
+                                ctx->sp++;
+                                if (ctx->sp > ctx->max_sp) ctx->max_sp = ctx->sp;
+                                break;
+                        }
+
                         // Try fast trampoline path (skips xcall overhead)
                         jit_emit_mov(asm, BC_A0, BC_TY);
                         jit_emit_load_imm(asm, BC_A1, gi);
@@ -6675,6 +6709,8 @@ jit_compile(Ty *ty, Value const *func)
         u64 compile_t0 = jit_wall_time();
 #endif
 
+        u64 trace_t0 = TRACING() ? tracer_now() : 0;
+
         i32 const *info = func->info;
         int code_size   = info[FUN_INFO_CODE_SIZE];
         int bound       = info[FUN_INFO_BOUND];
@@ -6841,6 +6877,12 @@ jit_compile(Ty *ty, Value const *func)
         ji->env = NULL;
         ji->env_count = info[FUN_INFO_CAPTURES];
 
+        sampler_jit_code(code, final_size, ji->expr, name);
+
+        if (trace_t0 != 0) {
+                tracer_complete("JIT compile", "jit", trace_t0, name);
+        }
+
 #if JIT_SCAN_LOG
         LOGX("JIT: compiled %s (%d params, %d bound, %zu bytes native)",
             name, param_count, bound, final_size);
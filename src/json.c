@@ -3,6 +3,21 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <utf8proc.h>
+#include <math.h>
+#include <float.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <poll.h>
+#include <sys/uio.h>
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 #include "test.h"
 #include "value.h"
@@ -11,99 +26,373 @@
 #include "dtoa.h"
 #include "itable.h"
 #include "class.h"
+#include "json.h"
 #include "vec.h"
 #include "vm.h"
 #include "ty.h"
 
-#define KW_DELIM(c) (strchr(" \n}],", c) != NULL)
 #define FAIL longjmp(jb, 1)
 
+/*
+ * json_parse() makes two passes over the input, the same split simdjson uses.
+ *
+ * The first pass (build_index()) looks at 64 bytes at a time and records the
+ * offset of every structural character ({}[]:,), every unescaped quote, and
+ * the first byte of every bare scalar (numbers, true, false, null). Quotes
+ * and backslashes are found with vector compares, and a prefix XOR over the
+ * quote mask gives the set of bytes that are inside strings, none of which
+ * are ever treated as structural.
+ *
+ * The second pass walks the index and builds values. Strings without escapes
+ * are copied out of the input in one go, object keys are interned for the
+ * duration of the parse, and numbers only go through strtoimax()/strtod()
+ * when the fast path can't produce an exact result.
+ */
+
+enum {
+        JC_QUOTE     = 1 << 0,
+        JC_BACKSLASH = 1 << 1,
+        JC_OP        = 1 << 2,
+        JC_SPACE     = 1 << 3
+};
+
+typedef struct {
+        u64 quote;
+        u64 backslash;
+        u64 op;
+        u64 space;
+} JsonBlock;
+
+typedef struct {
+        u64 hash;
+        u32 gen;
+        u32 off;
+        u32 len;
+        i32 id;
+        Value key;
+} JsonKey;
+
+#define JSON_KEY_SLOTS   2048
+#define JSON_KEY_MAX     (JSON_KEY_SLOTS / 2)
+#define JSON_KEY_MAX_LEN 64
+
+/* Index buffers bigger than this are released after the parse */
+#define JSON_INDEX_KEEP  (1U << 20)
+
 static _Thread_local jmp_buf jb;
 static _Thread_local char const *json;
 static _Thread_local usize len;
 static _Thread_local bool xd;
 
+static _Thread_local U32Vector Index;
+static _Thread_local u32 at;
+
+static _Thread_local JsonKey *Keys;
+static _Thread_local u32 KeyGen;
+static _Thread_local u32 KeyCount;
+
 typedef byte_vector str;
 
 static _Thread_local vec(void const *) Visiting;
 
-inline static char
-peek(void)
+#if defined(__SSE2__)
+inline static u64
+mask16(__m128i m, int i)
 {
-        return (len == 0) ? '\0' : json[0];
+        return (u64)(u16)_mm_movemask_epi8(m) << (16 * i);
 }
 
-inline static char
-peek1(void)
+static void
+classify(u8 const *p, JsonBlock *b)
 {
-        return (len <= 1) ? '\0' : json[1];
+        *b = (JsonBlock){0};
+
+        for (int i = 0; i < 4; ++i) {
+                __m128i v = _mm_loadu_si128((__m128i const *)(p + 16 * i));
+
+                /* Setting 0x20 folds '[' onto '{' and ']' onto '}' */
+                __m128i l = _mm_or_si128(v, _mm_set1_epi8(0x20));
+
+                __m128i op = _mm_or_si128(
+                        _mm_or_si128(
+                                _mm_cmpeq_epi8(l, _mm_set1_epi8('{')),
+                                _mm_cmpeq_epi8(l, _mm_set1_epi8('}'))
+                        ),
+                        _mm_or_si128(
+                                _mm_cmpeq_epi8(v, _mm_set1_epi8(':')),
+                                _mm_cmpeq_epi8(v, _mm_set1_epi8(','))
+                        )
+                );
+
+                /* '\t' through '\r', as isspace() has it: c - '\t' <= 4 unsigned */
+                __m128i ctl = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+
+                __m128i space = _mm_or_si128(
+                        _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                        _mm_cmpeq_epi8(_mm_min_epu8(ctl, _mm_set1_epi8(4)), ctl)
+                );
+
+                b->quote     |= mask16(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')), i);
+                b->backslash |= mask16(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\')), i);
+                b->op        |= mask16(op, i);
+                b->space     |= mask16(space, i);
+        }
 }
+#elif defined(__aarch64__)
+inline static u64
+mask64(uint8x16_t m0, uint8x16_t m1, uint8x16_t m2, uint8x16_t m3)
+{
+        uint8x16_t const bit = {
+                0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80,
+                0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80
+        };
 
-inline static char
-next(void)
+        uint8x16_t s0 = vpaddq_u8(vandq_u8(m0, bit), vandq_u8(m1, bit));
+        uint8x16_t s1 = vpaddq_u8(vandq_u8(m2, bit), vandq_u8(m3, bit));
+
+        s0 = vpaddq_u8(s0, s1);
+        s0 = vpaddq_u8(s0, s0);
+
+        return vgetq_lane_u64(vreinterpretq_u64_u8(s0), 0);
+}
+
+static void
+classify(u8 const *p, JsonBlock *b)
 {
-        if (len <= 0)
-                return '\0';
-        --len;
-        return *json++;
+        uint8x16_t quote[4];
+        uint8x16_t backslash[4];
+        uint8x16_t op[4];
+        uint8x16_t space[4];
+
+        for (int i = 0; i < 4; ++i) {
+                uint8x16_t v = vld1q_u8(p + 16 * i);
+                uint8x16_t l = vorrq_u8(v, vdupq_n_u8(0x20));
+
+                quote[i]     = vceqq_u8(v, vdupq_n_u8('"'));
+                backslash[i] = vceqq_u8(v, vdupq_n_u8('\\'));
+
+                op[i] = vorrq_u8(
+                        vorrq_u8(
+                                vceqq_u8(l, vdupq_n_u8('{')),
+                                vceqq_u8(l, vdupq_n_u8('}'))
+                        ),
+                        vorrq_u8(
+                                vceqq_u8(v, vdupq_n_u8(':')),
+                                vceqq_u8(v, vdupq_n_u8(','))
+                        )
+                );
+
+                space[i] = vorrq_u8(
+                        vceqq_u8(v, vdupq_n_u8(' ')),
+                        vcleq_u8(vsubq_u8(v, vdupq_n_u8('\t')), vdupq_n_u8(4))
+                );
+        }
+
+        b->quote     = mask64(quote[0], quote[1], quote[2], quote[3]);
+        b->backslash = mask64(backslash[0], backslash[1], backslash[2], backslash[3]);
+        b->op        = mask64(op[0], op[1], op[2], op[3]);
+        b->space     = mask64(space[0], space[1], space[2], space[3]);
 }
+#else
+static u8 const jclass[256] = {
+        ['"']  = JC_QUOTE,
+        ['\\'] = JC_BACKSLASH,
+
+        ['{'] = JC_OP, ['}'] = JC_OP,
+        ['['] = JC_OP, [']'] = JC_OP,
+        [':'] = JC_OP, [','] = JC_OP,
+
+        [' ']  = JC_SPACE, ['\n'] = JC_SPACE,
+        ['\t'] = JC_SPACE, ['\r'] = JC_SPACE,
+        ['\f'] = JC_SPACE, ['\v'] = JC_SPACE
+};
 
-static Value
-value(Ty *ty);
+static void
+classify(u8 const *p, JsonBlock *b)
+{
+        *b = (JsonBlock){0};
+
+        for (int i = 0; i < 64; ++i) {
+                u64 c = jclass[p[i]];
+                b->quote     |= (u64)((c & JC_QUOTE)     != 0) << i;
+                b->backslash |= (u64)((c & JC_BACKSLASH) != 0) << i;
+                b->op        |= (u64)((c & JC_OP)        != 0) << i;
+                b->space     |= (u64)((c & JC_SPACE)     != 0) << i;
+        }
+}
+#endif
+
+/*
+ * Returns the bytes in this block that are escaped by a backslash. Backslashes
+ * are rare enough in real documents that walking them one at a time is cheaper
+ * than the branch-free odd-run arithmetic simdjson uses. *carry is set when the
+ * last byte of the block is an unescaped backslash.
+ */
+inline static u64
+escaped(u64 backslash, u64 *carry)
+{
+        u64 mask = *carry;
 
-inline static void
-space(void)
+        backslash &= ~*carry;
+        *carry = 0;
+
+        while (backslash != 0) {
+                int i = __builtin_ctzll(backslash);
+                if (i == 63) {
+                        *carry = 1;
+                        break;
+                }
+                mask |= 2ULL << i;
+                backslash &= ~(3ULL << i);
+        }
+
+        return mask;
+}
+
+inline static u64
+prefix_xor(u64 x)
 {
-        while (isspace(peek())) next();
+        x ^= x << 1;
+        x ^= x << 2;
+        x ^= x << 4;
+        x ^= x << 8;
+        x ^= x << 16;
+        x ^= x << 32;
+
+        return x;
 }
 
-static Value
-number(void)
+/* Offsets in the index are 32-bit */
+static void
+check_size(Ty *ty, usize n)
 {
-        char numbuf[512];
-        char const *num = json;
-        bool integral = true;
+        if (n >= UINT32_MAX) {
+                zP("json: input exceeds maximum size (%zu bytes, the limit is 4GiB)", n);
+        }
+}
+
+static bool
+build_index(u8 const *s, usize n)
+{
+        /* All ones if the previous block ended inside a string */
+        u64 in_string = 0;
 
-        if (peek() == '-')
-                next();
+        /* Set if the previous block ended with a pending escape */
+        u64 carry = 0;
 
-        if (!isdigit(peek()))
-                FAIL;
+        /* Set if the previous block ended in the middle of a scalar */
+        u64 scalar = 0;
 
-        while (isdigit(peek()))
-                next();
+        v0(Index);
 
-        if (peek() == '.') {
-                integral = false;
-                next();
-                if (!isdigit(peek()))
-                        FAIL;
-                while (isdigit(peek()))
-                        next();
+        for (usize base = 0; base < n; base += 64) {
+                u8 buf[64];
+                u8 const *p = s + base;
+                JsonBlock b;
+
+                if (n - base < 64) {
+                        memset(buf, ' ', sizeof buf);
+                        memcpy(buf, p, n - base);
+                        p = buf;
+                }
+
+                classify(p, &b);
+
+                u64 quote  = b.quote & ~escaped(b.backslash, &carry);
+                u64 string = prefix_xor(quote) ^ in_string;
+                u64 other  = ~(b.op | b.space | quote | string);
+                u64 starts = other & ~((other << 1) | scalar);
+                u64 bits   = (b.op & ~string) | quote | starts;
+
+                in_string = (u64)((i64)string >> 63);
+                scalar = other >> 63;
+
+                xvR(Index, vN(Index) + __builtin_popcountll(bits) + 1);
+
+                while (bits != 0) {
+                        vPx(Index, base + __builtin_ctzll(bits));
+                        bits &= bits - 1;
+                }
         }
 
-        if (peek() == 'e' || peek() == 'E') {
-                integral = false;
-                next();
-                if (peek() == '-' || peek() == '+')
-                        next();
-                if (!isdigit(peek()))
-                        FAIL;
-                while (isdigit(peek()))
-                        next();
+        if (in_string) {
+                return false;
         }
 
-        int n = min(json - num, sizeof numbuf - 1);
-        memcpy(numbuf, num, n);
-        numbuf[n] = '\0';
+        xvR(Index, vN(Index) + 1);
+        vPx(Index, n);
+
+        return true;
+}
+
+inline static u32
+offset(void)
+{
+        return v__(Index, at);
+}
+
+inline static char
+peek(void)
+{
+        u32 off = v__(Index, at);
+        return (off < len) ? json[off] : '\0';
+}
+
+inline static char
+next(void)
+{
+        char c = peek();
+        at += (c != '\0');
+        return c;
+}
+
+inline static bool
+jspace(char c)
+{
+        return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+/*
+ * A scalar has to run right up to whitespace or the next structural character.
+ * Anything else after it (e.g. the x in `truex`) belongs to the same token and
+ * wasn't consumed, so the document is malformed. Must be called after the
+ * scalar's index entry has been consumed.
+ */
+inline static void
+scalar_end(usize end)
+{
+        if (end < len && end != offset() && !jspace(json[end]))
+                FAIL;
+}
+
+static Value
+value(Ty *ty);
+
+static double const exact_pow10[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+        1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+        1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static Value
+slow_number(char const *num, usize n, bool integral)
+{
+        char numbuf[512];
+        char *buf = (n < sizeof numbuf) ? numbuf : xmA(n + 1);
+
+        memcpy(buf, num, n);
+        buf[n] = '\0';
 
         Value result;
 
         errno = 0;
         if (integral)
-                result = INTEGER(strtoimax(num, NULL, 10));
+                result = INTEGER(strtoimax(buf, NULL, 10));
         else
-                result = REAL(strtod(num, NULL));
+                result = REAL(strtod(buf, NULL));
+
+        if (buf != numbuf)
+                xmF(buf);
 
         if (errno != 0)
                 FAIL;
@@ -112,48 +401,92 @@ number(void)
 }
 
 static Value
-null(void)
+number(void)
 {
-        if (strncmp(json, "null", 4) != 0)
-                FAIL;
+        char const *num = json + offset();
+        char const *end = json + len;
+        char const *p = num;
+
+        bool negative = false;
+        bool integral = true;
+        u64 m = 0;
+        i64 e = 0;
+        int digits = 0;
 
-        if (!KW_DELIM(json[4]))
+        if (*p == '-') {
+                negative = true;
+                p += 1;
+        }
+
+        if (p == end || !isdigit(*p))
                 FAIL;
 
-        json += 4;
-        len -= 4;
+        while (p < end && isdigit(*p)) {
+                m = 10 * m + (*p++ - '0');
+                digits += 1;
+        }
 
-        return NIL;
-}
+        if (p < end && *p == '.') {
+                char const *frac = ++p;
+                integral = false;
+                if (p == end || !isdigit(*p))
+                        FAIL;
+                while (p < end && isdigit(*p))
+                        m = 10 * m + (*p++ - '0');
+                digits += p - frac;
+                e -= p - frac;
+        }
 
-static Value
-jtrue(void)
-{
-        if (strncmp(json, "true", 4) != 0)
-                FAIL;
+        if (p < end && (*p == 'e' || *p == 'E')) {
+                bool negative_exp = false;
+                i64 x = 0;
+                integral = false;
+                p += 1;
+                if (p < end && (*p == '-' || *p == '+'))
+                        negative_exp = (*p++ == '-');
+                if (p == end || !isdigit(*p))
+                        FAIL;
+                while (p < end && isdigit(*p)) {
+                        if (x < 100000)
+                                x = 10 * x + (*p - '0');
+                        p += 1;
+                }
+                e += negative_exp ? -x : x;
+        }
 
-        if (!KW_DELIM(json[4]))
-                FAIL;
+        at += 1;
+        scalar_end(p - json);
+
+        if (integral && digits <= 18) {
+                return INTEGER(negative ? -(imax)m : (imax)m);
+        }
 
-        json += 4;
-        len -= 4;
+        /*
+         * Clinger's fast path: when the significand and the power of ten are
+         * both exactly representable as doubles, one IEEE multiplication or
+         * division gives the correctly rounded result.
+         */
+        if (!integral && digits <= 19 && m <= (1ULL << 53) && e >= -22 && e <= 22) {
+                double x = (double)m;
+                x = (e < 0) ? x / exact_pow10[-e] : x * exact_pow10[e];
+                return REAL(negative ? -x : x);
+        }
 
-        return BOOLEAN(true);
+        return slow_number(num, p - num, integral);
 }
 
 static Value
-jfalse(void)
+keyword(char const *word, usize n, Value v)
 {
-        if (strncmp(json, "false", 5) != 0)
-                FAIL;
+        u32 off = offset();
 
-        if (!KW_DELIM(json[5]))
+        if (len - off < n || memcmp(json + off, word, n) != 0)
                 FAIL;
 
-        json += 5;
-        len -= 5;
+        at += 1;
+        scalar_end(off + n);
 
-        return BOOLEAN(false);
+        return v;
 }
 
 static u8 const xtable[256] = {
@@ -168,96 +501,226 @@ static u8 const xtable[256] = {
         ['F'] = 15, ['f'] = 15
 };
 
-inline static u16
-next16x(Ty *ty)
+inline static u32
+hex(char const *p, int n)
 {
-        u8 b0 = xtable[(u8)next()];
-        u8 b1 = xtable[(u8)next()];
-        u8 b2 = xtable[(u8)next()];
-        u8 b3 = xtable[(u8)next()];
+        u32 x = 0;
 
-        return (b3 << 0)
-             | (b2 << 4)
-             | (b1 << 8)
-             | (b0 << 12);
-}
-
-inline static u8
-next8x(Ty *ty)
-{
-        u8 b0 = xtable[(u8)next()];
-        u8 b1 = xtable[(u8)next()];
+        for (int i = 0; i < n; ++i) {
+                x = (x << 4) | xtable[(u8)p[i]];
+        }
 
-        return (b1 << 0)
-             | (b0 << 4);
+        return x;
 }
 
+/*
+ * Decodes json[start..end), which contains at least one backslash. Escapes
+ * never decode to more bytes than they take up in the input, so the result
+ * fits in a string of the raw length.
+ */
 static Value
-string(Ty *ty)
+unescape(Ty *ty, u32 start, u32 end)
 {
-        if (next() != '"')
-                FAIL;
-
-        byte_vector str = {0};
+        char const *p = json + start;
+        char const *stop = json + end;
+        u8 *s = value_string_alloc(ty, end - start);
+        usize n = 0;
 
-        char b[8] = {0};
         i32 cp;
         u16 lo;
         u16 hi;
-        utf8proc_size_t n;
-
-        while (peek() != '\0' && peek() != '"') {
-                switch ((peek() == '\\') ? (next(), next()) : -1) {
-                case 't':  xvP(str, '\t'); break;
-                case 'f':  xvP(str, '\f'); break;
-                case 'n':  xvP(str, '\n'); break;
-                case 'r':  xvP(str, '\r'); break;
-                case 'b':  xvP(str, '\b'); break;
-                case '"':  xvP(str, '"');  break;
-                case '/':  xvP(str, '/');  break;
-                case '\\': xvP(str, '\\'); break;
+
+        while (p < stop) {
+                if (*p != '\\') {
+                        char const *bs = memchr(p, '\\', stop - p);
+                        if (bs == NULL)
+                                bs = stop;
+                        memcpy(s + n, p, bs - p);
+                        n += bs - p;
+                        p = bs;
+                        continue;
+                }
+
+                if (stop - p < 2)
+                        FAIL;
+
+                switch (p[1]) {
+                case 't':  s[n++] = '\t'; break;
+                case 'f':  s[n++] = '\f'; break;
+                case 'n':  s[n++] = '\n'; break;
+                case 'r':  s[n++] = '\r'; break;
+                case 'b':  s[n++] = '\b'; break;
 
                 case 'x':
-                        xvP(str, next8x(ty));
+                        if (stop - p < 4)
+                                FAIL;
+                        s[n++] = hex(p + 2, 2);
+                        p += 2;
                         break;
 
                 case 'u':
-                        cp = next16x(ty);
+                        if (stop - p < 6)
+                                FAIL;
+                        cp = hex(p + 2, 4);
                         if ((cp & 0xF800) == 0xD800) {
-                                if (next() != '\\' || next() != 'u') {
+                                if (stop - p < 12 || p[6] != '\\' || p[7] != 'u') {
                                         FAIL;
                                 }
 
                                 hi = cp;
-                                lo = next16x(ty);
+                                lo = hex(p + 8, 4);
 
                                 cp = 0x10000 + ((hi - 0xD800) << 10) + (lo - 0xDC00);
+                                p += 6;
                         }
-                        n = utf8proc_encode_char(cp, (u8 *)b);
-                        xvPn(str, b, n);
+                        n += utf8proc_encode_char(cp, s + n);
+                        p += 4;
                         break;
 
                 default:
-                        xvP(str, next());
+                        s[n++] = p[1];
                 }
+
+                p += 2;
         }
 
-        if (next() != '"')
-                FAIL;
+        return STRING(s, n);
+}
 
-        n = str.count;
+static Value
+string_at(Ty *ty, u32 start, u32 end)
+{
+        usize n = end - start;
 
         if (n == 0)
                 return STRING_NOGC(NULL, 0);
 
-        char *s = value_string_alloc(ty, n);
-        memcpy(s, str.items, n);
+        if (memchr(json + start, '\\', n) != NULL)
+                return unescape(ty, start, end);
 
-        xvF(str);
+        char *s = value_string_alloc(ty, n);
+        memcpy(s, json + start, n);
 
         return STRING(s, n);
 }
 
+inline static void
+string_bounds(u32 *start, u32 *end)
+{
+        *start = offset() + 1;
+
+        if (next() != '"')
+                FAIL;
+
+        *end = offset();
+
+        if (next() != '"')
+                FAIL;
+}
+
+static Value
+string(Ty *ty)
+{
+        u32 start;
+        u32 end;
+
+        string_bounds(&start, &end);
+
+        return string_at(ty, start, end);
+}
+
+/*
+ * Object keys repeat a lot (think of an array of a million records with the
+ * same ten fields), so each distinct escape-free key is only turned into a
+ * value once per parse. The table is reset between parses by bumping KeyGen.
+ */
+static JsonKey *
+intern_key(u32 start, u32 end)
+{
+        u32 n = end - start;
+
+        if (n > JSON_KEY_MAX_LEN || memchr(json + start, '\\', n) != NULL)
+                return NULL;
+
+        if (Keys == NULL) {
+                Keys = xmA(JSON_KEY_SLOTS * sizeof *Keys);
+                memset(Keys, 0, JSON_KEY_SLOTS * sizeof *Keys);
+        }
+
+        u64 hash = XXH3_64bits(json + start, n);
+        u32 i = hash & (JSON_KEY_SLOTS - 1);
+
+        for (;;) {
+                JsonKey *k = &Keys[i];
+
+                if (k->gen != KeyGen) {
+                        if (KeyCount == JSON_KEY_MAX)
+                                return NULL;
+                        KeyCount += 1;
+                        *k = (JsonKey) {
+                                .hash = hash,
+                                .gen  = KeyGen,
+                                .off  = start,
+                                .len  = n,
+                                .id   = -1,
+                                .key  = NONE
+                        };
+                        return k;
+                }
+
+                if (
+                        k->hash == hash
+                     && k->len == n
+                     && memcmp(json + k->off, json + start, n) == 0
+                ) {
+                        return k;
+                }
+
+                i = (i + 1) & (JSON_KEY_SLOTS - 1);
+        }
+}
+
+static Value
+key(Ty *ty)
+{
+        u32 start;
+        u32 end;
+
+        string_bounds(&start, &end);
+
+        JsonKey *k = intern_key(start, end);
+
+        if (k == NULL)
+                return string_at(ty, start, end);
+
+        if (k->key.type == VALUE_NONE)
+                k->key = string_at(ty, start, end);
+
+        return k->key;
+}
+
+static i32
+key_id(Ty *ty)
+{
+        u32 start;
+        u32 end;
+
+        string_bounds(&start, &end);
+
+        JsonKey *k = intern_key(start, end);
+
+        if (k != NULL && k->id != -1)
+                return k->id;
+
+        Value key = string_at(ty, start, end);
+        i32 id = M_ID(TY_TMP_C_STR(key));
+
+        if (k != NULL)
+                k->id = id;
+
+        return id;
+}
+
 static Value
 array(Ty *ty)
 {
@@ -266,15 +729,13 @@ array(Ty *ty)
 
         Array *a = vA();
 
-        while (peek() != '\0' && peek() != ']') {
+        while (peek() != ']') {
                 vvP(*a, value(ty));
-                space();
                 if (peek() != ']' && next() != ',')
                         FAIL;
         }
 
-        if (next() != ']')
-                FAIL;
+        next();
 
         return ARRAY(a);
 }
@@ -287,21 +748,17 @@ object_lol(Ty *ty)
 
         Dict *obj = dict_new(ty);
 
-        while (peek() != '\0' && peek() != '}') {
-                space();
-                Value key = string(ty);
-                space();
+        while (peek() != '}') {
+                Value k = key(ty);
                 if (next() != ':')
                         FAIL;
                 Value val = value(ty);
-                dict_put_value(ty, obj, key, val);
-                space();
+                dict_put_value(ty, obj, k, val);
                 if (peek() != '}' && next() != ',')
                         FAIL;
         }
 
-        if (next() != '}')
-                FAIL;
+        next();
 
         return DICT(obj);
 }
@@ -314,15 +771,12 @@ object_xD(Ty *ty)
 
         SCRATCH_SAVE();
 
-        ValueVector keys   = {0};
+        i32Vector   ids    = {0};
         ValueVector values = {0};
 
-        while (peek() != '\0' && peek() != '}') {
-                space();
+        while (peek() != '}') {
+                i32 id = key_id(ty);
 
-                Value key = string(ty);
-
-                space();
                 if (next() != ':') {
                         SCRATCH_RESTORE();
                         FAIL;
@@ -330,24 +784,21 @@ object_xD(Ty *ty)
 
                 Value val = value(ty);
 
-                space();
                 if (peek() != '}' && next() != ',') {
                         SCRATCH_RESTORE();
                         FAIL;
                 }
 
-                svP(keys, key);
+                svP(ids, id);
                 svP(values, val);
         }
 
-        if (next() != '}')
-                FAIL;
+        next();
 
-        Value object = value_record(ty, vN(keys));
+        Value object = value_record(ty, vN(ids));
 
-        for (u32 i = 0; i < vN(keys); ++i) {
-                char const *key = TY_TMP_C_STR(v__(keys, i));
-                object.ids[i]   = M_ID(key);
+        for (u32 i = 0; i < vN(ids); ++i) {
+                object.ids[i]   = v__(ids, i);
                 object.items[i] = v__(values, i);
         }
 
@@ -365,15 +816,13 @@ object(Ty *ty)
 static Value
 value(Ty *ty)
 {
-        space();
-
         switch (peek()) {
         case '{': return object(ty);
         case '[': return array(ty);
         case '"': return string(ty);
-        case 'n': return null();
-        case 't': return jtrue();
-        case 'f': return jfalse();
+        case 'n': return keyword("null", 4, NIL);
+        case 't': return keyword("true", 4, BOOLEAN(true));
+        case 'f': return keyword("false", 5, BOOLEAN(false));
         case '-': case '0': case '1': case '2': case '3': case '4':
         case '5': case '6': case '7': case '8': case '9':
                 return number();
@@ -404,117 +853,465 @@ try_visit(void const *p)
         }
 }
 
+/*
+ * Output goes into `out`, which json_encode() turns into a string at the end.
+ * json_write() instead points Sink at a file descriptor or Blob, and whenever
+ * out fills up past JSON_WRITE_CHUNK at a value boundary it is drained into
+ * the sink, so the complete encoding never exists in memory at once.
+ */
+
+#define JSON_WRITE_CHUNK  (1U << 16)
+#define JSON_WRITE_DIRECT (1U << 14)
+
+typedef struct {
+        int fd;
+        Blob *blob;
+        JsonWriteOptions const *opts;
+        usize depth;
+        usize written;
+} JsonSink;
+
+static _Thread_local JsonSink *Sink;
+static _Thread_local str WriteBuffer;
+
+/* Bytes that can be copied into a string literal as they are */
+static u8 const plain[256] = {
+        [0x20 ... 0x7E] = 1,
+        ['"']  = 0,
+        ['\\'] = 0
+};
+
+#ifdef _WIN32
 static bool
-encode(Ty *ty, Value const *v, str *out)
+write_fd(int fd, void const *p, usize n)
 {
-        if (v->type & VALUE_TAGGED) {
-                Value val = *v;
-                char const *tn = tags_name(ty, tags_first(ty, v->tags));
+        while (n > 0) {
+                int r = _write(fd, p, min(n, INT_MAX));
+                if (r < 0) {
+                        return false;
+                }
+                p = (char const *)p + r;
+                n -= r;
+        }
 
-                val.tags = tags_pop(ty, v->tags);
-                if (val.tags == 0) {
-                        val.type &= ~VALUE_TAGGED;
+        return true;
+}
+#else
+static bool
+write_fd(int fd, struct iovec *v, int nv)
+{
+        while (nv > 0) {
+                ssize_t r = writev(fd, v, nv);
+
+                if (r < 0 && errno == EINTR) {
+                        continue;
                 }
 
-                dump((void *)out, "{\"type\":\"%s\",\"value\":", tn);
+                if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                        struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+                        poll(&pfd, 1, -1);
+                        continue;
+                }
 
-                if (!encode(ty, &val, out)) {
+                if (r < 0) {
                         return false;
                 }
 
-                xvP(*out, '}');
+                while (nv > 0 && (usize)r >= v->iov_len) {
+                        r -= v->iov_len;
+                        v += 1;
+                        nv -= 1;
+                }
 
-                return true;
+                if (nv > 0) {
+                        v->iov_base = (char *)v->iov_base + r;
+                        v->iov_len -= r;
+                }
         }
 
-        bool first = true;
-
-        switch (v->type & ~VALUE_TAGGED) {
-        case VALUE_NIL:
-                xvPn(*out, "null", 4);
-                break;
+        return true;
+}
+#endif
 
-        case VALUE_TAG:
-                dump((void *)out, "\"%s\"", tags_name(ty, v->tag));
-                break;
+/*
+ * Sends everything in out, followed by extra[0..n), to the sink.
+ */
+static void
+drain(Ty *ty, str *out, void const *extra, usize n)
+{
+        JsonSink *sink = Sink;
+        bool ok = true;
 
-        case VALUE_STRING:
-                xvP(*out, '"');
-                for (int i = 0; i < sN(*v); ++i) {
-                        int n;
-                        int32_t cp;
-                        switch (ss(*v)[i]) {
-                        case '\t':
-                                xvP(*out, '\\');
-                                xvP(*out, 't');
-                                break;
-                        case '\n':
-                                xvP(*out, '\\');
-                                xvP(*out, 'n');
-                                break;
-                        case '\\':
-                        case '"':
-                                xvP(*out, '\\');
-                        default:
-                                if ((ss(*v)[i]) > 127) {
-                                        n = utf8proc_iterate(&ss(*v)[i], sN(*v) - i, &cp);
-                                        if (n <= 0) {
-                                                dump(out, "\\x%02hhx", ss(*v)[i]);
-                                        } else {
-                                                if (cp <= 0xFFFF) {
-                                                        dump(out, "\\u%04x", cp);
-                                                } else {
-                                                        cp -= 0x10000;
-                                                        u16 hi = 0xD800 + (cp >> 10);
-                                                        u16 lo = 0xDC00 + (cp & 0x3FF);
-                                                        dump(out, "\\u%04x\\u%04x", hi, lo);
-                                                }
-                                        }
-                                        i += n - 1;
-                                } else if (iscntrl(ss(*v)[i])) {
-                                        dump(out, "\\x%02hhx", ss(*v)[i]);
-                                } else {
-                                        xvP(*out, ss(*v)[i]);
-                                }
-                                break;
-                        }
-                }
-                xvP(*out, '"');
-                break;
+        if (sink->blob != NULL) {
+                uvPn(*sink->blob, vv(*out), vN(*out));
+                uvPn(*sink->blob, extra, n);
+        } else {
+#ifdef _WIN32
+                ok = write_fd(sink->fd, vv(*out), vN(*out))
+                  && write_fd(sink->fd, extra, n);
+#else
+                struct iovec iov[2] = {
+                        { .iov_base = vv(*out),      .iov_len = vN(*out) },
+                        { .iov_base = (void *)extra, .iov_len = n        }
+                };
+                ok = write_fd(sink->fd, iov, (n > 0) ? 2 : 1);
+#endif
+        }
 
-        case VALUE_BOOLEAN:
-                if (v->boolean)
-                        xvPn(*out, "true", 4);
-                else
-                        xvPn(*out, "false", 5);
-                break;
+        if (!ok) {
+                zP("json.write(): %s", strerror(errno));
+        }
 
-        case VALUE_INTEGER:
-                xvR(*out, out->count + 64);
-                out->count += snprintf(out->items + out->count, 64, "%"PRIiMAX, v->z);
-                break;
+        sink->written += vN(*out) + n;
+        vN(*out) = 0;
+}
 
-        case VALUE_REAL:
-                xvR(*out, out->count + 64);
-                out->count += dtoa(v->real, out->items + out->count, 64);
+inline static void
+spill(Ty *ty, str *out)
+{
+        if (Sink != NULL && vN(*out) >= JSON_WRITE_CHUNK) {
+                drain(ty, out, NULL, 0);
+        }
+}
+
+inline static bool
+pretty(void)
+{
+        return Sink != NULL && Sink->opts->indent > 0;
+}
+
+inline static void
+newline(str *out)
+{
+        if (pretty()) {
+                usize n = Sink->depth * Sink->opts->indent;
+                xvR(*out, vN(*out) + n + 1);
+                vPx(*out, '\n');
+                memset(vZ(*out), ' ', n);
+                vN(*out) += n;
+        }
+}
+
+inline static void
+open_container(str *out, char c)
+{
+        xvP(*out, c);
+        if (Sink != NULL) {
+                Sink->depth += 1;
+        }
+}
+
+inline static void
+close_container(str *out, char c, bool empty)
+{
+        if (Sink != NULL) {
+                Sink->depth -= 1;
+        }
+
+        if (!empty) {
+                newline(out);
+        }
+
+        xvP(*out, c);
+}
+
+inline static void
+separator(str *out, bool first)
+{
+        if (!first) {
+                xvP(*out, ',');
+        }
+
+        newline(out);
+}
+
+inline static void
+colon(str *out)
+{
+        xvP(*out, ':');
+        if (pretty()) {
+                xvP(*out, ' ');
+        }
+}
+
+static void
+encode_string(Ty *ty, u8 const *s, usize n, str *out)
+{
+        usize i = 0;
+
+        /* Long strings that need no escaping go straight from the value to
+         * the file descriptor */
+        if (
+                Sink != NULL
+             && Sink->blob == NULL
+             && n >= JSON_WRITE_DIRECT
+        ) {
+                while (i < n && plain[s[i]]) {
+                        i += 1;
+                }
+
+                if (i == n) {
+                        xvP(*out, '"');
+                        drain(ty, out, s, n);
+                        xvP(*out, '"');
+                        return;
+                }
+        }
+
+        xvP(*out, '"');
+
+        for (i = 0; i < n; ++i) {
+                usize run = i;
+                while (run < n && plain[s[run]]) {
+                        run += 1;
+                }
+
+                xvPn(*out, (char const *)s + i, run - i);
+
+                if ((i = run) == n) {
+                        break;
+                }
+
+                int m;
+                i32 cp;
+
+                switch (s[i]) {
+                case '\t':
+                        xvPn(*out, "\\t", 2);
+                        break;
+
+                case '\n':
+                        xvPn(*out, "\\n", 2);
+                        break;
+
+                case '\\':
+                case '"':
+                        xvP(*out, '\\');
+                        xvP(*out, s[i]);
+                        break;
+
+                default:
+                        if (s[i] > 127) {
+                                m = utf8proc_iterate(s + i, n - i, &cp);
+                                if (m <= 0) {
+                                        dump(out, "\\x%02hhx", s[i]);
+                                } else {
+                                        if (cp <= 0xFFFF) {
+                                                dump(out, "\\u%04x", cp);
+                                        } else {
+                                                cp -= 0x10000;
+                                                u16 hi = 0xD800 + (cp >> 10);
+                                                u16 lo = 0xDC00 + (cp & 0x3FF);
+                                                dump(out, "\\u%04x\\u%04x", hi, lo);
+                                        }
+                                        i += m - 1;
+                                }
+                        } else {
+                                dump(out, "\\x%02hhx", s[i]);
+                        }
+                        break;
+                }
+
+                if ((i & 0xFFF) == 0) {
+                        spill(ty, out);
+                }
+        }
+
+        xvP(*out, '"');
+}
+
+static void
+encode_real(double x, str *out)
+{
+        xvR(*out, vN(*out) + 64);
+
+        if (Sink != NULL && Sink->opts->precision > 0) {
+                vN(*out) += snprintf(vZ(*out), 64, "%.*g", Sink->opts->precision, x);
+        } else if (Sink != NULL && Sink->opts->single && fabs(x) <= FLT_MAX) {
+                vN(*out) += swift_dtoa_optimal_float((float)x, vZ(*out), 64);
+        } else {
+                vN(*out) += dtoa(x, vZ(*out), 64);
+        }
+}
+
+/*
+ * Pre-encoded `"name":` prefixes for a run of records with the same fields.
+ */
+typedef struct {
+        int const *ids;
+        int count;
+        u32 *offs;
+        str text;
+} JsonShape;
+
+static bool
+shape_init(Ty *ty, JsonShape *shape, Value const *v)
+{
+        if (v->type != VALUE_TUPLE || v->ids == NULL || v->count == 0) {
+                return false;
+        }
+
+        for (int i = 0; i < v->count; ++i) {
+                if (v->ids[i] == -1) {
+                        return false;
+                }
+        }
+
+        shape->ids = v->ids;
+        shape->count = v->count;
+        shape->offs = smA((v->count + 1) * sizeof (u32));
+        v00(shape->text);
+
+        for (int i = 0; i < v->count; ++i) {
+                char const *name = M_NAME(v->ids[i]);
+                shape->offs[i] = vN(shape->text);
+                encode_string(ty, (u8 const *)name, strlen(name), &shape->text);
+                colon(&shape->text);
+        }
+
+        shape->offs[v->count] = vN(shape->text);
+
+        return true;
+}
+
+inline static bool
+shape_fits(JsonShape const *shape, Value const *v)
+{
+        return v->type == VALUE_TUPLE
+            && v->count == shape->count
+            && v->ids != NULL
+            && (
+                    v->ids == shape->ids
+                 || memcmp(v->ids, shape->ids, v->count * sizeof (int)) == 0
+            );
+}
+
+static bool
+encode(Ty *ty, Value const *v, str *out);
+
+static bool
+encode_record(Ty *ty, Value const *v, JsonShape const *shape, str *out)
+{
+        open_container(out, '{');
+
+        if (!try_visit(v->items)) {
+                return false;
+        }
+
+        for (int i = 0; i < v->count; ++i) {
+                separator(out, i == 0);
+                xvPn(
+                        *out,
+                        vv(shape->text) + shape->offs[i],
+                        shape->offs[i + 1] - shape->offs[i]
+                );
+                if (!encode(ty, &v->items[i], out)) {
+                        return false;
+                }
+        }
+
+        vvX(Visiting);
+        close_container(out, '}', v->count == 0);
+
+        return true;
+}
+
+static bool
+encode(Ty *ty, Value const *v, str *out)
+{
+        if (v->type & VALUE_TAGGED) {
+                Value val = *v;
+                char const *tn = tags_name(ty, tags_first(ty, v->tags));
+
+                val.tags = tags_pop(ty, v->tags);
+                if (val.tags == 0) {
+                        val.type &= ~VALUE_TAGGED;
+                }
+
+                dump((void *)out, "{\"type\":\"%s\",\"value\":", tn);
+
+                if (!encode(ty, &val, out)) {
+                        return false;
+                }
+
+                xvP(*out, '}');
+
+                return true;
+        }
+
+        bool first = true;
+
+        switch (v->type & ~VALUE_TAGGED) {
+        case VALUE_NIL:
+                xvPn(*out, "null", 4);
+                break;
+
+        case VALUE_TAG:
+                dump((void *)out, "\"%s\"", tags_name(ty, v->tag));
+                break;
+
+        case VALUE_STRING:
+                encode_string(ty, ss(*v), sN(*v), out);
+                break;
+
+        case VALUE_BOOLEAN:
+                if (v->boolean)
+                        xvPn(*out, "true", 4);
+                else
+                        xvPn(*out, "false", 5);
+                break;
+
+        case VALUE_INTEGER:
+                xvR(*out, out->count + 64);
+                out->count += snprintf(out->items + out->count, 64, "%"PRIiMAX, v->z);
+                break;
+
+        case VALUE_REAL:
+                encode_real(v->real, out);
                 break;
 
         case VALUE_ARRAY:
-                xvP(*out, '[');
+        {
+                open_container(out, '[');
                 if (!try_visit(v->array))
                         return false;
+
+                JsonShape shape;
+                bool shaped = false;
+
+                SCRATCH_SAVE();
+
+                if (v->array->count > 1) {
+                        shaped = shape_init(ty, &shape, &v->array->items[0]);
+                }
+
                 for (int i = 0; i < v->array->count; ++i) {
-                        if (!encode(ty, &v->array->items[i], out))
+                        Value const *x = &v->array->items[i];
+                        separator(out, i == 0);
+                        bool ok = (shaped && shape_fits(&shape, x))
+                                ? encode_record(ty, x, &shape, out)
+                                : encode(ty, x, out);
+                        if (!ok) {
+                                if (shaped) xvF(shape.text);
+                                SCRATCH_RESTORE();
                                 return false;
-                        if (i + 1 < v->array->count)
-                                xvP(*out, ',');
+                        }
+                        spill(ty, out);
                 }
+
+                if (shaped) {
+                        xvF(shape.text);
+                }
+
+                SCRATCH_RESTORE();
+
                 vvX(Visiting);
-                xvP(*out, ']');
+                close_container(out, ']', v->array->count == 0);
                 break;
+        }
 
         case VALUE_DICT:
-                xvP(*out, '{');
+                open_container(out, '{');
                 if (!try_visit(v->dict)) {
                         return false;
                 }
@@ -522,20 +1319,17 @@ encode(Ty *ty, Value const *v, str *out)
                         if (key->type != VALUE_STRING) {
                                 continue;
                         }
-                        if (!first) {
-                                xvP(*out, ',');
-                        }
-                        if (!encode(ty, key, out)) {
-                                return false;
-                        }
-                        xvP(*out, ':');
+                        separator(out, first);
+                        encode_string(ty, ss(*key), sN(*key), out);
+                        colon(out);
                         if (!encode(ty, val, out)) {
                                 return false;
                         }
+                        spill(ty, out);
                         first = false;
                 });
                 vvX(Visiting);
-                xvP(*out, '}');
+                close_container(out, '}', first);
                 break;
 
         case VALUE_OBJECT:
@@ -547,7 +1341,7 @@ encode(Ty *ty, Value const *v, str *out)
 
                 if (vp != NULL) {
                         Value method = METHOD(NAMES.json, vp, v);
-                        Value s = vm_eval_function(ty, NULL, &method, NULL);
+                        Value s = vm_eval_function(ty, &method, NULL);
                         if (s.type == VALUE_STRING) {
                                 gP(&s);
                                 xvPn(*out, ss(s), sN(s));
@@ -556,44 +1350,41 @@ encode(Ty *ty, Value const *v, str *out)
                                 return encode(ty, &s, out);
                         }
                 } else {
-                        xvP(*out, '{');
+                        open_container(out, '{');
                         for (int i = 0; i < v->object->nslot; ++i) {
                                 char const *name = M_NAME(v__(v->object->class->fields.ids, i));
-                                xvPn(*out, name, strlen(name));
-                                xvP(*out, '"');
-                                xvP(*out, ':');
+                                separator(out, first);
+                                encode_string(ty, (u8 const *)name, strlen(name), out);
+                                colon(out);
                                 if (!encode(ty, &v->object->slots[i], out)) {
                                         return false;
                                 }
-                                xvP(*out, ',');
+                                first = false;
                         }
                         if (v->object->dynamic != NULL) {
                                 for (int i = 0; i < vN(v->object->dynamic->ids); ++i) {
                                         char const *name = M_NAME(v__(v->object->dynamic->ids, i));
-                                        xvPn(*out, name, strlen(name));
-                                        xvP(*out, '"');
-                                        xvP(*out, ':');
-                                        if (!encode(ty, &v->object->slots[i], out)) {
+                                        separator(out, first);
+                                        encode_string(ty, (u8 const *)name, strlen(name), out);
+                                        colon(out);
+                                        if (!encode(ty, v_(v->object->dynamic->values, i), out)) {
                                                 return false;
                                         }
-                                        xvP(*out, ',');
+                                        first = false;
                                 }
                         }
                         vvX(Visiting);
-                        if (*vvL(*out) == ',') {
-                                *vvL(*out) = '}';
-                        } else {
-                                xvP(*out, '}');
-                        }
+                        close_container(out, '}', first);
                 }
                 break;
         }
 
         case VALUE_TUPLE:
-                xvP(*out, '{');
+                open_container(out, '{');
                 if (!try_visit(v->items))
                         return false;
                 for (int i = 0; i < v->count; ++i) {
+                        separator(out, i == 0);
                         xvP(*out, '"');
                         if (v->ids != NULL && v->ids[i] != -1) {
                                 char const *name = M_NAME(v->ids[i]);
@@ -604,18 +1395,13 @@ encode(Ty *ty, Value const *v, str *out)
                                 xvPn(*out, b, strlen(b));
                         }
                         xvP(*out, '"');
-                        xvP(*out, ':');
+                        colon(out);
                         if (!encode(ty, &v->items[i], out)) {
                                 return false;
                         }
-                        xvP(*out, ',');
                 }
                 vvX(Visiting);
-                if (*vvL(*out) == ',') {
-                        *vvL(*out) = '}';
-                } else {
-                        xvP(*out, '}');
-                }
+                close_container(out, '}', v->count == 0);
                 break;
 
         case VALUE_BLOB:
@@ -639,26 +1425,38 @@ encode(Ty *ty, Value const *v, str *out)
         return true;
 }
 
-Value
-json_parse(Ty *ty, char const *s, usize n)
+static Value
+parse(Ty *ty, char const *s, usize n)
 {
+        check_size(ty, n);
+
         json = s;
         len = n;
+        at = 0;
 
-        xd = false;
+        KeyCount = 0;
+        if (++KeyGen == 0) {
+                if (Keys != NULL) {
+                        memset(Keys, 0, JSON_KEY_SLOTS * sizeof *Keys);
+                }
+                KeyGen = 1;
+        }
 
         GC_STOP();
 
-        if (setjmp(jb) != 0) {
-                GC_RESUME();
-                return NIL;
-        }
+        Value v = NIL;
 
-        Value v = value(ty);
-        space();
+        if (setjmp(jb) == 0 && build_index((u8 const *)s, n)) {
+                v = value(ty);
+                if (at + 1 != vN(Index)) {
+                        v = NIL;
+                }
+        }
 
-        if (peek() != '\0')
-                v = NIL;
+        if (vC(Index) > JSON_INDEX_KEEP) {
+                xvF(Index);
+                v00(Index);
+        }
 
         GC_RESUME();
 
@@ -666,59 +1464,862 @@ json_parse(Ty *ty, char const *s, usize n)
 }
 
 Value
-json_parse_xD(Ty *ty, char const *s, usize n)
+json_parse(Ty *ty, char const *s, usize n)
 {
-        json = s;
-        len = n;
+        xd = false;
+        return parse(ty, s, n);
+}
 
+Value
+json_parse_xD(Ty *ty, char const *s, usize n)
+{
         xd = true;
+        return parse(ty, s, n);
+}
 
-        GC_STOP();
+/*
+ * Lazy documents.
+ *
+ * json_index() only runs the first stage and keeps what it found: for every
+ * entry in the structural index, its offset in the input and the position of
+ * the entry just past the value that starts there. That's enough to walk to
+ * any member or element while stepping over whole subtrees, and nothing is
+ * materialized until json_lazy_value() is asked for a particular value.
+ */
+
+typedef struct {
+        u32 off;
+        u32 next;
+} JsonEntry;
+
+typedef struct {
+        char const *s;
+        usize n;
+        JsonEntry const *e;
+        u32 count;
+} JsonDoc;
+
+typedef struct {
+        Ty *ty;
+        JsonDoc const *doc;
+        char const *key;
+        usize n;
+        i64 index;
+        i64 found;
+        Value *out;
+} JsonWalk;
 
-        if (setjmp(jb) != 0) {
-                GC_RESUME();
+Value
+json_index(Ty *ty, char const *s, usize n)
+{
+        check_size(ty, n);
+
+        if (!build_index((u8 const *)s, n)) {
                 return NIL;
         }
 
-        Value v = value(ty);
-        space();
+        u32 count = vN(Index);
 
-        if (peek() != '\0')
-                v = NIL;
+        if (count < 2) {
+                return NIL;
+        }
 
-        GC_RESUME();
+        Blob *b = value_blob_new(ty);
+        NOGC(b);
+        uvR(*b, count * sizeof (JsonEntry));
+        OKGC(b);
 
-        return v;
-}
+        JsonEntry *e = (JsonEntry *)vv(*b);
+        bool ok = true;
+        bool open = false;
 
-Value
-json_encode(Ty *ty, Value const *v)
-{
-        str buf = {0};
-        Value r = NIL;
+        SCRATCH_SAVE();
 
-        v0(Visiting);
+        U32Vector stack = {0};
 
-        if (encode(ty, v, &buf)) {
-                r = vSs(vv(buf), vN(buf));
-                xvF(buf);
-        }
+        for (u32 i = 0; ok && i + 1 < count; ++i) {
+                u32 off = v__(Index, i);
 
-        return r;
-}
+                e[i].off = off;
+                e[i].next = i + 1;
 
+                switch (s[off]) {
+                case '{':
+                case '[':
+                        svP(stack, i);
+                        break;
 
-bool
-json_dump(Ty *ty, Value const  *v, byte_vector *out)
-{
-        Visiting.count = 0;
+                case '}':
+                case ']':
+                        if (vN(stack) == 0 || (s[e[*vvL(stack)].off] == '{') != (s[off] == '}')) {
+                                ok = false;
+                        } else {
+                                e[vXx(stack)].next = i + 1;
+                        }
+                        break;
 
-        usize start = vN(*out);
+                case '"':
+                        /* Opening and closing quotes alternate */
+                        if ((open = !open)) {
+                                e[i].next = i + 2;
+                        }
+                        break;
+                }
+        }
 
-        if (!encode(ty, v, out)) {
-                out->count = start;
-                return false;
+        ok = ok && vN(stack) == 0 && e[0].next == count - 1;
+
+        SCRATCH_RESTORE();
+
+        e[count - 1].off = n;
+        e[count - 1].next = count;
+        vN(*b) = count * sizeof (JsonEntry);
+
+        if (vC(Index) > JSON_INDEX_KEEP) {
+                xvF(Index);
+                v00(Index);
         }
 
-        return true;
+        return ok ? BLOB(b) : NIL;
+}
+
+inline static char
+doc_char(JsonDoc const *doc, i64 at)
+{
+        return (at >= 0 && at + 1 < doc->count) ? doc->s[doc->e[at].off] : '\0';
+}
+
+static bool
+doc_open(Ty *ty, Value const *src, Value const *index, imax at, JsonDoc *doc)
+{
+        switch (src->type) {
+        case VALUE_STRING:
+                doc->s = (char const *)ss(*src);
+                doc->n = sN(*src);
+                break;
+
+        case VALUE_BLOB:
+                doc->s = (char const *)vv(*src->blob);
+                doc->n = vN(*src->blob);
+                break;
+
+        default:
+                return false;
+        }
+
+        if (index->type != VALUE_BLOB) {
+                return false;
+        }
+
+        doc->e = (JsonEntry const *)vv(*index->blob);
+        doc->count = vN(*index->blob) / sizeof (JsonEntry);
+
+        return doc->count > 1
+            && doc->e[doc->count - 1].off == doc->n
+            && at >= 0
+            && at + 1 < doc->count;
+}
+
+static Value
+doc_key(Ty *ty, JsonDoc const *doc, u32 k)
+{
+        json = doc->s;
+        len = doc->n;
+
+        if (setjmp(jb) != 0) {
+                return NIL;
+        }
+
+        return string_at(ty, doc->e[k].off + 1, doc->e[k + 1].off);
+}
+
+static bool
+doc_key_eq(Ty *ty, JsonDoc const *doc, u32 k, char const *key, usize n)
+{
+        char const *start = doc->s + doc->e[k].off + 1;
+        usize size = doc->s + doc->e[k + 1].off - start;
+
+        if (memchr(start, '\\', size) == NULL) {
+                return size == n && memcmp(start, key, n) == 0;
+        }
+
+        Value decoded = doc_key(ty, doc, k);
+
+        return decoded.type == VALUE_STRING
+            && sN(decoded) == n
+            && memcmp(ss(decoded), key, n) == 0;
+}
+
+/*
+ * Calls f(w, key, value) for each member of the object (or element of the
+ * array) at `at`, where key is the position of the member's key, or -1 for
+ * array elements. Stops early once f returns false. Returns false if the
+ * container turns out to be malformed.
+ */
+static bool
+doc_each(JsonDoc const *doc, i64 at, bool (*f)(JsonWalk *, i64, u32), JsonWalk *w)
+{
+        char open = doc_char(doc, at);
+        char close = (open == '{') ? '}' : ']';
+        i64 k = at + 1;
+
+        while (doc_char(doc, k) != close) {
+                i64 key = -1;
+
+                if (open == '{') {
+                        if (doc_char(doc, k) != '"' || doc_char(doc, k + 2) != ':') {
+                                return false;
+                        }
+                        key = k;
+                        k += 3;
+                }
+
+                switch (doc_char(doc, k)) {
+                case '\0':
+                case ',':
+                case ':':
+                case ']':
+                case '}':
+                        return false;
+                }
+
+                if (!f(w, key, k)) {
+                        return true;
+                }
+
+                k = doc->e[k].next;
+
+                if (doc_char(doc, k) == ',') {
+                        k += 1;
+                } else if (doc_char(doc, k) != close) {
+                        return false;
+                }
+        }
+
+        return true;
+}
+
+static bool
+walk_count(JsonWalk *w, i64 key, u32 value)
+{
+        w->index += 1;
+        return true;
+}
+
+static bool
+walk_member(JsonWalk *w, i64 key, u32 value)
+{
+        if (doc_key_eq(w->ty, w->doc, key, w->key, w->n)) {
+                w->found = value;
+                return false;
+        }
+
+        return true;
+}
+
+static bool
+walk_element(JsonWalk *w, i64 key, u32 value)
+{
+        if (w->index-- == 0) {
+                w->found = value;
+                return false;
+        }
+
+        return true;
+}
+
+static bool
+walk_collect(JsonWalk *w, i64 key, u32 value)
+{
+        Ty *ty = w->ty;
+
+        if (key < 0) {
+                vAp(w->out->array, INTEGER(value));
+                return true;
+        }
+
+        Value k = doc_key(ty, w->doc, key);
+
+        if (k.type == VALUE_NIL) {
+                return false;
+        }
+
+        gP(&k);
+        Value pair = vT(2);
+        pair.items[0] = k;
+        pair.items[1] = INTEGER(value);
+        gX();
+
+        gP(&pair);
+        vAp(w->out->array, pair);
+        gX();
+
+        return true;
+}
+
+static i64
+doc_count(JsonDoc const *doc, i64 at)
+{
+        JsonWalk w = { .index = 0 };
+
+        switch (doc_char(doc, at)) {
+        case '{':
+        case '[':
+                return doc_each(doc, at, walk_count, &w) ? w.index : -1;
+        }
+
+        return -1;
+}
+
+static i64
+doc_member(Ty *ty, JsonDoc const *doc, i64 at, char const *key, usize n)
+{
+        JsonWalk w = { .ty = ty, .doc = doc, .key = key, .n = n, .found = -1 };
+
+        if (doc_char(doc, at) != '{' || !doc_each(doc, at, walk_member, &w)) {
+                return -1;
+        }
+
+        return w.found;
+}
+
+static i64
+doc_element(JsonDoc const *doc, i64 at, i64 i)
+{
+        JsonWalk w = { .found = -1 };
+
+        if (doc_char(doc, at) != '[') {
+                return -1;
+        }
+
+        if (i < 0) {
+                i += doc_count(doc, at);
+        }
+
+        if (i < 0) {
+                return -1;
+        }
+
+        w.index = i;
+
+        if (!doc_each(doc, at, walk_element, &w)) {
+                return -1;
+        }
+
+        return w.found;
+}
+
+#define OPEN_DOC(doc)                                                   \
+        do {                                                            \
+                if (!doc_open(ty, src, index, at, &(doc))) {            \
+                        zP("json: bad lazy document reference");        \
+                }                                                       \
+        } while (0)
+
+Value
+json_lazy_child(Ty *ty, Value const *src, Value const *index, imax at, Value const *key)
+{
+        JsonDoc doc;
+        i64 child;
+
+        OPEN_DOC(doc);
+
+        switch (key->type) {
+        case VALUE_STRING:
+                child = doc_member(ty, &doc, at, (char const *)ss(*key), sN(*key));
+                break;
+
+        case VALUE_INTEGER:
+                child = doc_element(&doc, at, key->z);
+                break;
+
+        default:
+                zP("json: bad key: %s", VSC(key));
+        }
+
+        return (child < 0) ? NIL : INTEGER(child);
+}
+
+/*
+ * Follows a path like a.b[3].c or ["some key"][-1] from `at`.
+ */
+Value
+json_lazy_path(Ty *ty, Value const *src, Value const *index, imax at, char const *path, usize n)
+{
+        JsonDoc doc;
+        char const *p = path;
+        char const *end = path + n;
+        i64 cur = at;
+
+        OPEN_DOC(doc);
+
+        while (p < end && cur >= 0) {
+                if (*p == '.') {
+                        p += 1;
+                } else if (*p != '[') {
+                        char const *name = p;
+                        while (p < end && *p != '.' && *p != '[') {
+                                p += 1;
+                        }
+                        cur = doc_member(ty, &doc, cur, name, p - name);
+                } else if (p + 1 < end && (p[1] == '"' || p[1] == '\'')) {
+                        char q = p[1];
+                        char const *name = p + 2;
+                        char const *stop = memchr(name, q, end - name);
+                        if (stop == NULL || stop + 1 == end || stop[1] != ']') {
+                                goto Bad;
+                        }
+                        cur = doc_member(ty, &doc, cur, name, stop - name);
+                        p = stop + 2;
+                } else {
+                        // The path isn't NUL-terminated, so no strtoll()
+                        char const *digit = p + 1;
+                        bool neg = (digit < end && *digit == '-');
+                        u64 i = 0;
+                        digit += neg;
+                        if (digit == end || !isdigit((u8)*digit)) {
+                                goto Bad;
+                        }
+                        while (digit < end && isdigit((u8)*digit)) {
+                                if (i > (INT64_MAX - (*digit - '0')) / 10) {
+                                        goto Bad;
+                                }
+                                i = 10 * i + (*digit++ - '0');
+                        }
+                        if (digit == end || *digit != ']') {
+                                goto Bad;
+                        }
+                        cur = doc_element(&doc, cur, neg ? -(i64)i : (i64)i);
+                        p = digit + 1;
+                }
+        }
+
+        return (cur < 0) ? NIL : INTEGER(cur);
+
+Bad:
+        zP("json: bad path: %.*s", (int)n, path);
+}
+
+Value
+json_lazy_kind(Ty *ty, Value const *src, Value const *index, imax at)
+{
+        JsonDoc doc;
+
+        OPEN_DOC(doc);
+
+        switch (doc_char(&doc, at)) {
+        case '{':           return xSz("object");
+        case '[':           return xSz("array");
+        case '"':           return xSz("string");
+        case 't': case 'f': return xSz("boolean");
+        case 'n':           return xSz("null");
+        default:            return xSz("number");
+        }
+}
+
+Value
+json_lazy_count(Ty *ty, Value const *src, Value const *index, imax at)
+{
+        JsonDoc doc;
+
+        OPEN_DOC(doc);
+
+        i64 n = doc_count(&doc, at);
+
+        return (n < 0) ? NIL : INTEGER(n);
+}
+
+/*
+ * Positions of the elements of an array, or (key, position) pairs for the
+ * members of an object.
+ */
+Value
+json_lazy_children(Ty *ty, Value const *src, Value const *index, imax at)
+{
+        JsonDoc doc;
+
+        OPEN_DOC(doc);
+
+        switch (doc_char(&doc, at)) {
+        case '{':
+        case '[':
+                break;
+
+        default:
+                return NIL;
+        }
+
+        Value out = ARRAY(vA());
+        JsonWalk w = { .ty = ty, .doc = &doc, .out = &out };
+
+        gP(&out);
+        bool ok = doc_each(&doc, at, walk_collect, &w);
+        gX();
+
+        return ok ? out : NIL;
+}
+
+Value
+json_lazy_value(Ty *ty, Value const *src, Value const *index, imax at, bool records)
+{
+        JsonDoc doc;
+
+        OPEN_DOC(doc);
+
+        u32 start = doc.e[at].off;
+        u32 next = doc.e[at].next;
+        u32 end;
+
+        switch (doc_char(&doc, at)) {
+        case '{':
+        case '[':
+        case '"':
+                /* Up to and including the closing bracket or quote */
+                end = doc.e[next - 1].off + 1;
+                break;
+
+        default:
+                end = doc.e[next].off;
+        }
+
+        return records
+             ? json_parse_xD(ty, doc.s + start, end - start)
+             : json_parse(ty, doc.s + start, end - start);
+}
+
+#undef OPEN_DOC
+
+/*
+ * Incremental parsing.
+ *
+ * json_feed() looks for complete values at the front of buf, parses each one
+ * on its own, and drops the bytes it has consumed. A value that hasn't been
+ * completely received yet stays at the front of the buffer, and the scanner's
+ * progress through it is kept in *state so that bytes are only looked at once
+ * no matter how the input is chunked. The input is either a sequence of values
+ * separated by whitespace (which covers NDJSON), or a single top-level array,
+ * in which case its elements are produced one by one.
+ *
+ * Only one value is ever parsed at a time, and the GC runs between values, so
+ * memory use is bounded by the largest value rather than the whole input.
+ */
+
+enum {
+        JF_STRING = 1 << 0,  /* inside a string */
+        JF_ESCAPE = 1 << 1,  /* previous byte was an unescaped backslash */
+        JF_SCALAR = 1 << 2,  /* inside a bare top-level scalar */
+        JF_VALUE  = 1 << 3,  /* a value starts at buf[0] */
+        JF_OPEN   = 1 << 4,  /* seen the first non-space byte */
+        JF_ARRAY  = 1 << 5,  /* producing the elements of a top-level array */
+        JF_SEP    = 1 << 6,  /* array mode: expecting ',' or ']' */
+        JF_DONE   = 1 << 7,  /* array mode: seen the closing ']' */
+        JF_COMMA  = 1 << 8   /* array mode: a ',' has to be followed by an element */
+};
+
+#define JF_FLAGS(s) ((u32)((s) & 0x1FF))
+#define JF_DEPTH(s) ((u32)(((s) >> 9) & 0xFFFF))
+#define JF_POS(s)   ((usize)((s) >> 25))
+#define JF_PACK(pos, depth, flags) (((imax)(pos) << 25) | ((imax)(depth) << 9) | (flags))
+
+#define JSON_FEED_MAX_DEPTH 0xFFFF
+
+static void
+feed_value(Ty *ty, Value *out, u8 const *s, usize n, JsonFeedOptions const *opts)
+{
+        if (n > opts->max_size) {
+                zP("json: value exceeds maximum size (%zu bytes)", opts->max_size);
+        }
+
+        Value v = opts->xd
+                ? json_parse_xD(ty, (char const *)s, n)
+                : json_parse(ty, (char const *)s, n);
+
+        if (v.type == VALUE_NIL && !(n == 4 && memcmp(s, "null", 4) == 0)) {
+                zP(
+                        "json: invalid value: %.*s%s",
+                        (int)min(n, 40),
+                        (char const *)s,
+                        (n > 40) ? "..." : ""
+                );
+        }
+
+        gP(&v);
+        vAp(out->array, v);
+        gX();
+
+        /* Everything parsed so far is reachable from out, so this is a good
+         * place to let the collector in. */
+        CheckUsed(ty);
+}
+
+Value
+json_feed(Ty *ty, Blob *buf, imax *state, JsonFeedOptions const *opts)
+{
+        u8 const *s = vv(*buf);
+        usize n = vN(*buf);
+
+        usize i = JF_POS(*state);
+        u32 depth = JF_DEPTH(*state);
+        u32 flags = JF_FLAGS(*state);
+        usize max_depth = min(opts->max_depth, JSON_FEED_MAX_DEPTH);
+
+        /* Start of the value being scanned, or of the unconsumed input */
+        usize start = (flags & JF_VALUE) ? 0 : i;
+
+        Value out = ARRAY(vA());
+        gP(&out);
+
+#define BEGIN()                                                                 \
+        do {                                                                    \
+                if (flags & JF_DONE)                                            \
+                        zP("json: unexpected data after top-level array");      \
+                if (flags & JF_SEP)                                             \
+                        zP("json: expected ',' or ']' between array elements"); \
+                flags = (flags | JF_VALUE) & ~JF_COMMA;                         \
+                start = i;                                                      \
+        } while (0)
+
+#define EMIT(end)                                                               \
+        do {                                                                    \
+                feed_value(ty, &out, s + start, (end) - start, opts);           \
+                flags &= ~JF_VALUE;                                             \
+                if (flags & JF_ARRAY)                                           \
+                        flags |= JF_SEP;                                        \
+                start = (end);                                                  \
+        } while (0)
+
+        while (i < n) {
+                if (flags & JF_STRING) {
+                        if (flags & JF_ESCAPE) {
+                                flags &= ~JF_ESCAPE;
+                                i += 1;
+                                continue;
+                        }
+
+                        while (i < n && s[i] != '"' && s[i] != '\\')
+                                i += 1;
+
+                        if (i == n)
+                                break;
+
+                        if (s[i++] == '\\') {
+                                flags |= JF_ESCAPE;
+                        } else {
+                                flags &= ~JF_STRING;
+                                if (depth == 0) {
+                                        EMIT(i);
+                                }
+                        }
+
+                        continue;
+                }
+
+                u8 c = s[i];
+
+                if (flags & JF_SCALAR) {
+                        if (strchr(" \t\r\n\f\v,[]{}\"", c) == NULL) {
+                                i += 1;
+                                continue;
+                        }
+                        flags &= ~JF_SCALAR;
+                        EMIT(i);
+                }
+
+                switch (c) {
+                case ' ': case '\t': case '\r': case '\n': case '\f': case '\v':
+                        break;
+
+                case '[':
+                        if (depth == 0 && !(flags & JF_OPEN)) {
+                                flags |= JF_OPEN;
+                                if (opts->array) {
+                                        flags |= JF_ARRAY;
+                                        start = i + 1;
+                                        break;
+                                }
+                        }
+                        /* fallthrough */
+                case '{':
+                        flags |= JF_OPEN;
+                        if (depth == 0)
+                                BEGIN();
+                        /* The outer array counts towards the depth too */
+                        if (++depth + !!(flags & JF_ARRAY) > max_depth)
+                                zP("json: maximum nesting depth (%zu) exceeded", max_depth);
+                        break;
+
+                case ']':
+                        if (depth == 0 && (flags & JF_ARRAY) && !(flags & JF_DONE)) {
+                                if (flags & JF_COMMA)
+                                        zP("json: trailing ',' in top-level array");
+                                flags = (flags | JF_DONE) & ~JF_SEP;
+                                start = i + 1;
+                                break;
+                        }
+                        /* fallthrough */
+                case '}':
+                        if (depth == 0)
+                                zP("json: unexpected '%c'", c);
+                        if (--depth == 0)
+                                EMIT(i + 1);
+                        break;
+
+                case ',':
+                        if (depth == 0) {
+                                if (!(flags & JF_SEP))
+                                        zP("json: unexpected ','");
+                                flags = (flags | JF_COMMA) & ~JF_SEP;
+                                start = i + 1;
+                        }
+                        break;
+
+                case '"':
+                        flags |= JF_OPEN;
+                        if (depth == 0)
+                                BEGIN();
+                        flags |= JF_STRING;
+                        break;
+
+                default:
+                        flags |= JF_OPEN;
+                        if (depth == 0) {
+                                BEGIN();
+                                flags |= JF_SCALAR;
+                        }
+                }
+
+                i += 1;
+
+                if (!(flags & JF_VALUE))
+                        start = i;
+        }
+
+        if ((flags & JF_VALUE) && i - start > opts->max_size) {
+                zP("json: value exceeds maximum size (%zu bytes)", opts->max_size);
+        }
+
+        if (opts->final) {
+                if (flags & JF_SCALAR) {
+                        flags &= ~JF_SCALAR;
+                        EMIT(n);
+                }
+                if (flags & JF_VALUE) {
+                        zP("json: unexpected end of input");
+                }
+                if ((flags & JF_ARRAY) && !(flags & JF_DONE)) {
+                        zP("json: unterminated top-level array");
+                }
+        }
+
+#undef BEGIN
+#undef EMIT
+
+        memmove(vv(*buf), vv(*buf) + start, n - start);
+        vN(*buf) -= start;
+
+        *state = JF_PACK(i - start, depth, flags);
+
+        gX();
+
+        return out;
+}
+
+Value
+json_encode(Ty *ty, Value const *v)
+{
+        str buf = {0};
+        Value r = NIL;
+        JsonSink *outer = Sink;
+
+        if (TY_CATCH_ERROR()) {
+                Sink = outer;
+                xvF(buf);
+                TY_RETHROW();
+        }
+
+        v0(Visiting);
+        Sink = NULL;
+
+        if (encode(ty, v, &buf)) {
+                r = vSs(vv(buf), vN(buf));
+        }
+
+        TY_CATCH_END();
+
+        Sink = outer;
+        xvF(buf);
+
+        return r;
+}
+
+imax
+json_write(Ty *ty, int fd, Blob *blob, Value const *v, JsonWriteOptions const *opts)
+{
+        JsonSink sink = { .fd = fd, .blob = blob, .opts = opts };
+        JsonSink *outer = Sink;
+
+        /* Reuse the buffer from the last call, unless it's already in use
+         * further up the stack (a __json__ method calling json.write()) */
+        str buf = WriteBuffer;
+        v00(WriteBuffer);
+        vN(buf) = 0;
+        xvR(buf, JSON_WRITE_CHUNK + 256);
+
+        /* A throwing __json__ method or a failed write unwinds through here,
+         * and mustn't leave Sink pointing into this frame */
+        if (TY_CATCH_ERROR()) {
+                Sink = outer;
+                xvF(buf);
+                TY_RETHROW();
+        }
+
+        v0(Visiting);
+        Sink = &sink;
+
+        bool ok = encode(ty, v, &buf);
+
+        if (ok) {
+                drain(ty, &buf, NULL, 0);
+        }
+
+        TY_CATCH_END();
+
+        Sink = outer;
+
+        if (WriteBuffer.items == NULL && vC(buf) <= 4 * JSON_WRITE_CHUNK) {
+                WriteBuffer = buf;
+        } else {
+                xvF(buf);
+        }
+
+        return ok ? (imax)sink.written : -1;
+}
+
+bool
+json_dump(Ty *ty, Value const  *v, byte_vector *out)
+{
+        JsonSink *outer = Sink;
+
+        usize start = vN(*out);
+
+        if (TY_CATCH_ERROR()) {
+                Sink = outer;
+                out->count = start;
+                TY_RETHROW();
+        }
+
+        Visiting.count = 0;
+        Sink = NULL;
+
+        bool ok = encode(ty, v, out);
+
+        TY_CATCH_END();
+
+        Sink = outer;
+
+        if (!ok) {
+                out->count = start;
+        }
+
+        return ok;
 }
@@ -169,22 +169,13 @@ mkregex(Ty *ty, char const *pat, int flags, bool detailed)
                 );
         }
 
-        err = pcre2_jit_compile(re, PCRE2_JIT_COMPLETE);
-        if (err < 0) {
-                pcre2_get_error_message(err, (u8 *)err_buf, sizeof err_buf);
-                error(
-                        ty,
-                        "error JIT-compiling regular expression: %s/%s/%s: %s",
-                        TERM(36),
-                        pat,
-                        TERM(39),
-                        err_buf
-                );
-        }
-
+        // JIT compilation waits until the regex is first matched against
+        // (see regex_code()): most regex literals in an imported module never
+        // are
         Regex *r = amA(sizeof *r);
         r->pattern = pat;
         r->pcre2 = re;
+        atomic_init(&r->jit, NULL);
         r->gc = false;
         r->detailed = detailed;
 
@@ -1286,9 +1277,68 @@ Begin:
         }
 }
 
+/*
+ * The parser backtracks by rewinding the lexer, and re-lexes tokens whenever
+ * it changes its mind about the context it wants them in. A token only depends
+ * on where in the source it starts, the context, and a few flags, so recently
+ * lexed tokens are remembered and replayed instead of being lexed again, which
+ * for regexes and interpolated strings is anything but cheap.
+ *
+ * Entries are tagged with a generation that's bumped whenever the lexer moves
+ * on to a new source, which forgets all of them at once.
+ */
+enum {
+        LEX_MEMO_SIZE = 1 << 10
+};
+
+typedef struct {
+        char const *s;
+        u32 gen;
+        i8 ctx;
+        bool in_pp;
+        bool need_nl;
+        bool blank_line;
+
+        Token token;
+        Location end;
+        bool need_nl_after;
+        bool blank_line_after;
+} LexMemo;
+
+static LexMemo Memo[LEX_MEMO_SIZE];
+static u32 MemoGen = 1;
+
+inline static LexMemo *
+MemoSlot(char const *s, int ctx)
+{
+        return &Memo[((uptr)s ^ ((uptr)ctx << 7)) & (LEX_MEMO_SIZE - 1)];
+}
+
+inline static bool
+MemoHit(LexMemo const *m, int ctx)
+{
+        return m->gen == MemoGen
+            && m->s == SRC
+            && m->ctx == ctx
+            && m->in_pp == state.in_pp
+            && m->need_nl == state.need_nl
+            && m->blank_line == state.blank_line;
+}
+
 Token
 lex_token(Ty *ty, LexContext ctx)
 {
+        LexMemo *m = MemoSlot(SRC, ctx);
+
+        if (MemoHit(m, ctx)) {
+                Start = m->token.start;
+                state.loc = m->end;
+                state.ctx = ctx;
+                state.need_nl = m->need_nl_after;
+                state.blank_line = m->blank_line_after;
+                return m->token;
+        }
+
         if (setjmp(jb) != 0) {
                 return (Token) {
                         .type  = TOKEN_ERROR,
@@ -1299,12 +1349,31 @@ lex_token(Ty *ty, LexContext ctx)
                 };
         }
 
-        return dotoken(ty, ctx);
+        LexMemo key = {
+                .s          = SRC,
+                .gen        = MemoGen,
+                .ctx        = ctx,
+                .in_pp      = state.in_pp,
+                .need_nl    = state.need_nl,
+                .blank_line = state.blank_line
+        };
+
+        Token t = dotoken(ty, ctx);
+
+        *m = key;
+        m->token = t;
+        m->end = state.loc;
+        m->need_nl_after = state.need_nl;
+        m->blank_line_after = state.blank_line;
+
+        return t;
 }
 
 void
 lex_init(Ty *ty, char const *file, char const *src)
 {
+        MemoGen += 1;
+
         lxst = &state;
         state = (LexState) {
                 .loc = (Location) {
@@ -1335,6 +1404,7 @@ lex_init(Ty *ty, char const *file, char const *src)
 void
 lex_start(Ty *ty, LexState const *st)
 {
+        MemoGen += 1;
         state = *st;
 }
 
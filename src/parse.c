@@ -7182,6 +7182,63 @@ Finally:
         return ok;
 }
 
+/*
+ * Parse the one top-level statement that starts at `where` in `source`.
+ *
+ * `tokens` holds the tokens that precede it, and the statement's own tokens
+ * (plus any lookahead past its end) are appended to it, so that the token
+ * indices in the new AST agree with the caller's token vector.
+ */
+Stmt *
+parse_at(
+        Ty *ty,
+        char const *source,
+        char const *file,
+        Location const *where,
+        TokenVector *tokens_io
+)
+{
+        lex_save(ty, &CtxCheckpoint);
+
+        ParserState save = state;
+        m0(state);
+
+        Stmt * volatile s = NULL;
+
+        lex_init(ty, file, source);
+        lex_rewind(ty, where);
+
+        tokens = *tokens_io;
+        TokenIndex = vN(tokens);
+
+        LastParsedExpr = NULL;
+
+        CompilerScopePush(ty);
+
+        if (TY_CATCH_ERROR()) {
+                (void)TY_CATCH();
+                s = NULL;
+                goto Finally;
+        }
+
+        setctx(LEX_PREFIX);
+
+        s = parse_statement(ty, -1);
+        s->end = TEnd;
+
+        TY_CATCH_END();
+
+Finally:
+        CompilerScopePop(ty);
+
+        *tokens_io = tokens;
+
+        state = save;
+        lex_restore(ty, &CtxCheckpoint);
+
+        return s;
+}
+
 Stmt **
 parse(Ty *ty, char const *source, char const *file)
 {
@@ -0,0 +1,2294 @@
+#include "ty.h"
+#include "vm.h"
+#include "ast.h"
+#include "compiler.h"
+#include "value.h"
+#include "xd.h"
+#include "gc.h"
+#include "sampler.h"
+
+#ifndef _WIN32
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+/*
+ * A sampling profiler that is always compiled in, and costs nothing until it's
+ * started.
+ *
+ * A timer on the process's CPU clock sends SIGPROF at the requested rate. The
+ * kernel only checks CPU timers on its own tick, so at high rates one signal
+ * can stand for several expirations; on Linux we're told how many, and weight
+ * the sample to match. The handler runs on whichever thread was busy, reads
+ * that thread's IP and the return addresses in its frame stack, and appends
+ * them to the thread's ring buffer. It never blocks and never allocates from
+ * the heap: rings are mapped on a thread's first sample and
+ * handed to the next thread when it exits, and each ring has exactly one
+ * writer (its thread, in the handler) and one reader (whoever is draining the
+ * rings, under ReportLock). A sample that doesn't fit is counted and dropped.
+ *
+ * Samples are only turned into source locations, through the same maps that
+ * are used for tracebacks, when a report is asked for.
+ *
+ * Only the frames of the running coroutine are recorded. Two kinds of
+ * pseudo-frame can sit on top of them: one for time spent collecting garbage,
+ * and one for JIT-compiled code, which we recognize by the machine PC in the
+ * signal context. Their "IPs" are addresses that bytecode can never have.
+ *
+ * Profiles can be exported as text, as folded stacks for flame graphs, and as
+ * pprof protobufs.
+ */
+
+enum {
+        SAMPLE_RING_WORDS = 1 << 16,
+        SAMPLE_MAX_DEPTH  = 64
+};
+
+typedef struct sample_ring SampleRing;
+
+struct sample_ring {
+        _Atomic(u64) head;
+        _Atomic(u64) tail;
+        atomic_bool owned;
+        SampleRing *next;
+        uptr words[SAMPLE_RING_WORDS];
+};
+
+typedef struct {
+        u64 hash;
+        u64 count;
+        u32 off;
+        u32 depth;
+        u32 tag;
+} SampleStack;
+
+typedef struct {
+        vec(SampleStack) stacks;
+        vec(uptr) ips;
+        u32 *index;
+        usize index_size;
+} StackTable;
+
+enum {
+        SITE_CODE,
+        SITE_JIT,
+        SITE_GC
+};
+
+typedef struct jit_code JitCode;
+
+struct jit_code {
+        uptr start;
+        uptr end;
+        Expr const *expr;
+        char const *name;
+        JitCode *next;
+};
+
+/*
+ * The JIT's code ranges sorted by address, for the signal handler to search.
+ * Every function compiled publishes a new table, and the handler may be
+ * reading the old one on another thread: tables that have been replaced wait
+ * on the retired list until no handler is inside FindJitCode().
+ */
+typedef struct jit_table JitTable;
+
+struct jit_table {
+        usize count;
+        JitTable *retired;
+        JitCode const *codes[];
+};
+
+typedef struct {
+        uptr ip;
+        Expr const *expr;
+        i32 func;
+        i32 line;
+} SampleSite;
+
+typedef struct {
+        u8 kind;
+        Expr const *func;
+        Module const *mod;
+        u32 line;
+        u64 self;
+        u64 total;
+        u64 seen;
+} SampleSum;
+
+typedef vec(SampleSite) SampleSiteVector;
+typedef vec(SampleSum)  SampleSumVector;
+
+static _Atomic(SampleRing *) Rings;
+static _Thread_local SampleRing *MyRing;
+static _Thread_local bool Exited;
+
+static atomic_bool Running;
+static _Atomic(u64) Dropped;
+static int Rate = SAMPLER_DEFAULT_HZ;
+static u64 StartTime;
+static bool Installed;
+
+static char GCFrame;
+static _Atomic(JitCode *) JitCodes;
+static _Atomic(JitTable *) JitRanges;
+static atomic_int JitReaders;
+static JitTable *JitRetired;
+static pthread_mutex_t JitLock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *PerfMap;
+static char const *OutPath;
+
+#ifdef __linux__
+static timer_t Timer;
+static bool HaveTimer;
+#endif
+
+static pthread_mutex_t ReportLock = PTHREAD_MUTEX_INITIALIZER;
+
+static StackTable CpuStacks;
+static u64 Total;
+
+static uptr
+MachinePC(void const *ctx)
+{
+        ucontext_t const *uc = ctx;
+
+#if defined(__linux__) && defined(__x86_64__)
+        return uc->uc_mcontext.gregs[REG_RIP];
+#elif defined(__linux__) && defined(__aarch64__)
+        return uc->uc_mcontext.pc;
+#elif defined(__APPLE__) && defined(__aarch64__)
+        return uc->uc_mcontext->__ss.__pc;
+#elif defined(__APPLE__) && defined(__x86_64__)
+        return uc->uc_mcontext->__ss.__rip;
+#else
+        return 0;
+#endif
+}
+
+static JitCode const *
+FindJitCode(uptr pc)
+{
+        JitCode const *found = NULL;
+
+        /*
+         * Both of these are seq_cst, as are the writer's store to JitRanges
+         * and its load of JitReaders: either it sees us here, or we see the
+         * table it just published.
+         */
+        atomic_fetch_add(&JitReaders, 1);
+
+        JitTable const *t = atomic_load(&JitRanges);
+
+        if (t != NULL) {
+                usize lo = 0;
+                usize hi = t->count;
+
+                // The last range starting at or before pc
+                while (lo < hi) {
+                        usize mid = lo + (hi - lo) / 2;
+                        if (t->codes[mid]->start <= pc) {
+                                lo = mid + 1;
+                        } else {
+                                hi = mid;
+                        }
+                }
+
+                if (lo > 0 && pc < t->codes[lo - 1]->end) {
+                        found = t->codes[lo - 1];
+                }
+        }
+
+        atomic_fetch_sub_explicit(&JitReaders, 1, memory_order_release);
+
+        return found;
+}
+
+// Publishes a table with code added to it. Called with JitLock held.
+static void
+AddJitRange(JitCode const *code)
+{
+        JitTable *old = atomic_load_explicit(&JitRanges, memory_order_relaxed);
+        usize n = (old == NULL) ? 0 : old->count;
+
+        JitTable *t = xmA(sizeof *t + (n + 1) * sizeof (JitCode const *));
+
+        usize i = 0;
+        for (; i < n && old->codes[i]->start < code->start; ++i) {
+                t->codes[i] = old->codes[i];
+        }
+
+        t->codes[i] = code;
+
+        if (n > i) {
+                memcpy(&t->codes[i + 1], &old->codes[i], (n - i) * sizeof (JitCode const *));
+        }
+
+        t->count = n + 1;
+        t->retired = NULL;
+
+        atomic_store(&JitRanges, t);
+
+        if (old != NULL) {
+                old->retired = JitRetired;
+                JitRetired = old;
+        }
+
+        if (atomic_load(&JitReaders) == 0) {
+                while (JitRetired != NULL) {
+                        JitTable *next = JitRetired->retired;
+                        xmF(JitRetired);
+                        JitRetired = next;
+                }
+        }
+}
+
+static SampleRing *
+ClaimRing(void)
+{
+        for (
+                SampleRing *ring = atomic_load_explicit(&Rings, memory_order_acquire);
+                ring != NULL;
+                ring = ring->next
+        ) {
+                bool owned = false;
+                if (atomic_compare_exchange_strong_explicit(
+                        &ring->owned,
+                        &owned,
+                        true,
+                        memory_order_acquire,
+                        memory_order_relaxed
+                )) {
+                        return ring;
+                }
+        }
+
+        SampleRing *ring = mmap(
+                NULL,
+                sizeof (SampleRing),
+                PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS,
+                -1,
+                0
+        );
+
+        if (ring == MAP_FAILED) {
+                return NULL;
+        }
+
+        atomic_init(&ring->owned, true);
+
+        SampleRing *next = atomic_load_explicit(&Rings, memory_order_relaxed);
+        do {
+                ring->next = next;
+        } while (!atomic_compare_exchange_weak_explicit(
+                &Rings,
+                &next,
+                ring,
+                memory_order_release,
+                memory_order_relaxed
+        ));
+
+        return ring;
+}
+
+static void
+OnSample(int sig, siginfo_t *info, void *ctx)
+{
+        int saved = errno;
+        Ty *ty = GetMyTy();
+
+#ifdef __linux__
+        uptr weight = 1 + max(info->si_overrun, 0);
+#else
+        uptr weight = 1;
+#endif
+
+        if (
+                (ty == NULL)
+             || (ty->st == NULL)
+             || (ty->group == NULL)
+             || Exited
+             || !atomic_load_explicit(&Running, memory_order_relaxed)
+        ) {
+                goto End;
+        }
+
+        SampleRing *ring = MyRing;
+        if (ring == NULL && (ring = MyRing = ClaimRing()) == NULL) {
+                atomic_fetch_add_explicit(&Dropped, 1, memory_order_relaxed);
+                goto End;
+        }
+
+        /*
+         * We may have interrupted a push onto the frame stack, but PushFrame()
+         * only counts a frame once it's filled in, and GrowFrameStack() only
+         * frees the old buffer once the new one is in place.
+         */
+        uptr stack[SAMPLE_MAX_DEPTH];
+        u32 n = 0;
+
+        JitCode const *code;
+
+        if (atomic_load_explicit(&ty->group->WantGC, memory_order_relaxed)) {
+                stack[n++] = (uptr)&GCFrame;
+        } else if (
+                (atomic_load_explicit(&JitRanges, memory_order_relaxed) != NULL)
+             && (code = FindJitCode(MachinePC(ctx))) != NULL
+        ) {
+                stack[n++] = (uptr)code;
+        }
+
+        if (ty->ip != NULL) {
+                stack[n++] = (uptr)ty->ip;
+        }
+
+        Frame const *frames = vv(ty->st->frames);
+        for (usize i = vN(ty->st->frames); i > 0 && n < SAMPLE_MAX_DEPTH; --i) {
+                if (frames[i - 1].ip != NULL) {
+                        stack[n++] = (uptr)frames[i - 1].ip;
+                }
+        }
+
+        if (n == 0) {
+                goto End;
+        }
+
+        u64 head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        u64 tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+        if (SAMPLE_RING_WORDS - (head - tail) < n + 2) {
+                atomic_fetch_add_explicit(&Dropped, 1, memory_order_relaxed);
+                goto End;
+        }
+
+        ring->words[head++ & (SAMPLE_RING_WORDS - 1)] = n;
+        ring->words[head++ & (SAMPLE_RING_WORDS - 1)] = weight;
+        for (u32 i = 0; i < n; ++i) {
+                ring->words[head++ & (SAMPLE_RING_WORDS - 1)] = stack[i];
+        }
+
+        atomic_store_explicit(&ring->head, head, memory_order_release);
+
+End:
+        errno = saved;
+}
+
+static void
+GrowStackIndex(StackTable *t)
+{
+        usize size = (t->index_size == 0) ? 1024 : 2 * t->index_size;
+        u32 *index = xmA(size * sizeof *index);
+
+        memset(index, 0xFF, size * sizeof *index);
+
+        for (u32 i = 0; i < vN(t->stacks); ++i) {
+                usize slot = v_(t->stacks, i)->hash & (size - 1);
+                while (index[slot] != UINT32_MAX) {
+                        slot = (slot + 1) & (size - 1);
+                }
+                index[slot] = i;
+        }
+
+        xmF(t->index);
+        t->index = index;
+        t->index_size = size;
+}
+
+// The index of the stack (ips, tag) in t, which is added with a count of 0 if it's new
+static u32
+InternStack(StackTable *t, uptr const *ips, u32 n, u32 tag)
+{
+        if (2 * (vN(t->stacks) + 1) > t->index_size) {
+                GrowStackIndex(t);
+        }
+
+        u64 hash = XXH3_64bits(ips, n * sizeof *ips) ^ (tag * 0x9E3779B97F4A7C15ULL);
+        usize slot = hash & (t->index_size - 1);
+
+        while (t->index[slot] != UINT32_MAX) {
+                SampleStack *s = v_(t->stacks, t->index[slot]);
+                if (
+                        (s->hash == hash)
+                     && (s->depth == n)
+                     && (s->tag == tag)
+                     && memcmp(v_(t->ips, s->off), ips, n * sizeof *ips) == 0
+                ) {
+                        return t->index[slot];
+                }
+                slot = (slot + 1) & (t->index_size - 1);
+        }
+
+        t->index[slot] = vN(t->stacks);
+
+        xvP(
+                t->stacks,
+                ((SampleStack) {
+                        .hash  = hash,
+                        .off   = vN(t->ips),
+                        .depth = n,
+                        .tag   = tag
+                })
+        );
+
+        xvPn(t->ips, ips, n);
+
+        return vN(t->stacks) - 1;
+}
+
+static void
+ClearStacks(StackTable *t)
+{
+        v0(t->stacks);
+        v0(t->ips);
+
+        if (t->index != NULL) {
+                memset(t->index, 0xFF, t->index_size * sizeof *t->index);
+        }
+}
+
+// Moves everything out of the rings and into CpuStacks. Caller holds ReportLock.
+static void
+Drain(void)
+{
+        uptr stack[SAMPLE_MAX_DEPTH];
+
+        for (
+                SampleRing *ring = atomic_load_explicit(&Rings, memory_order_acquire);
+                ring != NULL;
+                ring = ring->next
+        ) {
+                u64 head = atomic_load_explicit(&ring->head, memory_order_acquire);
+                u64 tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+                while (tail < head) {
+                        u32 n = ring->words[tail++ & (SAMPLE_RING_WORDS - 1)];
+                        u64 weight = ring->words[tail++ & (SAMPLE_RING_WORDS - 1)];
+                        for (u32 i = 0; i < n; ++i) {
+                                stack[i] = ring->words[tail++ & (SAMPLE_RING_WORDS - 1)];
+                        }
+                        u32 k = InternStack(&CpuStacks, stack, n, 0);
+                        v_(CpuStacks.stacks, k)->count += weight;
+                        Total += weight;
+                }
+
+                atomic_store_explicit(&ring->tail, tail, memory_order_release);
+        }
+}
+
+static int
+CompareSites(void const *a, void const *b)
+{
+        uptr x = ((SampleSite const *)a)->ip;
+        uptr y = ((SampleSite const *)b)->ip;
+
+        return (x > y) - (x < y);
+}
+
+static SampleSite const *
+FindSite(SampleSiteVector const *sites, uptr ip)
+{
+        return bsearch(
+                &(SampleSite) { .ip = ip },
+                vv(*sites),
+                vN(*sites),
+                sizeof (SampleSite),
+                CompareSites
+        );
+}
+
+static i32
+SumFor(SampleSumVector *sums, u8 kind, Expr const *func, Module const *mod, u32 line)
+{
+        for (i32 i = 0; i < vN(*sums); ++i) {
+                SampleSum const *sum = v_(*sums, i);
+                if (
+                        (sum->kind == kind)
+                     && (sum->func == func)
+                     && (sum->mod == mod)
+                     && (sum->line == line)
+                ) {
+                        return i;
+                }
+        }
+
+        xvP(
+                *sums,
+                ((SampleSum) {
+                        .kind = kind,
+                        .func = func,
+                        .mod  = mod,
+                        .line = line,
+                        .seen = UINT64_MAX
+                })
+        );
+
+        return vN(*sums) - 1;
+}
+
+// Whether a sampled "IP" is really one of our JitCode entries
+static JitCode const *
+IsJitCode(uptr ip)
+{
+        for (
+                JitCode const *code = atomic_load_explicit(&JitCodes, memory_order_acquire);
+                code != NULL;
+                code = code->next
+        ) {
+                if (ip == (uptr)code) {
+                        return code;
+                }
+        }
+
+        return NULL;
+}
+
+/*
+ * The function an IP is in. A function's prologue belongs to the expression
+ * that defines it, which is in the enclosing function, so go by the code
+ * ranges first.
+ */
+static Expr const *
+SiteFunc(Ty *ty, uptr ip, Expr const *e)
+{
+        Expr const *func = compiler_find_func(ty, (char const *)ip - 1);
+        return (func != NULL) ? func : e->xfunc;
+}
+
+/*
+ * Resolves every distinct IP in t to the expression it belongs to, and
+ * numbers the distinct functions and lines they fall in. Return addresses
+ * point just past the call, hence ip - 1.
+ */
+static void
+Resolve(
+        Ty *ty,
+        StackTable const *t,
+        SampleSiteVector *sites,
+        SampleSumVector *funcs,
+        SampleSumVector *lines
+)
+{
+        for (usize i = 0; i < vN(t->ips); ++i) {
+                xvP(*sites, ((SampleSite) { .ip = v__(t->ips, i) }));
+        }
+
+        qsort(vv(*sites), vN(*sites), sizeof (SampleSite), CompareSites);
+
+        usize n = 0;
+        for (usize i = 0; i < vN(*sites); ++i) {
+                if (n == 0 || v_(*sites, n - 1)->ip != v_(*sites, i)->ip) {
+                        *v_(*sites, n++) = v__(*sites, i);
+                }
+        }
+
+        vN(*sites) = n;
+
+        for (usize i = 0; i < vN(*sites); ++i) {
+                SampleSite *site = v_(*sites, i);
+                JitCode const *code = IsJitCode(site->ip);
+
+                if (site->ip == (uptr)&GCFrame) {
+                        site->expr = NULL;
+                        site->func = SumFor(funcs, SITE_GC, NULL, NULL, 0);
+                        site->line = SumFor(lines, SITE_GC, NULL, NULL, 0);
+                        continue;
+                }
+
+                if (code != NULL) {
+                        Expr const *func = code->expr;
+                        Module const *mod = (func == NULL) ? NULL : func->mod;
+                        u32 line = (func == NULL) ? 0 : func->start.line + 1;
+                        site->expr = func;
+                        site->func = SumFor(funcs, SITE_JIT, func, mod, 0);
+                        site->line = SumFor(lines, SITE_JIT, func, mod, line);
+                        continue;
+                }
+
+                Expr const *e = compiler_find_expr(ty, (char const *)site->ip - 1);
+
+                if (e != NULL && e->origin != NULL) {
+                        e = e->origin;
+                }
+
+                site->expr = e;
+
+                if (e == NULL) {
+                        site->func = SumFor(funcs, SITE_CODE, NULL, NULL, 0);
+                        site->line = SumFor(lines, SITE_CODE, NULL, NULL, 0);
+                } else {
+                        Expr const *func = SiteFunc(ty, site->ip, e);
+                        site->func = SumFor(funcs, SITE_CODE, func, e->mod, 0);
+                        site->line = SumFor(lines, SITE_CODE, func, e->mod, e->start.line + 1);
+                }
+        }
+}
+
+static void
+FuncName(byte_vector *out, SampleSum const *sum)
+{
+        Expr const *func = sum->func;
+
+        if (sum->kind == SITE_GC) {
+                dump(out, "(Garbage Collection)");
+        } else if (sum->mod == NULL) {
+                dump(out, "(unknown)");
+        } else if (func == NULL) {
+                dump(out, "(top)");
+        } else if (func->name == NULL) {
+                dump(out, "(lambda)");
+        } else if (func->class != NULL) {
+                dump(out, "%s.%s", func->class->name, func->name);
+        } else {
+                dump(out, "%s", func->name);
+        }
+}
+
+static void
+FuncLocation(byte_vector *out, SampleSum const *sum)
+{
+        if (sum->mod == NULL) {
+                return;
+        }
+
+        if (sum->func == NULL) {
+                dump(out, "%s", sum->mod->path);
+        } else {
+                dump(out, "%s:%d", sum->mod->path, (int)sum->func->start.line + 1);
+        }
+}
+
+static int
+CompareSums(void const *a, void const *b)
+{
+        SampleSum const *x = a;
+        SampleSum const *y = b;
+
+        if (x->self != y->self) {
+                return (x->self < y->self) - (x->self > y->self);
+        }
+
+        return (x->total < y->total) - (x->total > y->total);
+}
+
+static void
+Count(SampleSumVector *funcs, SampleSumVector *lines, SampleSiteVector const *sites)
+{
+        for (u32 i = 0; i < vN(CpuStacks.stacks); ++i) {
+                SampleStack const *s = v_(CpuStacks.stacks, i);
+                uptr const *ips = v_(CpuStacks.ips, s->off);
+
+                for (u32 j = 0; j < s->depth; ++j) {
+                        SampleSite const *site = FindSite(sites, ips[j]);
+                        SampleSum *func = v_(*funcs, site->func);
+                        SampleSum *line = v_(*lines, site->line);
+
+                        if (j == 0) {
+                                func->self += s->count;
+                                line->self += s->count;
+                        }
+
+                        // Recursive calls only count once towards the total
+                        if (func->seen != i) {
+                                func->seen = i;
+                                func->total += s->count;
+                        }
+
+                        if (line->seen != i) {
+                                line->seen = i;
+                                line->total += s->count;
+                        }
+                }
+        }
+}
+
+inline static double
+Percent(u64 n, u64 d)
+{
+        return (d == 0) ? 0.0 : (100.0 * n / d);
+}
+
+// Sets the timer going at hz, or stops it if hz is 0
+static bool
+ArmTimer(int hz)
+{
+#ifdef __linux__
+        if (!HaveTimer) {
+                struct sigevent ev = {0};
+                ev.sigev_notify = SIGEV_SIGNAL;
+                ev.sigev_signo = SIGPROF;
+
+                if (timer_create(CLOCK_PROCESS_CPUTIME_ID, &ev, &Timer) != 0) {
+                        return false;
+                }
+
+                HaveTimer = true;
+        }
+
+        struct itimerspec spec = {0};
+
+        if (hz > 0) {
+                spec.it_interval.tv_nsec = 1000000000L / hz;
+                spec.it_value = spec.it_interval;
+        }
+
+        return timer_settime(Timer, 0, &spec, NULL) == 0;
+#else
+        struct itimerval timer = {0};
+
+        if (hz > 0) {
+                timer.it_interval.tv_usec = max(1000000 / hz, 1);
+                timer.it_value = timer.it_interval;
+        }
+
+        return setitimer(ITIMER_PROF, &timer, NULL) == 0;
+#endif
+}
+
+bool
+sampler_start(int hz)
+{
+        if (hz <= 0 || hz > 1000000) {
+                return false;
+        }
+
+        pthread_mutex_lock(&ReportLock);
+
+        if (atomic_load(&Running)) {
+                pthread_mutex_unlock(&ReportLock);
+                return false;
+        }
+
+        /*
+         * The handler stays installed once we've installed it: a SIGPROF that
+         * was already on its way when the timer was stopped would otherwise
+         * kill the process.
+         */
+        if (!Installed) {
+                struct sigaction act = {0};
+                act.sa_sigaction = OnSample;
+                act.sa_flags = SA_SIGINFO | SA_RESTART;
+                sigemptyset(&act.sa_mask);
+
+                if (sigaction(SIGPROF, &act, NULL) != 0) {
+                        pthread_mutex_unlock(&ReportLock);
+                        return false;
+                }
+
+                Installed = true;
+        }
+
+        Rate = hz;
+        atomic_store(&Running, true);
+
+        if (Total == 0) {
+                struct timespec now;
+                clock_gettime(CLOCK_REALTIME, &now);
+                StartTime = (u64)now.tv_sec * 1000000000ULL + now.tv_nsec;
+        }
+
+        if (!ArmTimer(hz)) {
+                atomic_store(&Running, false);
+                pthread_mutex_unlock(&ReportLock);
+                return false;
+        }
+
+        pthread_mutex_unlock(&ReportLock);
+
+        return true;
+}
+
+bool
+sampler_stop(void)
+{
+        pthread_mutex_lock(&ReportLock);
+
+        bool running = atomic_load(&Running);
+
+        if (running) {
+                ArmTimer(0);
+                atomic_store(&Running, false);
+                Drain();
+        }
+
+        pthread_mutex_unlock(&ReportLock);
+
+        return running;
+}
+
+bool
+sampler_running(void)
+{
+        return atomic_load(&Running);
+}
+
+void
+sampler_reset(void)
+{
+        pthread_mutex_lock(&ReportLock);
+
+        Drain();
+
+        ClearStacks(&CpuStacks);
+        Total = 0;
+        atomic_store(&Dropped, 0);
+
+        pthread_mutex_unlock(&ReportLock);
+}
+
+void
+sampler_thread_exit(void)
+{
+        Exited = true;
+        atomic_signal_fence(memory_order_seq_cst);
+
+        if (MyRing != NULL) {
+                atomic_store_explicit(&MyRing->owned, false, memory_order_release);
+                MyRing = NULL;
+        }
+}
+
+void
+sampler_report(Ty *ty, byte_vector *out)
+{
+        pthread_mutex_lock(&ReportLock);
+
+        Drain();
+
+        SampleSiteVector sites = {0};
+        SampleSumVector funcs = {0};
+        SampleSumVector lines = {0};
+
+        Resolve(ty, &CpuStacks, &sites, &funcs, &lines);
+        Count(&funcs, &lines, &sites);
+
+        qsort(vv(funcs), vN(funcs), sizeof (SampleSum), CompareSums);
+        qsort(vv(lines), vN(lines), sizeof (SampleSum), CompareSums);
+
+        dump(
+                out,
+                "%"PRIu64" samples at %d Hz (%.2fs of CPU time), %"PRIu64" dropped\n",
+                Total,
+                Rate,
+                (double)Total / Rate,
+                atomic_load(&Dropped)
+        );
+
+        dump(out, "\n%8s %7s %8s %7s  %s\n", "self", "self%", "total", "total%", "function");
+
+        byte_vector name = {0};
+
+        for (usize i = 0; i < vN(funcs) && i < 30; ++i) {
+                SampleSum const *f = v_(funcs, i);
+
+                v0(name);
+                FuncName(&name, f);
+                if (f->kind == SITE_JIT) {
+                        dump(&name, " [jit]");
+                }
+
+                dump(
+                        out,
+                        "%8"PRIu64" %6.1f%% %8"PRIu64" %6.1f%%  %-32s ",
+                        f->self,
+                        Percent(f->self, Total),
+                        f->total,
+                        Percent(f->total, Total),
+                        vv(name)
+                );
+
+                FuncLocation(out, f);
+                dump(out, "\n");
+        }
+
+        dump(out, "\n%8s %7s  %-32s %s\n", "self", "self%", "function", "line");
+
+        for (usize i = 0; i < vN(lines) && i < 30 && v_(lines, i)->self > 0; ++i) {
+                SampleSum const *l = v_(lines, i);
+
+                v0(name);
+                FuncName(&name, l);
+                if (l->kind == SITE_JIT) {
+                        dump(&name, " [jit]");
+                }
+
+                dump(
+                        out,
+                        "%8"PRIu64" %6.1f%%  %-32s ",
+                        l->self,
+                        Percent(l->self, Total),
+                        vv(name)
+                );
+
+                if (l->mod != NULL) {
+                        dump(out, "%s:%u", l->mod->path, l->line);
+                }
+
+                dump(out, "\n");
+        }
+
+        pthread_mutex_unlock(&ReportLock);
+
+        xvF(name);
+        xvF(sites);
+        xvF(funcs);
+        xvF(lines);
+}
+
+Value
+sampler_samples(Ty *ty)
+{
+        pthread_mutex_lock(&ReportLock);
+
+        Drain();
+
+        SampleSiteVector sites = {0};
+        SampleSumVector funcs = {0};
+        SampleSumVector lines = {0};
+
+        Resolve(ty, &CpuStacks, &sites, &funcs, &lines);
+
+        byte_vector name = {0};
+        Array *samples = vA();
+
+        GC_STOP();
+
+        for (u32 i = 0; i < vN(CpuStacks.stacks); ++i) {
+                SampleStack const *s = v_(CpuStacks.stacks, i);
+                uptr const *ips = v_(CpuStacks.ips, s->off);
+                Array *stack = vA();
+
+                // Outermost frame first
+                for (u32 j = s->depth; j > 0; --j) {
+                        SampleSite const *site = FindSite(&sites, ips[j - 1]);
+                        Expr const *e = site->expr;
+
+                        SampleSum const *func = v_(funcs, site->func);
+
+                        v0(name);
+                        FuncName(&name, func);
+
+                        vAp(
+                                stack,
+                                vTn(
+                                        "func", vSsz(vv(name)),
+                                        "file", (e == NULL) ? NIL : vSsz(e->mod->path),
+                                        "line", (e == NULL) ? NIL : INTEGER(e->start.line + 1),
+                                        "col",  (e == NULL) ? NIL : INTEGER(e->start.col + 1),
+                                        "jit",  BOOLEAN(func->kind == SITE_JIT)
+                                )
+                        );
+                }
+
+                vAp(samples, PAIR(INTEGER(s->count), ARRAY(stack)));
+        }
+
+        GC_RESUME();
+
+        pthread_mutex_unlock(&ReportLock);
+
+        xvF(name);
+        xvF(sites);
+        xvF(funcs);
+        xvF(lines);
+
+        return ARRAY(samples);
+}
+
+/*
+ * Folded stacks, one line per distinct stack of function names:
+ *
+ *      (top);main;parse;lex 1234
+ *
+ * which is what flamegraph.pl, inferno and speedscope all read. JIT-compiled
+ * frames get the "_[j]" suffix that perf's own stack collapser uses for them.
+ */
+typedef struct {
+        char *stack;
+        u64 count;
+} FoldedStack;
+
+static int
+CompareFolded(void const *a, void const *b)
+{
+        return strcmp(((FoldedStack const *)a)->stack, ((FoldedStack const *)b)->stack);
+}
+
+void
+sampler_folded(Ty *ty, byte_vector *out)
+{
+        pthread_mutex_lock(&ReportLock);
+
+        Drain();
+
+        SampleSiteVector sites = {0};
+        SampleSumVector funcs = {0};
+        SampleSumVector lines = {0};
+
+        Resolve(ty, &CpuStacks, &sites, &funcs, &lines);
+
+        vec(FoldedStack) folded = {0};
+        byte_vector line = {0};
+
+        for (u32 i = 0; i < vN(CpuStacks.stacks); ++i) {
+                SampleStack const *s = v_(CpuStacks.stacks, i);
+                uptr const *ips = v_(CpuStacks.ips, s->off);
+
+                v0(line);
+
+                for (u32 j = s->depth; j > 0; --j) {
+                        SampleSum const *func = v_(funcs, FindSite(&sites, ips[j - 1])->func);
+                        if (j != s->depth) {
+                                dump(&line, ";");
+                        }
+                        FuncName(&line, func);
+                        if (func->kind == SITE_JIT) {
+                                dump(&line, "_[j]");
+                        }
+                }
+
+                // Different IPs in the same functions fold into the same line
+                xvP(folded, ((FoldedStack) { .stack = S2(vv(line)), .count = s->count }));
+        }
+
+        pthread_mutex_unlock(&ReportLock);
+
+        qsort(vv(folded), vN(folded), sizeof (FoldedStack), CompareFolded);
+
+        for (usize i = 0; i < vN(folded);) {
+                FoldedStack const *f = v_(folded, i);
+                u64 count = 0;
+                usize j = i;
+
+                while (j < vN(folded) && strcmp(v_(folded, j)->stack, f->stack) == 0) {
+                        count += v_(folded, j)->count;
+                        j += 1;
+                }
+
+                dump(out, "%s %"PRIu64"\n", f->stack, count);
+
+                for (; i < j; ++i) {
+                        xmF(v_(folded, i)->stack);
+                }
+        }
+
+        xvF(folded);
+        xvF(line);
+        xvF(sites);
+        xvF(funcs);
+        xvF(lines);
+}
+
+/*
+ * pprof's profile.proto, uncompressed (pprof accepts it either way). We only
+ * need a handful of its fields, so the protobuf encoding is done by hand.
+ */
+enum {
+        PB_VARINT = 0,
+        PB_BYTES  = 2
+};
+
+static void
+PbVarint(byte_vector *out, u64 x)
+{
+        while (x >= 0x80) {
+                xvP(*out, (u8)(x | 0x80));
+                x >>= 7;
+        }
+
+        xvP(*out, (u8)x);
+}
+
+static void
+PbInt(byte_vector *out, u32 field, u64 x)
+{
+        PbVarint(out, ((u64)field << 3) | PB_VARINT);
+        PbVarint(out, x);
+}
+
+static void
+PbBytes(byte_vector *out, u32 field, void const *data, usize n)
+{
+        PbVarint(out, ((u64)field << 3) | PB_BYTES);
+        PbVarint(out, n);
+        xvPn(*out, (u8 const *)data, n);
+}
+
+static void
+PbMessage(byte_vector *out, u32 field, byte_vector *msg)
+{
+        PbBytes(out, field, vv(*msg), vN(*msg));
+        v0(*msg);
+}
+
+static u64
+PbString(StringVector *strings, char const *s)
+{
+        for (usize i = 0; i < vN(*strings); ++i) {
+                if (strcmp(v__(*strings, i), s) == 0) {
+                        return i;
+                }
+        }
+
+        xvP(*strings, S2(s));
+
+        return vN(*strings) - 1;
+}
+
+static void
+PbValueType(byte_vector *out, u32 field, StringVector *strings, char const *type, char const *unit)
+{
+        byte_vector msg = {0};
+
+        PbInt(&msg, 1, PbString(strings, type));
+        PbInt(&msg, 2, PbString(strings, unit));
+        PbMessage(out, field, &msg);
+
+        xvF(msg);
+}
+
+// Locations (one per site, IDs are indices into sites + 1) and functions
+static void
+PbLocations(
+        byte_vector *out,
+        StringVector *strings,
+        SampleSiteVector const *sites,
+        SampleSumVector const *funcs,
+        SampleSumVector const *lines
+)
+{
+        byte_vector msg = {0};
+        byte_vector sub = {0};
+        byte_vector name = {0};
+
+        for (usize i = 0; i < vN(*sites); ++i) {
+                SampleSite const *site = v_(*sites, i);
+                SampleSum const *line = v_(*lines, site->line);
+
+                PbInt(&msg, 1, i + 1);
+                PbInt(&msg, 3, site->ip);
+
+                PbInt(&sub, 1, site->func + 1);
+                PbInt(&sub, 2, line->line);
+                if (site->expr != NULL && line->kind == SITE_CODE) {
+                        PbInt(&sub, 3, site->expr->start.col + 1);
+                }
+                PbMessage(&msg, 4, &sub);
+
+                PbMessage(out, 4, &msg);
+        }
+
+        for (usize i = 0; i < vN(*funcs); ++i) {
+                SampleSum const *func = v_(*funcs, i);
+
+                v0(name);
+                FuncName(&name, func);
+                if (func->kind == SITE_JIT) {
+                        dump(&name, " [jit]");
+                }
+
+                PbInt(&msg, 1, i + 1);
+                PbInt(&msg, 2, PbString(strings, vv(name)));
+                PbInt(&msg, 3, PbString(strings, vv(name)));
+
+                if (func->mod != NULL) {
+                        PbInt(&msg, 4, PbString(strings, func->mod->path));
+                }
+
+                if (func->func != NULL) {
+                        PbInt(&msg, 5, func->func->start.line + 1);
+                }
+
+                PbMessage(out, 5, &msg);
+        }
+
+        xvF(msg);
+        xvF(sub);
+        xvF(name);
+}
+
+// The string table has to come after everything that interns into it
+static void
+PbStrings(byte_vector *out, StringVector *strings)
+{
+        for (usize i = 0; i < vN(*strings); ++i) {
+                char *str = v__(*strings, i);
+                PbBytes(out, 6, str, strlen(str));
+                xmF(str);
+        }
+
+        xvF(*strings);
+}
+
+void
+sampler_pprof(Ty *ty, byte_vector *out)
+{
+        pthread_mutex_lock(&ReportLock);
+
+        Drain();
+
+        SampleSiteVector sites = {0};
+        SampleSumVector funcs = {0};
+        SampleSumVector lines = {0};
+
+        Resolve(ty, &CpuStacks, &sites, &funcs, &lines);
+
+        StringVector strings = {0};
+        byte_vector msg = {0};
+        byte_vector sub = {0};
+
+        u64 period = 1000000000ULL / Rate;
+
+        xvP(strings, S2(""));
+
+        PbValueType(out, 1, &strings, "samples", "count");
+        PbValueType(out, 1, &strings, "cpu", "nanoseconds");
+
+        // Location IDs are site indices + 1, leaf first
+        for (u32 i = 0; i < vN(CpuStacks.stacks); ++i) {
+                SampleStack const *s = v_(CpuStacks.stacks, i);
+                uptr const *ips = v_(CpuStacks.ips, s->off);
+
+                for (u32 j = 0; j < s->depth; ++j) {
+                        PbVarint(&sub, FindSite(&sites, ips[j]) - vv(sites) + 1);
+                }
+
+                PbMessage(&msg, 1, &sub);
+
+                PbVarint(&sub, s->count);
+                PbVarint(&sub, s->count * period);
+                PbMessage(&msg, 2, &sub);
+
+                PbMessage(out, 2, &msg);
+        }
+
+        PbLocations(out, &strings, &sites, &funcs, &lines);
+
+        PbInt(out, 9, StartTime);
+        PbInt(out, 10, (u64)(Total * period));
+        PbValueType(out, 11, &strings, "cpu", "nanoseconds");
+        PbInt(out, 12, period);
+
+        PbStrings(out, &strings);
+
+        pthread_mutex_unlock(&ReportLock);
+
+        xvF(msg);
+        xvF(sub);
+        xvF(sites);
+        xvF(funcs);
+        xvF(lines);
+}
+
+/*
+ * Called by the JIT for every function it compiles, so that samples taken
+ * while it's running can be attributed to the right function, and so that
+ * perf can name the code too if it's been asked to.
+ */
+void
+sampler_jit_code(void const *code, usize size, Expr const *expr, char const *name)
+{
+        JitCode *node = xmA(sizeof *node);
+
+        node->start = (uptr)code;
+        node->end = (uptr)code + size;
+        node->expr = expr;
+        node->name = name;
+        node->next = atomic_load_explicit(&JitCodes, memory_order_relaxed);
+
+        while (!atomic_compare_exchange_weak_explicit(
+                &JitCodes,
+                &node->next,
+                node,
+                memory_order_release,
+                memory_order_relaxed
+        )) {
+                ;
+        }
+
+        pthread_mutex_lock(&JitLock);
+        AddJitRange(node);
+        pthread_mutex_unlock(&JitLock);
+
+        if (PerfMap != NULL) {
+                pthread_mutex_lock(&ReportLock);
+                fprintf(PerfMap, "%"PRIxPTR" %zx ty:%s\n", node->start, size, (name != NULL) ? name : "(anonymous)");
+                fflush(PerfMap);
+                pthread_mutex_unlock(&ReportLock);
+        }
+}
+
+/*
+ * Start writing /tmp/perf-<pid>.map, which is where perf(1) looks for symbols
+ * for code that it can't find in any mapped file.
+ */
+bool
+sampler_perf_map(void)
+{
+        char path[64];
+
+        pthread_mutex_lock(&ReportLock);
+
+        if (PerfMap == NULL) {
+                snprintf(path, sizeof path, "/tmp/perf-%d.map", (int)getpid());
+                PerfMap = fopen(path, "w");
+        }
+
+        if (PerfMap != NULL) {
+                for (
+                        JitCode const *code = atomic_load_explicit(&JitCodes, memory_order_acquire);
+                        code != NULL;
+                        code = code->next
+                ) {
+                        fprintf(
+                                PerfMap,
+                                "%"PRIxPTR" %"PRIxPTR" ty:%s\n",
+                                code->start,
+                                code->end - code->start,
+                                (code->name != NULL) ? code->name : "(anonymous)"
+                        );
+                }
+
+                fflush(PerfMap);
+        }
+
+        pthread_mutex_unlock(&ReportLock);
+
+        return PerfMap != NULL;
+}
+
+void
+sampler_set_output(char const *path)
+{
+        OutPath = path;
+}
+
+static bool
+EndsWith(char const *s, char const *suffix)
+{
+        usize n = strlen(s);
+        usize m = strlen(suffix);
+
+        return n >= m && strcmp(s + n - m, suffix) == 0;
+}
+
+static void
+WriteProfile(char const *path, byte_vector const *out)
+{
+        FILE *f = fopen(path, "wb");
+
+        if (f == NULL || fwrite(vv(*out), 1, vN(*out), f) != vN(*out)) {
+                fprintf(stderr, "ty: failed to write profile to %s: %s\n", path, strerror(errno));
+        }
+
+        if (f != NULL) {
+                fclose(f);
+        }
+}
+
+// atexit() hook for --sample
+void
+sampler_dump(void)
+{
+        Ty *ty = GetMyTy();
+        byte_vector out = {0};
+
+        sampler_stop();
+
+        if (OutPath == NULL) {
+                sampler_report(ty, &out);
+                fprintf(stderr, "%.*s", (int)vN(out), vv(out));
+                xvF(out);
+                return;
+        }
+
+        if (EndsWith(OutPath, ".pb") || EndsWith(OutPath, ".pprof")) {
+                sampler_pprof(ty, &out);
+        } else if (EndsWith(OutPath, ".folded")) {
+                sampler_folded(ty, &out);
+        } else {
+                sampler_report(ty, &out);
+        }
+
+        WriteProfile(OutPath, &out);
+
+        xvF(out);
+}
+
+/*
+ * The allocation profiler.
+ *
+ * Like tcmalloc's, it samples allocations rather than bytes: each thread
+ * counts down from a random number of bytes, exponentially distributed with
+ * mean HeapRate, and the allocation that takes it past zero is sampled. Big
+ * allocations are therefore almost always sampled and small ones rarely, and
+ * a sample of n bytes stands for 1 / (1 - exp(-n / HeapRate)) allocations
+ * like it. The countdown lives in Ty so that the check in gc_alloc() and
+ * friends is a subtraction and a branch; when the profiler isn't running,
+ * the slow path just pushes it HEAP_RECHECK bytes further out.
+ *
+ * A sampled allocation is remembered until it's freed, so that we can report
+ * what's still in use as well as what has been allocated in total. Frees only
+ * take HeapLock if the allocation might be one of ours, which HeapFilter
+ * (a counting filter over the addresses of live samples) decides.
+ */
+
+enum {
+        HEAP_RECHECK     = 1 << 16,
+        HEAP_FILTER_SIZE = 1 << 12
+};
+
+typedef struct {
+        double alloc_objects;
+        double alloc_bytes;
+        double inuse_objects;
+        double inuse_bytes;
+} HeapCount;
+
+typedef struct {
+        uptr key;
+        u32 stack;
+        u32 size;
+        double weight;
+} HeapLiveSample;
+
+_Atomic(usize) HeapSamplesLive;
+
+static atomic_bool HeapRunning;
+static _Atomic(isize) HeapRate = SAMPLER_HEAP_DEFAULT_RATE;
+static u64 HeapStartTime;
+static char const *HeapOutPath;
+
+static _Thread_local bool HeapArmed;
+static _Thread_local u64 HeapSeed;
+
+static pthread_mutex_t HeapLock = PTHREAD_MUTEX_INITIALIZER;
+
+static StackTable HeapStacks;
+static vec(HeapCount) HeapCounts;
+static u64 HeapSampled;
+
+static HeapLiveSample *HeapLive;
+static usize HeapLiveSize;
+static _Atomic(u8) HeapFilter[HEAP_FILTER_SIZE];
+
+static char const *HeapTypeNames[] = {
+        [GC_STRING]       = "String",
+        [GC_ARRAY]        = "Array",
+        [GC_TUPLE]        = "Tuple",
+        [GC_OBJECT]       = "Object",
+        [GC_DICT]         = "Dict",
+        [GC_BLOB]         = "Blob",
+        [GC_QUEUE]        = "Queue",
+        [GC_SHARED_QUEUE] = "SharedQueue",
+        [GC_VALUE]        = "Value",
+        [GC_ENV]          = "Env",
+        [GC_GENERATOR]    = "Generator",
+        [GC_THREAD]       = "Thread",
+        [GC_REGEX]        = "Regex",
+        [GC_ARENA]        = "Arena",
+        [GC_FUN_INFO]     = "FunInfo",
+        [GC_FFI_AUTO]     = "FFI",
+        [GC_ANY]          = "(untyped)"
+};
+
+static char const *
+HeapTypeName(u32 type)
+{
+        return (type < countof(HeapTypeNames) && HeapTypeNames[type] != NULL)
+             ? HeapTypeNames[type]
+             : "(unknown)";
+}
+
+inline static usize
+HeapFilterSlot(uptr key)
+{
+        return ((key >> 4) * 0x9E3779B97F4A7C15ULL) >> (64 - 12);
+}
+
+inline static usize
+HeapLiveSlot(uptr key, usize size)
+{
+        return ((key >> 4) * 0x9E3779B97F4A7C15ULL) & (size - 1);
+}
+
+static void
+GrowHeapLive(void)
+{
+        usize size = (HeapLiveSize == 0) ? 256 : 2 * HeapLiveSize;
+        HeapLiveSample *live = xmA(size * sizeof *live);
+
+        memset(live, 0, size * sizeof *live);
+
+        for (usize i = 0; i < HeapLiveSize; ++i) {
+                if (HeapLive[i].key != 0) {
+                        usize slot = HeapLiveSlot(HeapLive[i].key, size);
+                        while (live[slot].key != 0) {
+                                slot = (slot + 1) & (size - 1);
+                        }
+                        live[slot] = HeapLive[i];
+                }
+        }
+
+        xmF(HeapLive);
+        HeapLive = live;
+        HeapLiveSize = size;
+}
+
+// Caller holds HeapLock
+static void
+AddLive(HeapLiveSample sample)
+{
+        if (2 * (atomic_load(&HeapSamplesLive) + 1) > HeapLiveSize) {
+                GrowHeapLive();
+        }
+
+        usize slot = HeapLiveSlot(sample.key, HeapLiveSize);
+        while (HeapLive[slot].key != 0) {
+                slot = (slot + 1) & (HeapLiveSize - 1);
+        }
+
+        HeapLive[slot] = sample;
+
+        atomic_fetch_add_explicit(&HeapFilter[HeapFilterSlot(sample.key)], 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&HeapSamplesLive, 1, memory_order_relaxed);
+}
+
+// Caller holds HeapLock. Linear probing, so deletion shifts the cluster back.
+static bool
+TakeLive(uptr key, HeapLiveSample *sample)
+{
+        if (HeapLiveSize == 0) {
+                return false;
+        }
+
+        usize mask = HeapLiveSize - 1;
+        usize slot = HeapLiveSlot(key, HeapLiveSize);
+
+        while (HeapLive[slot].key != key) {
+                if (HeapLive[slot].key == 0) {
+                        return false;
+                }
+                slot = (slot + 1) & mask;
+        }
+
+        *sample = HeapLive[slot];
+
+        usize hole = slot;
+        for (usize i = (slot + 1) & mask; HeapLive[i].key != 0; i = (i + 1) & mask) {
+                usize home = HeapLiveSlot(HeapLive[i].key, HeapLiveSize);
+                if (((i - home) & mask) >= ((i - hole) & mask)) {
+                        HeapLive[hole] = HeapLive[i];
+                        hole = i;
+                }
+        }
+
+        HeapLive[hole].key = 0;
+
+        atomic_fetch_sub_explicit(&HeapFilter[HeapFilterSlot(key)], 1, memory_order_relaxed);
+        atomic_fetch_sub_explicit(&HeapSamplesLive, 1, memory_order_relaxed);
+
+        return true;
+}
+
+// Bytes until the next sample: exponentially distributed with mean rate
+static isize
+HeapInterval(isize rate)
+{
+        if (HeapSeed == 0) {
+                HeapSeed = (uptr)&HeapSeed ^ (u64)time(NULL);
+        }
+
+        // splitmix64, and 53 bits of it for a uniform double in (0, 1]
+        u64 z = (HeapSeed += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        z ^= z >> 31;
+
+        double u = ((z >> 11) + 1) * 0x1.0p-53;
+
+        return (isize)(-log(u) * rate) + 1;
+}
+
+void
+sampler_heap_alloc(Ty *ty, struct alloc const *a)
+{
+        if (!atomic_load_explicit(&HeapRunning, memory_order_relaxed)) {
+                HeapArmed = false;
+                ty->heap_sample_left = HEAP_RECHECK;
+                return;
+        }
+
+        isize rate = atomic_load_explicit(&HeapRate, memory_order_relaxed);
+
+        /*
+         * The first time through after the profiler starts, we only arrived
+         * here because HEAP_RECHECK ran out, which says nothing about this
+         * allocation in particular.
+         */
+        if (!HeapArmed) {
+                HeapArmed = true;
+                ty->heap_sample_left = HeapInterval(rate);
+                return;
+        }
+
+        ty->heap_sample_left = HeapInterval(rate);
+
+        if (ty->st == NULL || a->size == 0) {
+                return;
+        }
+
+        uptr stack[SAMPLE_MAX_DEPTH];
+        u32 n = 0;
+
+        if (ty->ip != NULL) {
+                stack[n++] = (uptr)ty->ip;
+        }
+
+        Frame const *frames = vv(ty->st->frames);
+        for (usize i = vN(ty->st->frames); i > 0 && n < SAMPLE_MAX_DEPTH; --i) {
+                if (frames[i - 1].ip != NULL) {
+                        stack[n++] = (uptr)frames[i - 1].ip;
+                }
+        }
+
+        if (n == 0) {
+                return;
+        }
+
+        double weight = 1.0 / (1.0 - exp(-(double)a->size / rate));
+
+        pthread_mutex_lock(&HeapLock);
+
+        u32 k = InternStack(&HeapStacks, stack, n, a->type);
+        while (vN(HeapCounts) <= k) {
+                xvP(HeapCounts, ((HeapCount) {0}));
+        }
+
+        HeapCount *count = v_(HeapCounts, k);
+        count->alloc_objects += weight;
+        count->alloc_bytes += weight * a->size;
+        count->inuse_objects += weight;
+        count->inuse_bytes += weight * a->size;
+
+        HeapSampled += 1;
+
+        AddLive((HeapLiveSample) {
+                .key    = (uptr)a,
+                .stack  = k,
+                .size   = a->size,
+                .weight = weight
+        });
+
+        pthread_mutex_unlock(&HeapLock);
+}
+
+void
+sampler_heap_free(struct alloc const *a)
+{
+        uptr key = (uptr)a;
+        HeapLiveSample sample;
+
+        if (atomic_load_explicit(&HeapFilter[HeapFilterSlot(key)], memory_order_relaxed) == 0) {
+                return;
+        }
+
+        pthread_mutex_lock(&HeapLock);
+
+        if (TakeLive(key, &sample)) {
+                HeapCount *count = v_(HeapCounts, sample.stack);
+                count->inuse_objects -= sample.weight;
+                count->inuse_bytes -= sample.weight * sample.size;
+        }
+
+        pthread_mutex_unlock(&HeapLock);
+}
+
+bool
+sampler_heap_start(isize rate)
+{
+        if (rate <= 0) {
+                return false;
+        }
+
+        pthread_mutex_lock(&HeapLock);
+
+        bool running = atomic_load(&HeapRunning);
+
+        if (!running) {
+                if (HeapSampled == 0) {
+                        struct timespec now;
+                        clock_gettime(CLOCK_REALTIME, &now);
+                        HeapStartTime = (u64)now.tv_sec * 1000000000ULL + now.tv_nsec;
+                }
+
+                atomic_store(&HeapRate, rate);
+                atomic_store(&HeapRunning, true);
+        }
+
+        pthread_mutex_unlock(&HeapLock);
+
+        // Other threads notice within HEAP_RECHECK bytes, but this one can start now
+        if (!running) {
+                GetMyTy()->heap_sample_left = 0;
+        }
+
+        return !running;
+}
+
+bool
+sampler_heap_stop(void)
+{
+        return atomic_exchange(&HeapRunning, false);
+}
+
+bool
+sampler_heap_running(void)
+{
+        return atomic_load(&HeapRunning);
+}
+
+void
+sampler_heap_reset(void)
+{
+        pthread_mutex_lock(&HeapLock);
+
+        ClearStacks(&HeapStacks);
+        v0(HeapCounts);
+        HeapSampled = 0;
+
+        if (HeapLive != NULL) {
+                memset(HeapLive, 0, HeapLiveSize * sizeof *HeapLive);
+        }
+
+        for (usize i = 0; i < HEAP_FILTER_SIZE; ++i) {
+                atomic_store_explicit(&HeapFilter[i], 0, memory_order_relaxed);
+        }
+
+        atomic_store(&HeapSamplesLive, 0);
+
+        pthread_mutex_unlock(&HeapLock);
+}
+
+typedef struct {
+        SampleSum const *where;
+        u32 type;
+        HeapCount count;
+} HeapSum;
+
+static int
+CompareInUse(void const *a, void const *b)
+{
+        HeapCount const *x = &((HeapSum const *)a)->count;
+        HeapCount const *y = &((HeapSum const *)b)->count;
+
+        if (x->inuse_bytes != y->inuse_bytes) {
+                return (x->inuse_bytes < y->inuse_bytes) - (x->inuse_bytes > y->inuse_bytes);
+        }
+
+        return (x->alloc_bytes < y->alloc_bytes) - (x->alloc_bytes > y->alloc_bytes);
+}
+
+static int
+CompareAllocated(void const *a, void const *b)
+{
+        HeapCount const *x = &((HeapSum const *)a)->count;
+        HeapCount const *y = &((HeapSum const *)b)->count;
+
+        if (x->alloc_bytes != y->alloc_bytes) {
+                return (x->alloc_bytes < y->alloc_bytes) - (x->alloc_bytes > y->alloc_bytes);
+        }
+
+        return (x->inuse_bytes < y->inuse_bytes) - (x->inuse_bytes > y->inuse_bytes);
+}
+
+static void
+HeapAdd(HeapCount *total, HeapCount const *count)
+{
+        total->alloc_objects += count->alloc_objects;
+        total->alloc_bytes += count->alloc_bytes;
+        total->inuse_objects += count->inuse_objects;
+        total->inuse_bytes += count->inuse_bytes;
+}
+
+static char const *
+HumanBytes(char *buf, usize n, double bytes)
+{
+        static char const *units[] = { "B", "KiB", "MiB", "GiB", "TiB" };
+        int unit = 0;
+
+        while (fabs(bytes) >= 1024.0 && unit + 1 < countof(units)) {
+                bytes /= 1024.0;
+                unit += 1;
+        }
+
+        snprintf(buf, n, (unit == 0) ? "%.0f %s" : "%.1f %s", bytes, units[unit]);
+
+        return buf;
+}
+
+// The top 20 lines by bytes in use (inuse) or by bytes allocated (!inuse)
+static void
+HeapLineTable(byte_vector *out, HeapSum *sums, usize n, HeapCount const *total, bool inuse)
+{
+        byte_vector name = {0};
+        char a[32];
+        char b[32];
+
+        qsort(sums, n, sizeof (HeapSum), inuse ? CompareInUse : CompareAllocated);
+
+        dump(
+                out,
+                "\n%12s %6s %12s %6s  %-32s %s\n",
+                inuse ? "in use" : "allocated",
+                "%",
+                inuse ? "allocated" : "in use",
+                "%",
+                "function",
+                "line"
+        );
+
+        for (usize i = 0; i < n && i < 20; ++i) {
+                HeapCount const *count = &sums[i].count;
+                SampleSum const *where = sums[i].where;
+
+                // In-use counts are sums of doubles, so "nothing" can come out a hair off 0
+                double first = inuse ? count->inuse_bytes : count->alloc_bytes;
+                double second = inuse ? count->alloc_bytes : count->inuse_bytes;
+
+                if (first < 0.5) {
+                        break;
+                }
+
+                v0(name);
+                FuncName(&name, where);
+
+                dump(
+                        out,
+                        "%12s %5.1f%% %12s %5.1f%%  %-32s ",
+                        HumanBytes(a, sizeof a, first),
+                        Percent(first, inuse ? total->inuse_bytes : total->alloc_bytes),
+                        HumanBytes(b, sizeof b, fmax(second, 0)),
+                        Percent(fmax(second, 0), inuse ? total->alloc_bytes : total->inuse_bytes),
+                        vv(name)
+                );
+
+                if (where->mod != NULL) {
+                        dump(out, "%s:%u", where->mod->path, where->line);
+                }
+
+                dump(out, "\n");
+        }
+
+        xvF(name);
+}
+
+void
+sampler_heap_report(Ty *ty, byte_vector *out)
+{
+        pthread_mutex_lock(&HeapLock);
+
+        SampleSiteVector sites = {0};
+        SampleSumVector funcs = {0};
+        SampleSumVector lines = {0};
+
+        Resolve(ty, &HeapStacks, &sites, &funcs, &lines);
+
+        vec(HeapSum) by_line = {0};
+        HeapSum by_type[GC_ANY + 1] = {0};
+        HeapCount total = {0};
+
+        for (usize i = 0; i < vN(lines); ++i) {
+                xvP(by_line, ((HeapSum) { .where = v_(lines, i) }));
+        }
+
+        // Allocations are charged to the line that made them, not its callers
+        for (u32 i = 0; i < vN(HeapStacks.stacks); ++i) {
+                SampleStack const *s = v_(HeapStacks.stacks, i);
+                SampleSite const *site = FindSite(&sites, v__(HeapStacks.ips, s->off));
+                HeapCount const *count = v_(HeapCounts, i);
+
+                HeapAdd(&v_(by_line, site->line)->count, count);
+
+                if (s->tag <= GC_ANY) {
+                        by_type[s->tag].type = s->tag;
+                        HeapAdd(&by_type[s->tag].count, count);
+                }
+
+                HeapAdd(&total, count);
+        }
+
+        qsort(by_type, countof(by_type), sizeof (HeapSum), CompareInUse);
+
+        char a[32];
+        char b[32];
+        char c[32];
+
+        dump(
+                out,
+                "%"PRIu64" samples, 1 per %s allocated\n"
+                "in use:    %s in %.0f objects\n"
+                "allocated: %s in %.0f objects\n",
+                HeapSampled,
+                HumanBytes(a, sizeof a, atomic_load(&HeapRate)),
+                HumanBytes(b, sizeof b, fmax(total.inuse_bytes, 0)),
+                fmax(total.inuse_objects, 0),
+                HumanBytes(c, sizeof c, total.alloc_bytes),
+                total.alloc_objects
+        );
+
+        HeapLineTable(out, vv(by_line), vN(by_line), &total, true);
+        HeapLineTable(out, vv(by_line), vN(by_line), &total, false);
+
+        dump(out, "\n%12s %6s %12s %6s  %s\n", "in use", "%", "allocated", "%", "type");
+
+        for (usize i = 0; i < countof(by_type) && by_type[i].count.alloc_bytes > 0; ++i) {
+                HeapSum const *t = &by_type[i];
+                dump(
+                        out,
+                        "%12s %5.1f%% %12s %5.1f%%  %s\n",
+                        HumanBytes(a, sizeof a, fmax(t->count.inuse_bytes, 0)),
+                        Percent(fmax(t->count.inuse_bytes, 0), total.inuse_bytes),
+                        HumanBytes(b, sizeof b, t->count.alloc_bytes),
+                        Percent(t->count.alloc_bytes, total.alloc_bytes),
+                        HeapTypeName(t->type)
+                );
+        }
+
+        pthread_mutex_unlock(&HeapLock);
+
+        xvF(by_line);
+        xvF(sites);
+        xvF(funcs);
+        xvF(lines);
+}
+
+// The same four sample types as Go's heap profiles, so pprof's -sample_index works the same way
+void
+sampler_heap_pprof(Ty *ty, byte_vector *out)
+{
+        pthread_mutex_lock(&HeapLock);
+
+        SampleSiteVector sites = {0};
+        SampleSumVector funcs = {0};
+        SampleSumVector lines = {0};
+
+        Resolve(ty, &HeapStacks, &sites, &funcs, &lines);
+
+        StringVector strings = {0};
+        byte_vector msg = {0};
+        byte_vector sub = {0};
+
+        xvP(strings, S2(""));
+
+        PbValueType(out, 1, &strings, "alloc_objects", "count");
+        PbValueType(out, 1, &strings, "alloc_space", "bytes");
+        PbValueType(out, 1, &strings, "inuse_objects", "count");
+        PbValueType(out, 1, &strings, "inuse_space", "bytes");
+
+        for (u32 i = 0; i < vN(HeapStacks.stacks); ++i) {
+                SampleStack const *s = v_(HeapStacks.stacks, i);
+                uptr const *ips = v_(HeapStacks.ips, s->off);
+                HeapCount const *count = v_(HeapCounts, i);
+
+                for (u32 j = 0; j < s->depth; ++j) {
+                        PbVarint(&sub, FindSite(&sites, ips[j]) - vv(sites) + 1);
+                }
+
+                PbMessage(&msg, 1, &sub);
+
+                PbVarint(&sub, llround(count->alloc_objects));
+                PbVarint(&sub, llround(count->alloc_bytes));
+                PbVarint(&sub, llround(fmax(count->inuse_objects, 0)));
+                PbVarint(&sub, llround(fmax(count->inuse_bytes, 0)));
+                PbMessage(&msg, 2, &sub);
+
+                // Label { key: "type", str: ... }
+                PbInt(&sub, 1, PbString(&strings, "type"));
+                PbInt(&sub, 2, PbString(&strings, HeapTypeName(s->tag)));
+                PbMessage(&msg, 3, &sub);
+
+                PbMessage(out, 2, &msg);
+        }
+
+        PbLocations(out, &strings, &sites, &funcs, &lines);
+
+        PbInt(out, 9, HeapStartTime);
+        PbValueType(out, 11, &strings, "space", "bytes");
+        PbInt(out, 12, atomic_load(&HeapRate));
+        PbInt(out, 14, PbString(&strings, "inuse_space"));
+
+        PbStrings(out, &strings);
+
+        pthread_mutex_unlock(&HeapLock);
+
+        xvF(msg);
+        xvF(sub);
+        xvF(sites);
+        xvF(funcs);
+        xvF(lines);
+}
+
+void
+sampler_heap_set_output(char const *path)
+{
+        HeapOutPath = path;
+}
+
+// atexit() hook for --heap-sample
+void
+sampler_heap_dump(void)
+{
+        Ty *ty = GetMyTy();
+        byte_vector out = {0};
+
+        sampler_heap_stop();
+
+        if (HeapOutPath == NULL) {
+                sampler_heap_report(ty, &out);
+                fprintf(stderr, "%.*s", (int)vN(out), vv(out));
+        } else {
+                if (EndsWith(HeapOutPath, ".pb") || EndsWith(HeapOutPath, ".pprof")) {
+                        sampler_heap_pprof(ty, &out);
+                } else {
+                        sampler_heap_report(ty, &out);
+                }
+                WriteProfile(HeapOutPath, &out);
+        }
+
+        xvF(out);
+}
+
+
+/*
+ * Hardware counters, for benchmarks: retired instructions, cycles, and cache
+ * misses, counted in user space for this thread and any threads it starts
+ * afterwards. They're opened on first use, and keep counting from then on;
+ * callers are expected to look at differences between two readings.
+ *
+ * perf_event_open() is often unavailable (containers, perf_event_paranoid, not
+ * Linux), and any one counter may be missing on a given machine, so each
+ * reading is -1 when we couldn't get it.
+ */
+#ifdef __linux__
+static u64 const CounterConfigs[SAMPLER_COUNTERS] = {
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_CACHE_MISSES
+};
+
+static int CounterFds[SAMPLER_COUNTERS];
+static bool CountersOpened;
+static pthread_mutex_t CounterLock = PTHREAD_MUTEX_INITIALIZER;
+
+static void
+OpenCounters(void)
+{
+        for (int i = 0; i < SAMPLER_COUNTERS; ++i) {
+                struct perf_event_attr attr = {
+                        .type           = PERF_TYPE_HARDWARE,
+                        .size           = sizeof attr,
+                        .config         = CounterConfigs[i],
+                        .read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING,
+                        .inherit        = 1,
+                        .exclude_kernel = 1,
+                        .exclude_hv     = 1
+                };
+
+                CounterFds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+        }
+
+        CountersOpened = true;
+}
+
+bool
+sampler_counters(i64 *out)
+{
+        bool any = false;
+
+        pthread_mutex_lock(&CounterLock);
+
+        if (!CountersOpened) {
+                OpenCounters();
+        }
+
+        for (int i = 0; i < SAMPLER_COUNTERS; ++i) {
+                // value, time enabled, time running
+                u64 buf[3];
+
+                out[i] = -1;
+
+                if (CounterFds[i] < 0 || read(CounterFds[i], buf, sizeof buf) != sizeof buf) {
+                        continue;
+                }
+
+                // The kernel multiplexes counters when there are more of them
+                // than hardware to count them with: scale up to make up for it
+                if (buf[2] > 0) {
+                        out[i] = (i64)((double)buf[0] * buf[1] / buf[2]);
+                        any = true;
+                }
+        }
+
+        pthread_mutex_unlock(&CounterLock);
+
+        return any;
+}
+#else
+bool
+sampler_counters(i64 *out)
+{
+        return false;
+}
+#endif
+
+#else
+
+bool
+sampler_start(int hz)
+{
+        return false;
+}
+
+bool
+sampler_stop(void)
+{
+        return false;
+}
+
+bool
+sampler_running(void)
+{
+        return false;
+}
+
+void
+sampler_reset(void)
+{
+}
+
+void
+sampler_thread_exit(void)
+{
+}
+
+void
+sampler_report(Ty *ty, byte_vector *out)
+{
+        dump(out, "sampling profiler is not available on Windows\n");
+}
+
+Value
+sampler_samples(Ty *ty)
+{
+        return ARRAY(vA());
+}
+
+void
+sampler_folded(Ty *ty, byte_vector *out)
+{
+}
+
+void
+sampler_pprof(Ty *ty, byte_vector *out)
+{
+}
+
+void
+sampler_jit_code(void const *code, usize size, Expr const *expr, char const *name)
+{
+}
+
+bool
+sampler_perf_map(void)
+{
+        return false;
+}
+
+void
+sampler_set_output(char const *path)
+{
+}
+
+void
+sampler_dump(void)
+{
+}
+
+_Atomic(usize) HeapSamplesLive;
+
+void
+sampler_heap_alloc(Ty *ty, struct alloc const *a)
+{
+        ty->heap_sample_left = INTPTR_MAX;
+}
+
+void
+sampler_heap_free(struct alloc const *a)
+{
+}
+
+bool
+sampler_heap_start(isize rate)
+{
+        return false;
+}
+
+bool
+sampler_heap_stop(void)
+{
+        return false;
+}
+
+bool
+sampler_heap_running(void)
+{
+        return false;
+}
+
+void
+sampler_heap_reset(void)
+{
+}
+
+void
+sampler_heap_report(Ty *ty, byte_vector *out)
+{
+        dump(out, "allocation profiler is not available on Windows\n");
+}
+
+void
+sampler_heap_pprof(Ty *ty, byte_vector *out)
+{
+}
+
+void
+sampler_heap_set_output(char const *path)
+{
+}
+
+void
+sampler_heap_dump(void)
+{
+}
+
+bool
+sampler_counters(i64 *out)
+{
+        return false;
+}
+
+#endif
@@ -85,15 +85,10 @@ column_count(Ty *ty, int argc, Value *kwargs)
         return INTEGER(sqlite3_column_count(PTR_ARG(0)));
 }
 
-static Value
-get_column(Ty *ty, int argc, Value *kwargs)
+inline static Value
+column_value(Ty *ty, sqlite3_stmt *stmt, int i)
 {
-        ASSERT_ARGC("sqlite3.column()", 2);
-
-        sqlite3_stmt *stmt = PTR_ARG(0);
-        i64 i = INT_ARG(1);
-
-        char *s;
+        char const *s;
         int sz;
         Blob *b;
 
@@ -103,14 +98,16 @@ get_column(Ty *ty, int argc, Value *kwargs)
         case SQLITE_INTEGER:
                 return INTEGER(sqlite3_column_int64(stmt, i));
         case SQLITE_TEXT:
-                s = (char *)sqlite3_column_text(stmt, i);
+                s = (char const *)sqlite3_column_text(stmt, i);
                 sz = sqlite3_column_bytes(stmt, i);
                 return vSs(s, sz);
-        case SQLITE_BLOB:;
+        case SQLITE_BLOB:
                 b = value_blob_new(ty);
-                s = (char *)sqlite3_column_blob(stmt, i);
+                s = sqlite3_column_blob(stmt, i);
                 sz = sqlite3_column_bytes(stmt, i);
+                NOGC(b);
                 uvPn(*b, s, sz);
+                OKGC(b);
                 return BLOB(b);
         case SQLITE_NULL:
         default:
@@ -118,6 +115,17 @@ get_column(Ty *ty, int argc, Value *kwargs)
         }
 }
 
+static Value
+get_column(Ty *ty, int argc, Value *kwargs)
+{
+        ASSERT_ARGC("sqlite3.column()", 2);
+
+        sqlite3_stmt *stmt = PTR_ARG(0);
+        i64 i = INT_ARG(1);
+
+        return column_value(ty, stmt, i);
+}
+
 static Value
 fetch(Ty *ty, int argc, Value *kwargs)
 {
@@ -125,37 +133,12 @@ fetch(Ty *ty, int argc, Value *kwargs)
 
         sqlite3_stmt *stmt = PTR_ARG(0);
 
-        char const *s;
-        int sz;
-        Blob *b;
-        Value a = ARRAY(vA());
+        int n = sqlite3_column_count(stmt);
+        Value a = ARRAY(vAn(n));
         gP(&a);
 
-        int n = sqlite3_column_count(stmt);
         for (int i = 0; i < n; ++i) {
-                switch (sqlite3_column_type(stmt, i)) {
-                case SQLITE_NULL:
-                        vAp(a.array, NIL);
-                        break;
-                case SQLITE_FLOAT:
-                        vAp(a.array, REAL(sqlite3_column_double(stmt, i)));
-                        break;
-                case SQLITE_INTEGER:
-                        vAp(a.array, INTEGER(sqlite3_column_int64(stmt, i)));
-                        break;
-                case SQLITE_TEXT:;
-                        s = (char *)sqlite3_column_text(stmt, i);
-                        sz = sqlite3_column_bytes(stmt, i);
-                        vAp(a.array, vSs(s, sz));
-                        break;
-                case SQLITE_BLOB:;
-                        b = value_blob_new(ty);
-                        s = sqlite3_column_blob(stmt, i);
-                        sz = sqlite3_column_bytes(stmt, i);
-                        vAp(a.array, BLOB(b));
-                        vvPn(*b, s, sz);
-                        break;
-                }
+                vPx(*a.array, column_value(ty, stmt, i));
         }
 
         gX();
@@ -163,52 +146,144 @@ fetch(Ty *ty, int argc, Value *kwargs)
         return a;
 }
 
+/*
+ * Takes the column names as an optional second argument so that callers
+ * fetching many rows from one statement only create the keys once.
+ */
 static Value
 fetch_dict(Ty *ty, int argc, Value *kwargs)
 {
-        ASSERT_ARGC("sqlite3.fetch()", 1);
+        ASSERT_ARGC("sqlite3.fetchAssoc()", 1, 2);
 
         sqlite3_stmt *stmt = PTR_ARG(0);
+        Array const *names = (argc == 2) ? ARGx(1, VALUE_ARRAY).array : NULL;
 
-        char const *s;
-        int sz;
-        Blob *b;
         Value d = DICT(dict_new(ty));
 
         gP(&d);
 
         int n = sqlite3_column_count(stmt);
+        for (int i = 0; i < n; ++i) {
+                Value key = (names != NULL && i < vN(*names))
+                          ? v__(*names, i)
+                          : vSsz(sqlite3_column_name(stmt, i));
+                gP(&key);
+                Value val = column_value(ty, stmt, i);
+                dict_put_value(ty, d.dict, key, val);
+                gX();
+        }
+
+        gX();
+
+        return d;
+}
+
+/*
+ * An empty record with one field per result column. fetchRecord() uses its
+ * field ids for every row, so the names are only looked up once.
+ */
+static Value
+shape(Ty *ty, int argc, Value *kwargs)
+{
+        ASSERT_ARGC("sqlite3.shape()", 1);
+
+        sqlite3_stmt *stmt = PTR_ARG(0);
+
+        int n = sqlite3_column_count(stmt);
+        Value record = value_record(ty, n);
+
         for (int i = 0; i < n; ++i) {
                 char const *name = sqlite3_column_name(stmt, i);
-                Value key = vSsz(name);
-                switch (sqlite3_column_type(stmt, i)) {
-                case SQLITE_NULL:
-                        dict_put_value(ty, d.dict, key, NIL);
-                        break;
-                case SQLITE_FLOAT:
-                        dict_put_value(ty, d.dict, key, REAL(sqlite3_column_double(stmt, i)));
-                        break;
-                case SQLITE_INTEGER:
-                        dict_put_value(ty, d.dict, key, INTEGER(sqlite3_column_int64(stmt, i)));
-                        break;
-                case SQLITE_TEXT:;
-                        s = (char *)sqlite3_column_text(stmt, i);
-                        sz = sqlite3_column_bytes(stmt, i);
-                        dict_put_value(ty, d.dict, key, vSs(s, sz));
-                        break;
-                case SQLITE_BLOB:;
-                        b = value_blob_new(ty);
-                        s = sqlite3_column_blob(stmt, i);
-                        sz = sqlite3_column_bytes(stmt, i);
-                        dict_put_value(ty, d.dict, key, BLOB(b));
-                        uvPn(*b, s, sz);
+                record.ids[i] = (name != NULL) ? M_ID(name) : -1;
+        }
+
+        return record;
+}
+
+static Value
+fetch_record(Ty *ty, int argc, Value *kwargs)
+{
+        ASSERT_ARGC("sqlite3.fetchRecord()", 2);
+
+        sqlite3_stmt *stmt = PTR_ARG(0);
+        Value shape = ARGx(1, VALUE_TUPLE);
+
+        int n = sqlite3_column_count(stmt);
+
+        if (n != shape.count) {
+                bP("shape doesn't match the statement's columns");
+        }
+
+        Value record = vT(n);
+        record.ids = shape.ids;
+        gP(&record);
+
+        for (int i = 0; i < n; ++i) {
+                record.items[i] = column_value(ty, stmt, i);
+        }
+
+        gX();
+
+        return record;
+}
+
+/*
+ * Steps stmt up to `max` times (or until it's done, if max < 0) and returns
+ * the rows column by column. A TEXT value equal to the one above it in the
+ * same column reuses that string rather than allocating a new one, which
+ * makes low-cardinality columns cheap.
+ */
+static Value
+fetch_columns(Ty *ty, int argc, Value *kwargs)
+{
+        ASSERT_ARGC("sqlite3.fetchColumns()", 1, 2);
+
+        sqlite3_stmt *stmt = PTR_ARG(0);
+        imax max = (argc == 2) ? INT_ARG(1) : -1;
+
+        int n = sqlite3_column_count(stmt);
+        Value columns = ARRAY(vAn(n));
+        gP(&columns);
+
+        for (int i = 0; i < n; ++i) {
+                vPx(*columns.array, ARRAY(vA()));
+        }
+
+        int status = SQLITE_DONE;
+
+        for (imax row = 0; max < 0 || row < max; ++row) {
+                if ((status = sqlite3_step(stmt)) != SQLITE_ROW) {
                         break;
                 }
+
+                for (int i = 0; i < n; ++i) {
+                        Array *column = v__(*columns.array, i).array;
+                        Value const *above = (row > 0) ? vvL(*column) : NULL;
+
+                        if (
+                                above != NULL
+                             && above->type == VALUE_STRING
+                             && sqlite3_column_type(stmt, i) == SQLITE_TEXT
+                        ) {
+                                char const *s = (char const *)sqlite3_column_text(stmt, i);
+                                int sz = sqlite3_column_bytes(stmt, i);
+                                if (sN(*above) == sz && memcmp(ss(*above), s, sz) == 0) {
+                                        Value same = *above;
+                                        vAp(column, same);
+                                        continue;
+                                }
+                        }
+
+                        vAp(column, column_value(ty, stmt, i));
+                }
         }
 
         gX();
 
-        return d;
+        return vTn(
+                "columns", columns,
+                "status",  INTEGER(status)
+        );
 }
 
 static Value
@@ -226,6 +301,46 @@ reset(Ty *ty, int argc, Value *kwargs)
         return INTEGER(sqlite3_reset(PTR_ARG(0)));
 }
 
+static Value
+clear_bindings(Ty *ty, int argc, Value *kwargs)
+{
+        ASSERT_ARGC("sqlite3.clearBindings()", 1);
+        return INTEGER(sqlite3_clear_bindings(PTR_ARG(0)));
+}
+
+static int
+bind_value(sqlite3_stmt *stmt, int i, Value const *v)
+{
+        switch (v->type) {
+        case VALUE_INTEGER:
+                return sqlite3_bind_int64(stmt, i, v->z);
+        case VALUE_REAL:
+                return sqlite3_bind_double(stmt, i, v->real);
+        case VALUE_BOOLEAN:
+                return sqlite3_bind_int(stmt, i, v->boolean);
+        case VALUE_STRING:
+                return sqlite3_bind_text(
+                        stmt,
+                        i,
+                        (char const *)ss(*v),
+                        sN(*v),
+                        SQLITE_TRANSIENT
+                );
+        case VALUE_BLOB:
+                return sqlite3_bind_blob(
+                        stmt,
+                        i,
+                        vv(*v->blob),
+                        vN(*v->blob),
+                        SQLITE_TRANSIENT
+                );
+        case VALUE_NIL:
+                return sqlite3_bind_null(stmt, i);
+        default:
+                return SQLITE_MISMATCH;
+        }
+}
+
 static Value
 mbind(Ty *ty, int argc, Value *kwargs)
 {
@@ -244,41 +359,143 @@ mbind(Ty *ty, int argc, Value *kwargs)
         }
 
         Value v = ARG(2);
-        int err;
 
         switch (v.type) {
         case VALUE_INTEGER:
-                err = sqlite3_bind_int64(stmt, i, v.z);
-                break;
         case VALUE_REAL:
-                err = sqlite3_bind_double(stmt, i, v.real);
-                break;
         case VALUE_STRING:
-                err = sqlite3_bind_text(
-                        stmt,
-                        i,
-                        (char const *)ss(v),
-                        sN(v),
-                        SQLITE_TRANSIENT
-                );
-                break;
         case VALUE_BLOB:
-                err = sqlite3_bind_blob(
-                        stmt,
-                        i,
-                        vv(*v.blob),
-                        vN(*v.blob),
-                        SQLITE_TRANSIENT
-                );
-                break;
         case VALUE_NIL:
-                err = sqlite3_bind_null(stmt, i);
-                break;
+                return INTEGER(bind_value(stmt, i, &v));
         default:
                 return NIL;
         }
+}
+
+/*
+ * Named parameters can be written :name, @name or $name in the SQL; a key
+ * without one of those prefixes matches any of them.
+ */
+static int
+named_parameter(sqlite3_stmt *stmt, char const *name, usize n)
+{
+        char buf[256];
+
+        if (n + 2 > sizeof buf) {
+                return 0;
+        }
 
-        return INTEGER(err);
+        memcpy(buf + 1, name, n);
+        buf[n + 1] = '\0';
+
+        if (n > 0 && strchr(":@$", name[0]) != NULL) {
+                return sqlite3_bind_parameter_index(stmt, buf + 1);
+        }
+
+        for (char const *p = ":@$"; *p != '\0'; ++p) {
+                buf[0] = *p;
+                int i = sqlite3_bind_parameter_index(stmt, buf);
+                if (i != 0) {
+                        return i;
+                }
+        }
+
+        return 0;
+}
+
+/*
+ * Binds one row for executeMany(): arrays and unnamed tuple fields go to
+ * positional parameters, dict entries and named record fields to the
+ * matching named parameters.
+ */
+static int
+bind_row(sqlite3_stmt *stmt, Value const *row)
+{
+        int err = SQLITE_OK;
+
+        switch (row->type) {
+        case VALUE_ARRAY:
+                for (int i = 0; err == SQLITE_OK && i < vN(*row->array); ++i) {
+                        err = bind_value(stmt, i + 1, v_(*row->array, i));
+                }
+                break;
+
+        case VALUE_TUPLE:
+                for (int i = 0; err == SQLITE_OK && i < row->count; ++i) {
+                        int k = i + 1;
+                        if (row->ids != NULL && row->ids[i] != -1) {
+                                char const *name = M_NAME(row->ids[i]);
+                                k = named_parameter(stmt, name, strlen(name));
+                        }
+                        err = (k > 0) ? bind_value(stmt, k, &row->items[i]) : SQLITE_RANGE;
+                }
+                break;
+
+        case VALUE_DICT:
+                dfor(row->dict, {
+                        if (err != SQLITE_OK) {
+                                break;
+                        }
+                        if (key->type != VALUE_STRING) {
+                                err = SQLITE_MISMATCH;
+                                break;
+                        }
+                        int k = named_parameter(stmt, (char const *)ss(*key), sN(*key));
+                        err = (k > 0) ? bind_value(stmt, k, val) : SQLITE_RANGE;
+                });
+                break;
+
+        default:
+                err = bind_value(stmt, 1, row);
+        }
+
+        return err;
+}
+
+/*
+ * Runs stmt once for each element of rows, which must all be bound in C
+ * without going back through the interpreter. Stops at the first failure
+ * and reports how many rows went through before it.
+ */
+static Value
+execute_many(Ty *ty, int argc, Value *kwargs)
+{
+        ASSERT_ARGC("sqlite3.executeMany()", 2);
+
+        sqlite3_stmt *stmt = PTR_ARG(0);
+        Array const *rows = ARGx(1, VALUE_ARRAY).array;
+
+        int err = SQLITE_OK;
+        imax done = 0;
+
+        for (; done < vN(*rows); ++done) {
+                sqlite3_reset(stmt);
+                sqlite3_clear_bindings(stmt);
+
+                if ((err = bind_row(stmt, v_(*rows, done))) != SQLITE_OK) {
+                        break;
+                }
+
+                if ((err = sqlite3_step(stmt)) == SQLITE_ROW || err == SQLITE_DONE) {
+                        err = SQLITE_OK;
+                } else {
+                        break;
+                }
+        }
+
+        sqlite3_reset(stmt);
+
+        return vTn(
+                "count", INTEGER(done),
+                "error", INTEGER(err)
+        );
+}
+
+static Value
+autocommit(Ty *ty, int argc, Value *kwargs)
+{
+        ASSERT_ARGC("sqlite3.autocommit()", 1);
+        return BOOLEAN(sqlite3_get_autocommit(PTR_ARG(0)));
 }
 
 static Value
@@ -334,10 +551,14 @@ static struct {
         { .name = "close",        .value = BUILTIN(dbclose)       },
         { .name = "fetch",        .value = BUILTIN(fetch)         },
         { .name = "fetchAssoc",   .value = BUILTIN(fetch_dict)    },
+        { .name = "fetchRecord",  .value = BUILTIN(fetch_record)  },
+        { .name = "fetchColumns", .value = BUILTIN(fetch_columns) },
+        { .name = "shape",        .value = BUILTIN(shape)         },
         { .name = "prepare",      .value = BUILTIN(prepare)       },
         { .name = "step",         .value = BUILTIN(step)          },
         { .name = "finalize",     .value = BUILTIN(finalize)      },
         { .name = "reset",        .value = BUILTIN(reset)         },
+        { .name = "clearBindings", .value = BUILTIN(clear_bindings) },
         { .name = "bind",         .value = BUILTIN(mbind)          },
         { .name = "column",       .value = BUILTIN(get_column)    },
         { .name = "columnCount",  .value = BUILTIN(column_count)  },
@@ -345,6 +566,8 @@ static struct {
         { .name = "error",        .value = BUILTIN(error_code)    },
         { .name = "errorMessage", .value = BUILTIN(error_msg)     },
         { .name = "changes",      .value = BUILTIN(changes)       },
+        { .name = "executeMany",  .value = BUILTIN(execute_many)  },
+        { .name = "autocommit",   .value = BUILTIN(autocommit)    },
         { .name = "totalChanges", .value = BUILTIN(total_changes) },
         { .name = "SQLITE_ABORT", .value = INT(4) },
         { .name = "SQLITE_AUTH", .value = INT(23) },
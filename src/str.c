@@ -293,7 +293,7 @@ string_search_all(Ty *ty, Value *string, int argc, Value *kwargs)
                         off += n + sN(pattern);
                 }
         } else {
-                pcre2_code *re = pattern.regex->pcre2;
+                pcre2_code *re = regex_code(pattern.regex);
                 usize *ovec = ty_re_ovec();
                 isize rc;
                 for (;;) {
@@ -365,7 +365,7 @@ string_bsearch(Ty *ty, Value *string, int argc, Value *kwargs)
                 n = match - s;
         } else if (pattern.type == VALUE_REGEX) {
                 usize *ovec = ty_re_ovec();
-                isize rc = ty_re_match(pattern.regex->pcre2, s, bytes, 0, 0);
+                isize rc = ty_re_match(regex_code(pattern.regex), s, bytes, 0, 0);
 
                 if (rc == PCRE2_ERROR_NOMATCH) {
                         return NIL;
@@ -416,7 +416,7 @@ string_search(Ty *ty, Value *string, int argc, Value *kwargs)
                 u8 const *match = mmmm(s, bytes, ss(pattern), sN(pattern));
                 n = (match != NULL) ? (match - s) : -1;
         } else {
-                pcre2_code *re = pattern.regex->pcre2;
+                pcre2_code *re = regex_code(pattern.regex);
                 usize *ovec = ty_re_ovec();
 
                 isize rc = ty_re_match(re, (PCRE2_SPTR)s, bytes, 0, 0);
@@ -458,7 +458,7 @@ string_searchr(Ty *ty, Value *string, int argc, Value *kwargs)
                 u8 const *match = mmmmr(s, bytes, ss(pattern), sN(pattern));
                 n = (match != NULL) ? (match - s) : -1;
         } else {
-                pcre2_code *re = pattern.regex->pcre2;
+                pcre2_code *re = regex_code(pattern.regex);
                 usize *ovec = ty_re_ovec();
                 isize last_match = -1;
                 isize pos = 0;
@@ -508,7 +508,7 @@ string_bsearchr(Ty *ty, Value *string, int argc, Value *kwargs)
                 }
                 n = match - s;
         } else {
-                pcre2_code *re = pattern.regex->pcre2;
+                pcre2_code *re = regex_code(pattern.regex);
                 usize *ovec = ty_re_ovec();
                 isize last_match = -1;
                 isize pos = 0;
@@ -718,7 +718,7 @@ string_split(Ty *ty, Value *string, int argc, Value *kwargs)
                         vAp(result.array, STRING_EMPTY);
                 }
         } else {
-                pcre2_code *re = pattern.regex->pcre2;
+                pcre2_code *re = regex_code(pattern.regex);
                 isize len = sN(*string);
                 isize start = 0;
                 isize pstart = 0;
@@ -786,7 +786,7 @@ string_count(Ty *ty, Value *string, int argc, Value *kwargs)
                         count += 1;
                 }
         } else if (pattern.type == VALUE_REGEX) {
-                pcre2_code *re = pattern.regex->pcre2;
+                pcre2_code *re = regex_code(pattern.regex);
                 usize *ovec = ty_re_ovec();
                 isize off = 0;
                 isize rc;
@@ -861,7 +861,7 @@ string_comb(Ty *ty, Value *string, int argc, Value *kwargs)
 
         case VALUE_REGEX:
         {
-                pcre2_code *re = pattern.regex->pcre2;
+                pcre2_code *re = regex_code(pattern.regex);
                 isize len = sN(*string);
                 isize start = 0;
                 usize *ovec = ty_re_ovec();
@@ -988,7 +988,7 @@ string_replace(Ty *ty, Value *string, int argc, Value *kwargs)
 
                 vvPn(chars, s, len);
         } else if (replacement.type == VALUE_STRING) {
-                pcre2_code *re = pattern.regex->pcre2;
+                pcre2_code *re = regex_code(pattern.regex);
                 isize len = sN(*string);
                 usize *ovec = ty_re_ovec();
                 isize start = 0;
@@ -1025,7 +1025,7 @@ string_replace(Ty *ty, Value *string, int argc, Value *kwargs)
                         vvPn(chars, s + start, len - start);
                 }
         } else if (CALLABLE(replacement)) {
-                pcre2_code *re = pattern.regex->pcre2;
+                pcre2_code *re = regex_code(pattern.regex);
                 isize len = sN(*string);
                 usize *ovec = ty_re_ovec();
                 isize start = 0;
@@ -1082,7 +1082,7 @@ string_is_match(Ty *ty, Value *string, int argc, Value *kwargs)
         Value pattern = ARGx(0, VALUE_REGEX);
 
         isize rc = pcre2_match(
-                pattern.regex->pcre2,
+                regex_code(pattern.regex),
                 (PCRE2_SPTR)ss(*string),
                 sN(*string),
                 0,
@@ -1107,7 +1107,7 @@ string_match(Ty *ty, Value *string, int argc, Value *kwargs)
         usize *ovec = ty_re_ovec();
 
         isize rc = pcre2_match(
-                pattern.regex->pcre2,
+                regex_code(pattern.regex),
                 (PCRE2_SPTR)ss(*string),
                 sN(*string),
                 0,
@@ -1143,7 +1143,7 @@ string_matches(Ty *ty, Value *string, int argc, Value *kwargs)
 
         for (;;) {
                 rc = pcre2_match(
-                        pattern.regex->pcre2,
+                        regex_code(pattern.regex),
                         (PCRE2_SPTR)ss(*string),
                         sN(*string),
                         offset,
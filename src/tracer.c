@@ -0,0 +1,424 @@
+#include <errno.h>
+#include <string.h>
+
+#include "ty.h"
+#include "vm.h"
+#include "xd.h"
+#include "tthread.h"
+#include "tracer.h"
+
+/*
+ * An execution tracer: a timeline of what each thread was doing, written out
+ * in Chrome's trace-event format so that it can be opened in Perfetto
+ * (ui.perfetto.dev) or chrome://tracing.
+ *
+ * Every thread appends to its own buffer, so recording an event never waits
+ * on another thread; the buffer's lock is only ever contended while a trace is
+ * being written out. Buffers outlive their threads, and are only emptied by
+ * tracer_reset().
+ *
+ * Most events are "complete" events, recorded once they're over with their
+ * start time and duration. Only GC phases, whose ends are far from their
+ * beginnings, use separate begin and end events.
+ */
+
+enum {
+        TRACE_MAX_EVENTS = 1 << 20
+};
+
+typedef struct {
+        u64 ts;
+        u64 dur;
+        char const *name;
+        char const *cat;
+        char const *detail;
+        char ph;
+} TraceEvent;
+
+typedef struct trace_buffer TraceBuffer;
+
+struct trace_buffer {
+        u64 tid;
+        TySpinLock lock;
+        vec(TraceEvent) events;
+        u64 dropped;
+        TraceBuffer *next;
+};
+
+atomic_bool Tracing;
+
+static _Thread_local TraceBuffer *MyBuffer;
+static _Thread_local u64 BlockedSince;
+
+static TySpinLock Lock;
+static bool Initialized;
+static TraceBuffer *Buffers;
+static u64 Epoch;
+static char const *OutPath;
+
+typedef struct {
+        u64 hash;
+        char *str;
+} TraceString;
+
+// Open-addressed, so size is always a power of two
+static struct {
+        TraceString *slots;
+        usize size;
+        usize count;
+} Strings;
+
+u64
+tracer_now(void)
+{
+        return TyMonotonicTime();
+}
+
+static TraceBuffer *
+Buffer(void)
+{
+        if (MyBuffer != NULL) {
+                return MyBuffer;
+        }
+
+        TraceBuffer *buf = xmA(sizeof *buf);
+        *buf = (TraceBuffer) { .tid = RealThreadId() };
+        TySpinLockInit(&buf->lock);
+
+        TySpinLockLock(&Lock);
+        buf->next = Buffers;
+        Buffers = buf;
+        TySpinLockUnlock(&Lock);
+
+        return MyBuffer = buf;
+}
+
+static void
+Record(char ph, char const *name, char const *cat, u64 ts, u64 dur, char const *detail)
+{
+        TraceBuffer *buf = Buffer();
+
+        TySpinLockLock(&buf->lock);
+
+        if (vN(buf->events) < TRACE_MAX_EVENTS) {
+                xvP(
+                        buf->events,
+                        ((TraceEvent) {
+                                .ts     = ts,
+                                .dur    = dur,
+                                .name   = name,
+                                .cat    = cat,
+                                .detail = detail,
+                                .ph     = ph
+                        })
+                );
+        } else {
+                buf->dropped += 1;
+        }
+
+        TySpinLockUnlock(&buf->lock);
+}
+
+static TraceString *
+FindString(TraceString *slots, usize size, char const *s, usize n, u64 hash)
+{
+        usize mask = size - 1;
+
+        for (usize i = hash & mask;; i = (i + 1) & mask) {
+                TraceString *slot = &slots[i];
+                if (
+                        (slot->str == NULL)
+                     || (slot->hash == hash && strncmp(slot->str, s, n) == 0 && slot->str[n] == '\0')
+                ) {
+                        return slot;
+                }
+        }
+}
+
+static void
+GrowStrings(void)
+{
+        usize size = (Strings.size == 0) ? 256 : 2 * Strings.size;
+        TraceString *slots = xmA(size * sizeof *slots);
+
+        memset(slots, 0, size * sizeof *slots);
+
+        for (usize i = 0; i < Strings.size; ++i) {
+                TraceString const *old = &Strings.slots[i];
+                if (old->str != NULL) {
+                        *FindString(slots, size, old->str, strlen(old->str), old->hash) = *old;
+                }
+        }
+
+        xmF(Strings.slots);
+
+        Strings.slots = slots;
+        Strings.size  = size;
+}
+
+// Strings that events refer to have to live as long as the trace does
+char const *
+tracer_intern(char const *s, usize n)
+{
+        u64 hash = XXH3_64bits(s, n);
+
+        TySpinLockLock(&Lock);
+
+        if (2 * (Strings.count + 1) > Strings.size) {
+                GrowStrings();
+        }
+
+        TraceString *slot = FindString(Strings.slots, Strings.size, s, n, hash);
+
+        if (slot->str == NULL) {
+                slot->str = xmA(n + 1);
+                slot->hash = hash;
+                memcpy(slot->str, s, n);
+                slot->str[n] = '\0';
+                Strings.count += 1;
+        }
+
+        char const *interned = slot->str;
+
+        TySpinLockUnlock(&Lock);
+
+        return interned;
+}
+
+void
+tracer_begin(char const *name, char const *cat)
+{
+        Record('B', name, cat, tracer_now(), 0, NULL);
+}
+
+void
+tracer_end(void)
+{
+        Record('E', NULL, NULL, tracer_now(), 0, NULL);
+}
+
+void
+tracer_complete(char const *name, char const *cat, u64 start, char const *detail)
+{
+        u64 now = tracer_now();
+
+        if (detail != NULL) {
+                detail = tracer_intern(detail, strlen(detail));
+        }
+
+        Record('X', name, cat, start, now - start, detail);
+}
+
+void
+tracer_instant(char const *name, char const *cat, char const *detail)
+{
+        if (detail != NULL) {
+                detail = tracer_intern(detail, strlen(detail));
+        }
+
+        Record('i', name, cat, tracer_now(), 0, detail);
+}
+
+/*
+ * Time spent with the Ty lock released for a blocking call. ReleaseLock() and
+ * TakeLock() call these: the lock is also released to wait for a GC, but
+ * that's traced separately, and isn't "blocked" as far as ReleaseLock() is
+ * concerned.
+ */
+void
+tracer_unlocked(bool blocked)
+{
+        BlockedSince = blocked ? tracer_now() : 0;
+}
+
+void
+tracer_locked(void)
+{
+        if (BlockedSince != 0) {
+                Record('X', "blocked", "io", BlockedSince, tracer_now() - BlockedSince, NULL);
+                BlockedSince = 0;
+        }
+}
+
+bool
+tracer_start(void)
+{
+        if (!Initialized) {
+                TySpinLockInit(&Lock);
+                Initialized = true;
+        }
+
+        if (atomic_load(&Tracing)) {
+                return false;
+        }
+
+        if (Epoch == 0) {
+                Epoch = tracer_now();
+        }
+
+        atomic_store(&Tracing, true);
+
+        return true;
+}
+
+bool
+tracer_stop(void)
+{
+        return atomic_exchange(&Tracing, false);
+}
+
+void
+tracer_reset(void)
+{
+        if (!Initialized) {
+                return;
+        }
+
+        TySpinLockLock(&Lock);
+
+        for (TraceBuffer *buf = Buffers; buf != NULL; buf = buf->next) {
+                TySpinLockLock(&buf->lock);
+                v0(buf->events);
+                buf->dropped = 0;
+                TySpinLockUnlock(&buf->lock);
+        }
+
+        Epoch = tracer_now();
+
+        TySpinLockUnlock(&Lock);
+}
+
+static void
+JsonString(byte_vector *out, char const *s)
+{
+        xvP(*out, '"');
+
+        for (; *s != '\0'; ++s) {
+                u8 c = *s;
+                switch (c) {
+                case '"':  dump(out, "\\\""); break;
+                case '\\': dump(out, "\\\\"); break;
+                case '\n': dump(out, "\\n");  break;
+                case '\t': dump(out, "\\t");  break;
+                default:
+                        if (c < 0x20) {
+                                dump(out, "\\u%04x", c);
+                        } else {
+                                xvP(*out, c);
+                        }
+                }
+        }
+
+        xvP(*out, '"');
+}
+
+static void
+Timestamp(byte_vector *out, char const *key, u64 ns)
+{
+        dump(out, ",\"%s\":%"PRIu64".%03u", key, ns / 1000, (unsigned)(ns % 1000));
+}
+
+void
+tracer_json(byte_vector *out)
+{
+        if (!Initialized) {
+                dump(out, "{\"traceEvents\":[]}\n");
+                return;
+        }
+
+        TySpinLockLock(&Lock);
+
+        dump(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+        dump(out, "{\"ph\":\"M\",\"pid\":1,\"name\":\"process_name\",\"args\":{\"name\":\"ty\"}}");
+
+        for (TraceBuffer *buf = Buffers; buf != NULL; buf = buf->next) {
+                TySpinLockLock(&buf->lock);
+
+                dump(
+                        out,
+                        ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":%"PRIu64",\"name\":\"thread_name\","
+                        "\"args\":{\"name\":\"thread %"PRIu64"\"}}",
+                        buf->tid,
+                        buf->tid
+                );
+
+                if (buf->dropped > 0) {
+                        dump(
+                                out,
+                                ",\n{\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%"PRIu64",\"ts\":0,"
+                                "\"name\":\"%"PRIu64" events dropped\"}",
+                                buf->tid,
+                                buf->dropped
+                        );
+                }
+
+                for (usize i = 0; i < vN(buf->events); ++i) {
+                        TraceEvent const *ev = v_(buf->events, i);
+
+                        // Events from before the last reset
+                        if (ev->ts < Epoch) {
+                                continue;
+                        }
+
+                        dump(out, ",\n{\"ph\":\"%c\",\"pid\":1,\"tid\":%"PRIu64, ev->ph, buf->tid);
+                        Timestamp(out, "ts", ev->ts - Epoch);
+
+                        if (ev->ph == 'X') {
+                                Timestamp(out, "dur", ev->dur);
+                        } else if (ev->ph == 'i') {
+                                dump(out, ",\"s\":\"t\"");
+                        }
+
+                        if (ev->name != NULL) {
+                                dump(out, ",\"name\":");
+                                JsonString(out, ev->name);
+                        }
+
+                        if (ev->cat != NULL) {
+                                dump(out, ",\"cat\":\"%s\"", ev->cat);
+                        }
+
+                        if (ev->detail != NULL) {
+                                dump(out, ",\"args\":{\"detail\":");
+                                JsonString(out, ev->detail);
+                                dump(out, "}");
+                        }
+
+                        dump(out, "}");
+                }
+
+                TySpinLockUnlock(&buf->lock);
+        }
+
+        dump(out, "\n]}\n");
+
+        TySpinLockUnlock(&Lock);
+}
+
+void
+tracer_set_output(char const *path)
+{
+        OutPath = path;
+}
+
+// atexit() hook for --trace-out
+void
+tracer_dump(void)
+{
+        byte_vector out = {0};
+
+        tracer_stop();
+        tracer_json(&out);
+
+        FILE *f = fopen(OutPath, "wb");
+
+        if (f == NULL || fwrite(vv(out), 1, vN(out), f) != vN(out)) {
+                fprintf(stderr, "ty: failed to write trace to %s: %s\n", OutPath, strerror(errno));
+        }
+
+        if (f != NULL) {
+                fclose(f);
+        }
+
+        xvF(out);
+}
@@ -322,8 +322,28 @@ static vec(usize) WorkIndex;
 static ConstraintVector ToSolve;
 static vec(Expr *) FunStack;
 static vec(TypeEnv *) EnvStack;
+static U32Vector LevelEpoch;
 // ================================
 
+static u64 FuelUsed;
+static u64 CheckTime;
+static int CheckTiming;
+
+// Times the outermost unification or type_check() call, for --type-stats
+inline static u64
+CheckClockStart(void)
+{
+        return (TypeStats && CheckTiming++ == 0) ? TyThreadCPUTime() : 0;
+}
+
+inline static void
+CheckClockStop(u64 start)
+{
+        if (TypeStats && --CheckTiming == 0) {
+                CheckTime += TyThreadCPUTime() - start;
+        }
+}
+
 inline static bool
 IsBottom(Type const *t0)
 {
@@ -340,6 +360,7 @@ FuelCheck(Ty *ty)
         }
 
         FUEL -= 1;
+        FuelUsed += 1;
 
         if (FUEL == LOW_FUEL) {
                 EnableLogging = 1;
@@ -353,11 +374,21 @@ FuelCheck(Ty *ty)
         CurrentLevel += 1;              \
 } while (0)
 
-#define LeaveScope() do {       \
-        CurrentLevel -= 1;      \
-        SolveDeferred(ty);      \
+#define LeaveScope() do {               \
+        CurrentLevel -= 1;              \
+        ForgetLevel(CurrentLevel + 1);  \
+        SolveDeferred(ty);              \
 } while (0)
 
+// Drops the type_check() results remembered at the given level
+inline static void
+ForgetLevel(u32 level)
+{
+        if (level < vN(LevelEpoch)) {
+                *v_(LevelEpoch, level) += 1;
+        }
+}
+
 inline static char *
 mkcstr(Ty *ty, Value const *v)
 {
@@ -1181,6 +1212,7 @@ CloneType(Ty *ty, Type const *t0)
                 t = amA(sizeof *t);
                 *t = *t0;
                 t->fixed = false;
+                t->canon = NULL;
                 t->src = t0->src;
                 TypeAllocCounter += 1;
         }
@@ -2418,6 +2450,442 @@ AlmostSameType(Type const *t0, Type const *t1)
         return false;
 }
 
+/*
+ * Hash-consing
+ *
+ * A closed type -- one with no type variables, aliases or computed types
+ * anywhere inside it -- has a canonical representative that is shared by
+ * every type structurally identical to it, so comparing two closed types
+ * is a pointer comparison. Children are interned first, which makes the
+ * comparison of candidates shallow.
+ *
+ * Canonical nodes are private copies made with the general-purpose allocator:
+ * the types they stand for are updated in place during inference, and may live
+ * in an arena that gets released (see ty.eval()), so they never escape into the
+ * type graph. A type only remembers its representative once it's concrete and
+ * fixed, i.e. once unification can no longer change it.
+ */
+
+static Type NotClosed = { .type = TYPE_ERROR };
+
+static struct {
+        Type **slots;
+        u32 count;
+        u32 mask;
+} Interned;
+
+static u64 InternLookups;
+static u64 InternHits;
+
+inline static Type *
+CanonOf(Type const *t0)
+{
+        return (t0 != NULL && t0->fixed && t0->canon != &NotClosed) ? t0->canon : NULL;
+}
+
+static u64
+CanonHash(Type const *t0)
+{
+        u64 h = HashCombine(t0->type, (t0->variadic << 2) | (t0->forgive << 1) | t0->packed);
+
+        switch (t0->type) {
+        case TYPE_OBJECT:
+        case TYPE_CLASS:
+                h = HashCombine(h, (uptr)t0->class);
+                for (int i = 0; i < vN(t0->args); ++i) {
+                        h = HashCombine(h, (uptr)v__(t0->args, i));
+                }
+                break;
+
+        case TYPE_TUPLE:
+                h = HashCombine(h, (uptr)t0->repeat);
+                h = HashCombine(h, (t0->frfr << 1) | t0->closed);
+                for (int i = 0; i < vN(t0->types); ++i) {
+                        char const *name = v__(t0->names, i);
+                        h = HashCombine(h, (uptr)v__(t0->types, i));
+                        h = HashCombine(h, (name != NULL) ? hash64z(name) : 0);
+                        h = HashCombine(h, v__(t0->required, i));
+                }
+                break;
+
+        case TYPE_UNION:
+        case TYPE_INTERSECT:
+                for (int i = 0; i < vN(t0->types); ++i) {
+                        h = HashCombine(h, (uptr)v__(t0->types, i));
+                }
+                break;
+
+        case TYPE_FUNCTION:
+                h = HashCombine(h, (uptr)t0->rt);
+                h = HashCombine(h, (uptr)t0->yields);
+                h = HashCombine(h, (uptr)t0->sends);
+                for (int i = 0; i < vN(t0->params); ++i) {
+                        Param const *p = v_(t0->params, i);
+                        h = HashCombine(h, (uptr)p->type);
+                        h = HashCombine(h, (uptr)p->dflt);
+                        h = HashCombine(h, (p->name != NULL) ? hash64z(p->name) : 0);
+                        h = HashCombine(h, (p->required << 3) | (p->rest << 2) | (p->kws << 1) | p->pack);
+                }
+                break;
+
+        case TYPE_INT:
+        case TYPE_BOOL:
+                h = HashCombine(h, t0->z);
+                break;
+
+        case TYPE_STRING:
+                h = HashCombine(h, hash64z(t0->str));
+                break;
+        }
+
+        return h;
+}
+
+inline static bool
+SameName(char const *s0, char const *s1)
+{
+        return (s0 == s1) || (s0 != NULL && s1 != NULL && s_eq(s0, s1));
+}
+
+static bool
+CanonEqual(Type const *t0, Type const *t1)
+{
+        if (
+                t0->type != t1->type
+             || t0->variadic != t1->variadic
+             || t0->forgive != t1->forgive
+             || t0->packed != t1->packed
+        ) {
+                return false;
+        }
+
+        switch (t0->type) {
+        case TYPE_OBJECT:
+        case TYPE_CLASS:
+                if (t0->class != t1->class || vN(t0->args) != vN(t1->args)) {
+                        return false;
+                }
+                for (int i = 0; i < vN(t0->args); ++i) {
+                        if (v__(t0->args, i) != v__(t1->args, i)) {
+                                return false;
+                        }
+                }
+                return true;
+
+        case TYPE_TUPLE:
+                if (
+                        t0->repeat != t1->repeat
+                     || t0->frfr != t1->frfr
+                     || t0->closed != t1->closed
+                     || vN(t0->types) != vN(t1->types)
+                ) {
+                        return false;
+                }
+                for (int i = 0; i < vN(t0->types); ++i) {
+                        if (
+                                v__(t0->types, i) != v__(t1->types, i)
+                             || v__(t0->required, i) != v__(t1->required, i)
+                             || !SameName(v__(t0->names, i), v__(t1->names, i))
+                        ) {
+                                return false;
+                        }
+                }
+                return true;
+
+        case TYPE_UNION:
+        case TYPE_INTERSECT:
+                if (vN(t0->types) != vN(t1->types)) {
+                        return false;
+                }
+                for (int i = 0; i < vN(t0->types); ++i) {
+                        if (v__(t0->types, i) != v__(t1->types, i)) {
+                                return false;
+                        }
+                }
+                return true;
+
+        case TYPE_FUNCTION:
+                if (
+                        t0->rt != t1->rt
+                     || t0->yields != t1->yields
+                     || t0->sends != t1->sends
+                     || vN(t0->params) != vN(t1->params)
+                ) {
+                        return false;
+                }
+                for (int i = 0; i < vN(t0->params); ++i) {
+                        Param const *p0 = v_(t0->params, i);
+                        Param const *p1 = v_(t1->params, i);
+                        if (
+                                p0->type != p1->type
+                             || p0->dflt != p1->dflt
+                             || p0->required != p1->required
+                             || p0->rest != p1->rest
+                             || p0->kws != p1->kws
+                             || p0->pack != p1->pack
+                             || !SameName(p0->name, p1->name)
+                        ) {
+                                return false;
+                        }
+                }
+                return true;
+
+        case TYPE_INT:
+        case TYPE_BOOL:
+                return t0->z == t1->z;
+
+        case TYPE_STRING:
+                return s_eq(t0->str, t1->str);
+
+        case TYPE_NIL:
+        case TYPE_BOTTOM:
+                return true;
+        }
+
+        return false;
+}
+
+static void
+FreeCandidate(Type *t0)
+{
+        switch (t0->type) {
+        case TYPE_OBJECT:
+        case TYPE_CLASS:
+                xvF(t0->args);
+                break;
+
+        case TYPE_TUPLE:
+                xvF(t0->names);
+                xvF(t0->required);
+        case TYPE_UNION:
+        case TYPE_INTERSECT:
+                xvF(t0->types);
+                break;
+
+        case TYPE_FUNCTION:
+                xvF(t0->params);
+                break;
+        }
+
+        xmF(t0);
+}
+
+static void
+InternGrow(void)
+{
+        u32 cap = (Interned.mask == 0) ? 256 : 2 * (Interned.mask + 1);
+        Type **slots = mrealloc(NULL, cap * sizeof (Type *));
+
+        memset(slots, 0, cap * sizeof (Type *));
+
+        for (u32 i = 0; Interned.mask != 0 && i <= Interned.mask; ++i) {
+                Type *t0 = Interned.slots[i];
+                if (t0 != NULL) {
+                        u32 j = CanonHash(t0) & (cap - 1);
+                        while (slots[j] != NULL) {
+                                j = (j + 1) & (cap - 1);
+                        }
+                        slots[j] = t0;
+                }
+        }
+
+        xmF(Interned.slots);
+
+        Interned.slots = slots;
+        Interned.mask = cap - 1;
+}
+
+// Returns the representative of the candidate t0, taking ownership of it
+static Type *
+Intern(Type *t0)
+{
+        if (2 * (Interned.count + 1) > Interned.mask) {
+                InternGrow();
+        }
+
+        InternLookups += 1;
+
+        u32 i = CanonHash(t0) & Interned.mask;
+
+        for (Type *t1; (t1 = Interned.slots[i]) != NULL; i = (i + 1) & Interned.mask) {
+                if (CanonEqual(t0, t1)) {
+                        InternHits += 1;
+                        FreeCandidate(t0);
+                        return t1;
+                }
+        }
+
+        switch (t0->type) {
+        case TYPE_TUPLE:
+                for (int i = 0; i < vN(t0->names); ++i) {
+                        if (v__(t0->names, i) != NULL) {
+                                *v_(t0->names, i) = S2(v__(t0->names, i));
+                        }
+                }
+                break;
+
+        case TYPE_FUNCTION:
+                for (int i = 0; i < vN(t0->params); ++i) {
+                        Param *p = v_(t0->params, i);
+                        if (p->name != NULL) {
+                                p->name = S2(p->name);
+                        }
+                }
+                break;
+
+        case TYPE_STRING:
+                t0->str = S2(t0->str);
+                break;
+        }
+
+        t0->fixed = true;
+        t0->concrete = true;
+        t0->canon = t0;
+
+        Interned.slots[i] = t0;
+        Interned.count += 1;
+
+        return t0;
+}
+
+static Type *
+Canonical(Type *t0, int depth);
+
+inline static bool
+CanonicalChild(Type *t0, Type **c, int depth)
+{
+        if (t0 == NULL) {
+                *c = NULL;
+                return true;
+        }
+
+        *c = Canonical(t0, depth + 1);
+
+        return (*c != &NotClosed);
+}
+
+// The canonical representative of t0, or &NotClosed if it doesn't have one
+static Type *
+Canonical(Type *t0, int depth)
+{
+        Type *c;
+
+        if (t0->canon != NULL) {
+                return t0->canon;
+        }
+
+        // Too deep to be worth it, or cyclic
+        if (depth > 32) {
+                return &NotClosed;
+        }
+
+        Type *t1 = mrealloc(NULL, sizeof *t1);
+        memset(t1, 0, sizeof *t1);
+
+        t1->type     = t0->type;
+        t1->variadic = t0->variadic;
+        t1->forgive  = t0->forgive;
+        t1->packed   = t0->packed;
+
+        switch (t0->type) {
+        case TYPE_OBJECT:
+        case TYPE_CLASS:
+                if (vN(t0->bound) != 0) {
+                        goto NotClosed;
+                }
+                t1->class = t0->class;
+                for (int i = 0; i < vN(t0->args); ++i) {
+                        if (!CanonicalChild(v__(t0->args, i), &c, depth)) {
+                                goto NotClosed;
+                        }
+                        xvP(t1->args, c);
+                }
+                break;
+
+        case TYPE_TUPLE:
+                if (!CanonicalChild(t0->repeat, &t1->repeat, depth)) {
+                        goto NotClosed;
+                }
+                t1->frfr   = t0->frfr;
+                t1->closed = t0->closed;
+                for (int i = 0; i < vN(t0->types); ++i) {
+                        if (!CanonicalChild(v__(t0->types, i), &c, depth)) {
+                                goto NotClosed;
+                        }
+                        xvP(t1->types, c);
+                        xvP(t1->names, v__(t0->names, i));
+                        xvP(t1->required, v__(t0->required, i));
+                }
+                break;
+
+        case TYPE_UNION:
+        case TYPE_INTERSECT:
+                for (int i = 0; i < vN(t0->types); ++i) {
+                        if (!CanonicalChild(v__(t0->types, i), &c, depth)) {
+                                goto NotClosed;
+                        }
+                        xvP(t1->types, c);
+                }
+                break;
+
+        case TYPE_FUNCTION:
+                if (
+                        vN(t0->bound) != 0
+                     || vN(t0->constraints) != 0
+                     || t0->pack != NULL
+                     || !CanonicalChild(t0->rt, &t1->rt, depth)
+                     || !CanonicalChild(t0->yields, &t1->yields, depth)
+                     || !CanonicalChild(t0->sends, &t1->sends, depth)
+                ) {
+                        goto NotClosed;
+                }
+                for (int i = 0; i < vN(t0->params); ++i) {
+                        Param p = v__(t0->params, i);
+                        if (
+                                !CanonicalChild(p.type, &p.type, depth)
+                             || !CanonicalChild(p.dflt, &p.dflt, depth)
+                        ) {
+                                goto NotClosed;
+                        }
+                        xvP(t1->params, p);
+                }
+                break;
+
+        case TYPE_INT:
+        case TYPE_BOOL:
+                t1->z = t0->z;
+                break;
+
+        case TYPE_STRING:
+                t1->str = t0->str;
+                break;
+
+        case TYPE_NIL:
+        case TYPE_BOTTOM:
+                break;
+
+        default:
+                goto NotClosed;
+        }
+
+        c = Intern(t1);
+
+        if (t0->fixed && t0->concrete) {
+                t0->canon = c;
+        }
+
+        return c;
+
+NotClosed:
+        FreeCandidate(t1);
+
+        if (t0->fixed && t0->concrete) {
+                t0->canon = &NotClosed;
+        }
+
+        return &NotClosed;
+}
+
 static bool
 SameType(Type const *t0, Type const *t1)
 {
@@ -2429,6 +2897,10 @@ SameType(Type const *t0, Type const *t1)
                 return true;
         }
 
+        if (CanonOf(t0) != NULL && CanonOf(t0) == CanonOf(t1)) {
+                return true;
+        }
+
         if (IsBoundVar(t0)) {
                 return false;
         }
@@ -5592,7 +6064,9 @@ static bool
                 }
         }
 #else
+        u64 start = CheckClockStart();
         bool ok = !ENABLED || UnifyXD(ty, t0, t1, super, false, false);
+        CheckClockStop(start);
 #endif
 
         if (!ok && check && ENFORCE) {
@@ -7004,6 +7478,7 @@ type_call_t(Ty *ty, Expr const *e, Type *t0)
                         CurrentLevel += 1;
                         TryBind(ty, t0, t1, false);
                         CurrentLevel -= 1;
+                        ForgetLevel(CurrentLevel + 1);
                         return InferCall(ty, args, kwargs, kws, t0);
                 }
         }
@@ -8495,11 +8970,154 @@ type_check2(Ty *ty, Type *t0, Type *t1, bool need)
         return ok;
 }
 
+/*
+ * type_check() results for pairs of closed types, keyed by their canonical
+ * representatives. An entry is only good while we're still at (or below) the
+ * solving level it was made at: leaving that level bumps its epoch. Giving a
+ * class a new superclass forgets everything.
+ */
+typedef struct {
+        Type const *t0;
+        Type const *t1;
+        u32 level;
+        u32 epoch;
+        bool ok;
+} CheckEntry;
+
+static struct {
+        CheckEntry *slots;
+        u32 count;
+        u32 mask;
+} Checked;
+
+static u64 CheckLookups;
+static u64 CheckHits;
+
+inline static u32
+CheckHash(Type const *t0, Type const *t1)
+{
+        return HashCombine((uptr)t0, (uptr)t1 >> 4);
+}
+
+inline static bool
+CheckIsLive(CheckEntry const *e)
+{
+        return (e->t0 != NULL)
+            && (e->level <= CurrentLevel)
+            && (e->epoch == v__(LevelEpoch, e->level));
+}
+
+static Type const *
+CheckKey(Type *t0)
+{
+        if (t0 == NULL || !t0->fixed || !t0->concrete) {
+                return NULL;
+        }
+
+        Type const *c = Canonical(t0, 0);
+
+        return (c != &NotClosed) ? c : NULL;
+}
+
+static bool
+FindCheck(Type const *t0, Type const *t1, bool *ok)
+{
+        if (Checked.count == 0) {
+                return false;
+        }
+
+        CheckLookups += 1;
+
+        for (
+                u32 i = CheckHash(t0, t1) & Checked.mask;
+                Checked.slots[i].t0 != NULL;
+                i = (i + 1) & Checked.mask
+        ) {
+                CheckEntry const *e = &Checked.slots[i];
+                if (e->t0 == t0 && e->t1 == t1) {
+                        if (!CheckIsLive(e)) {
+                                return false;
+                        }
+                        CheckHits += 1;
+                        *ok = e->ok;
+                        return true;
+                }
+        }
+
+        return false;
+}
+
+// The slot for (t0, t1): its current entry, a dead one, or an empty one
+static CheckEntry *
+CheckSlot(Type const *t0, Type const *t1)
+{
+        u32 i = CheckHash(t0, t1) & Checked.mask;
+
+        for (;;) {
+                CheckEntry *e = &Checked.slots[i];
+                if (
+                        (e->t0 == NULL)
+                     || (e->t0 == t0 && e->t1 == t1)
+                     || !CheckIsLive(e)
+                ) {
+                        return e;
+                }
+                i = (i + 1) & Checked.mask;
+        }
+}
+
+static void
+RememberCheck(Type const *t0, Type const *t1, bool ok)
+{
+        while (vN(LevelEpoch) <= CurrentLevel) {
+                xvP(LevelEpoch, 0);
+        }
+
+        if (2 * (Checked.count + 1) > Checked.mask) {
+                CheckEntry *old = Checked.slots;
+                u32 n = (old == NULL) ? 0 : Checked.mask + 1;
+                u32 cap = (n == 0) ? 1024 : 2 * n;
+
+                Checked.slots = mrealloc(NULL, cap * sizeof (CheckEntry));
+                Checked.mask  = cap - 1;
+                Checked.count = 0;
+                memset(Checked.slots, 0, cap * sizeof (CheckEntry));
+
+                for (u32 i = 0; i < n; ++i) {
+                        if (CheckIsLive(&old[i])) {
+                                *CheckSlot(old[i].t0, old[i].t1) = old[i];
+                                Checked.count += 1;
+                        }
+                }
+
+                xmF(old);
+        }
+
+        CheckEntry *e = CheckSlot(t0, t1);
+
+        if (e->t0 == NULL) {
+                Checked.count += 1;
+        }
+
+        e->t0    = t0;
+        e->t1    = t1;
+        e->level = CurrentLevel;
+        e->epoch = v__(LevelEpoch, CurrentLevel);
+        e->ok    = ok;
+}
+
+void
+types_forget_checks(Ty *ty)
+{
+        if (Checked.slots != NULL) {
+                memset(Checked.slots, 0, (Checked.mask + 1) * sizeof (CheckEntry));
+                Checked.count = 0;
+        }
+}
+
 bool
 type_check(Ty *ty, Type *t0, Type *t1)
 {
-        static TypeMemo memo;
-
         if (!FuelCheck(ty)) {
                 return false;
         }
@@ -8511,18 +9129,24 @@ type_check(Ty *ty, Type *t0, Type *t1)
         checks = 0;
 
         bool ok;
-        if (false && CheckMemo(&memo, t0, t1, &ok)) {
+
+        Type const *c0 = (ENABLED && d == 0) ? CheckKey(t0) : NULL;
+        Type const *c1 = (c0 != NULL) ? CheckKey(t1) : NULL;
+
+        if (c1 != NULL && FindCheck(c0, c1, &ok)) {
                 return ok;
         }
 
+        u64 start = CheckClockStart();
         ok = !ENABLED || type_check_x(ty, t0, t1, false);
+        CheckClockStop(start);
 
         TLOG("%stype_check_x():%s", ok ? TERM(92) : TERM(91), TERM(0));
         TLOG("    %s", ShowType(t0));
         TLOG("    %s", ShowType(t1));
 
-        if (false && checks > 8 && IsConcrete(t0) && IsConcrete(t1)) {
-                AddMemo(&memo, t0, t1, ok);
+        if (c1 != NULL) {
+                RememberCheck(c0, c1, ok);
         }
 
         return ok;
@@ -11342,6 +11966,7 @@ types_init(Ty *ty)
         v0(ToSolve);
         v0(FunStack);
         v0(EnvStack);
+        types_forget_checks(ty);
         PushEnv();
         EnterScope();
 }
@@ -12038,4 +12663,186 @@ type_guess_class_of(Ty *ty, Type const *t0)
         return class_get(ty, class);
 }
 
+/*
+ * Per-module statistics for --type-stats: the CPU time spent compiling the
+ * module up to code generation (parsing, name resolution and type inference),
+ * the part of that spent unifying and checking types, fuel burned, how often
+ * type_check() found its answer in the memo, and how often a closed type was
+ * already interned.
+ *
+ * Counters are global and always running; whenever the module being compiled
+ * changes, what accumulated since the last switch is credited to the module on
+ * top of the stack. A NULL module (e.g. while an imported module's top-level
+ * code runs) credits nobody.
+ */
+typedef struct {
+        char const *module;
+        u64 time;
+        u64 check_time;
+        u64 fuel;
+        u64 unify;
+        u64 check_lookups;
+        u64 check_hits;
+        u64 intern_lookups;
+        u64 intern_hits;
+        u64 allocs;
+} TypeStatsEntry;
+
+static vec(TypeStatsEntry) StatsModules;
+static vec(isize) StatsStack;
+static TypeStatsEntry StatsMark;
+
+static TypeStatsEntry
+StatsNow(void)
+{
+        return (TypeStatsEntry) {
+                .time           = TyThreadCPUTime(),
+                .check_time     = CheckTime,
+                .fuel           = FuelUsed,
+                .unify          = TypeCheckCounter,
+                .check_lookups  = CheckLookups,
+                .check_hits     = CheckHits,
+                .intern_lookups = InternLookups,
+                .intern_hits    = InternHits,
+                .allocs         = TypeAllocCounter
+        };
+}
+
+static void
+StatsFlush(void)
+{
+        TypeStatsEntry now = StatsNow();
+
+        if (vN(StatsStack) > 0 && *vvL(StatsStack) >= 0) {
+                TypeStatsEntry *m = v_(StatsModules, *vvL(StatsStack));
+                m->time           += now.time           - StatsMark.time;
+                m->check_time     += now.check_time     - StatsMark.check_time;
+                m->fuel           += now.fuel           - StatsMark.fuel;
+                m->unify          += now.unify          - StatsMark.unify;
+                m->check_lookups  += now.check_lookups  - StatsMark.check_lookups;
+                m->check_hits     += now.check_hits     - StatsMark.check_hits;
+                m->intern_lookups += now.intern_lookups - StatsMark.intern_lookups;
+                m->intern_hits    += now.intern_hits    - StatsMark.intern_hits;
+                m->allocs         += now.allocs         - StatsMark.allocs;
+        }
+
+        StatsMark = now;
+}
+
+int
+types_stats_begin(Ty *ty, char const *module)
+{
+        if (!TypeStats) {
+                return 0;
+        }
+
+        StatsFlush();
+
+        isize i = -1;
+
+        if (module != NULL) {
+                for (i = 0; i < vN(StatsModules); ++i) {
+                        if (s_eq(v_(StatsModules, i)->module, module)) {
+                                break;
+                        }
+                }
+                if (i == vN(StatsModules)) {
+                        xvP(StatsModules, ((TypeStatsEntry) { .module = S2(module) }));
+                }
+        }
+
+        xvP(StatsStack, i);
+
+        return vN(StatsStack) - 1;
+}
+
+void
+types_stats_end(Ty *ty, int depth)
+{
+        if (!TypeStats) {
+                return;
+        }
+
+        StatsFlush();
+
+        // We might be unwinding from a compile error
+        if (vN(StatsStack) > depth) {
+                vN(StatsStack) = depth;
+        }
+}
+
+static int
+StatsCompare(void const *a, void const *b)
+{
+        TypeStatsEntry const *m0 = a;
+        TypeStatsEntry const *m1 = b;
+
+        return (m0->time < m1->time) - (m0->time > m1->time);
+}
+
+inline static double
+Percent(u64 n, u64 d)
+{
+        return (d == 0) ? 0.0 : (100.0 * n / d);
+}
+
+static void
+StatsRow(FILE *f, TypeStatsEntry const *m)
+{
+        fprintf(
+                f,
+                "%-28.28s %10.2f %10.2f %10"PRIu64" %10"PRIu64" %7.1f%% %7.1f%% %10"PRIu64"\n",
+                m->module,
+                m->time / 1.0e6,
+                m->check_time / 1.0e6,
+                m->fuel,
+                m->unify,
+                Percent(m->check_hits, m->check_lookups),
+                Percent(m->intern_hits, m->intern_lookups),
+                m->allocs
+        );
+}
+
+void
+types_stats_dump(void)
+{
+        StatsFlush();
+
+        TypeStatsEntry total = { .module = "(total)" };
+
+        for (int i = 0; i < vN(StatsModules); ++i) {
+                TypeStatsEntry const *m = v_(StatsModules, i);
+                total.time           += m->time;
+                total.check_time     += m->check_time;
+                total.fuel           += m->fuel;
+                total.unify          += m->unify;
+                total.check_lookups  += m->check_lookups;
+                total.check_hits     += m->check_hits;
+                total.intern_lookups += m->intern_lookups;
+                total.intern_hits    += m->intern_hits;
+                total.allocs         += m->allocs;
+        }
+
+        qsort(vv(StatsModules), vN(StatsModules), sizeof (TypeStatsEntry), StatsCompare);
+
+        fprintf(
+                stderr,
+                "%-28s %10s %10s %10s %10s %8s %8s %10s\n",
+                "module",
+                "total (ms)",
+                "check (ms)",
+                "fuel",
+                "unify",
+                "memo",
+                "intern",
+                "types"
+        );
+
+        for (int i = 0; i < vN(StatsModules); ++i) {
+                StatsRow(stderr, v_(StatsModules, i));
+        }
+
+        StatsRow(stderr, &total);
+}
+
 /* vim: set sts=8 sw=8 expandtab: */
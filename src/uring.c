@@ -0,0 +1,981 @@
+#include "value.h"
+#include "vm.h"
+#include "vec.h"
+#include "uring.h"
+
+#define BUILTIN(f)    { .type = VALUE_BUILTIN_FUNCTION, .builtin_function = (f), .tags = 0 }
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+
+/*
+ * io_uring without liburing: the rings are mapped and driven directly with
+ * the three raw syscalls.
+ *
+ * Every submitted request gets a slot, and the slot index is the request's
+ * user_data. The slot owns whatever has to outlive the call that submitted
+ * the request: a copy of the path for opens and stats, a copy of String data
+ * for writes, the statx buffer. Blob buffers are used in place and pinned with
+ * NOGC() until the request completes, so the kernel reads and writes the same
+ * memory the script sees.
+ */
+
+enum {
+        U_READ,
+        U_WRITE,
+        U_OPEN,
+        U_STAT,
+        U_ACCEPT,
+        U_CLOSE,
+        U_READ_FIXED,
+        U_WRITE_FIXED
+};
+
+typedef struct {
+        u8 op;
+        bool busy;
+        Blob *blob;
+        usize base;
+        void *own;
+        usize index;
+        i32 next;
+} UringSlot;
+
+typedef struct {
+        int fd;
+
+        u32 *sq_head;
+        u32 *sq_tail;
+        u32 sq_mask;
+        u32 sq_entries;
+        u32 *sq_array;
+        struct io_uring_sqe *sqes;
+
+        u32 *cq_head;
+        u32 *cq_tail;
+        u32 cq_mask;
+        struct io_uring_cqe *cqes;
+
+        void *sq_ring;
+        void *cq_ring;
+        usize sq_ring_size;
+        usize cq_ring_size;
+        usize sqes_size;
+
+        u32 queued;
+        u32 inflight;
+
+        UringSlot *slots;
+        u32 nslots;
+        i32 free;
+
+        Blob **fixed;
+        u32 nfixed;
+} Uring;
+
+static _Thread_local int error;
+
+inline static int
+uring_enter(Uring *r, u32 submit, u32 wait)
+{
+        return syscall(
+                __NR_io_uring_enter,
+                r->fd,
+                submit,
+                wait,
+                (wait > 0) ? IORING_ENTER_GETEVENTS : 0,
+                NULL,
+                0
+        );
+}
+
+static Value
+setup(Ty *ty, int argc, Value *kwargs)
+{
+        ASSERT_ARGC("uring.setup()", 1);
+
+        // Completions are only ever looked at from io_uring_enter() or right
+        // after it, so the kernel needn't interrupt us to post them. Older
+        // kernels don't know the flag.
+        struct io_uring_params p = { .flags = IORING_SETUP_COOP_TASKRUN };
+        int fd = syscall(__NR_io_uring_setup, (u32)INT_ARG(0), &p);
+
+        if (fd < 0 && errno == EINVAL) {
+                p = (struct io_uring_params){0};
+                fd = syscall(__NR_io_uring_setup, (u32)INT_ARG(0), &p);
+        }
+
+        if (fd < 0) {
+                error = errno;
+                return NIL;
+        }
+
+        Uring *r = xmA(sizeof *r);
+        memset(r, 0, sizeof *r);
+
+        r->fd = fd;
+        r->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof (u32);
+        r->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe);
+
+        if (p.features & IORING_FEAT_SINGLE_MMAP) {
+                r->sq_ring_size = max(r->sq_ring_size, r->cq_ring_size);
+                r->cq_ring_size = r->sq_ring_size;
+        }
+
+        r->sq_ring = mmap(
+                NULL,
+                r->sq_ring_size,
+                PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE,
+                fd,
+                IORING_OFF_SQ_RING
+        );
+
+        if (r->sq_ring == MAP_FAILED) {
+                goto Fail;
+        }
+
+        if (p.features & IORING_FEAT_SINGLE_MMAP) {
+                r->cq_ring = r->sq_ring;
+        } else {
+                r->cq_ring = mmap(
+                        NULL,
+                        r->cq_ring_size,
+                        PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE,
+                        fd,
+                        IORING_OFF_CQ_RING
+                );
+                if (r->cq_ring == MAP_FAILED) {
+                        munmap(r->sq_ring, r->sq_ring_size);
+                        goto Fail;
+                }
+        }
+
+        r->sqes_size = p.sq_entries * sizeof (struct io_uring_sqe);
+        r->sqes = mmap(
+                NULL,
+                r->sqes_size,
+                PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE,
+                fd,
+                IORING_OFF_SQES
+        );
+
+        if (r->sqes == MAP_FAILED) {
+                if (r->cq_ring != r->sq_ring) {
+                        munmap(r->cq_ring, r->cq_ring_size);
+                }
+                munmap(r->sq_ring, r->sq_ring_size);
+                goto Fail;
+        }
+
+        u8 *sq = r->sq_ring;
+        u8 *cq = r->cq_ring;
+
+        r->sq_head    = (u32 *)(sq + p.sq_off.head);
+        r->sq_tail    = (u32 *)(sq + p.sq_off.tail);
+        r->sq_mask    = *(u32 *)(sq + p.sq_off.ring_mask);
+        r->sq_entries = p.sq_entries;
+        r->sq_array   = (u32 *)(sq + p.sq_off.array);
+
+        r->cq_head = (u32 *)(cq + p.cq_off.head);
+        r->cq_tail = (u32 *)(cq + p.cq_off.tail);
+        r->cq_mask = *(u32 *)(cq + p.cq_off.ring_mask);
+        r->cqes    = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+        // Never more requests in flight than the completion ring can hold
+        r->nslots = p.cq_entries;
+        r->slots = xmA(r->nslots * sizeof *r->slots);
+
+        for (u32 i = 0; i < r->nslots; ++i) {
+                r->slots[i] = (UringSlot){ .next = (i + 1 < r->nslots) ? i + 1 : -1 };
+        }
+
+        r->free = 0;
+
+        return PTR(r);
+
+Fail:
+        error = errno;
+        close(fd);
+        xmF(r);
+        return NIL;
+}
+
+/*
+ * Claims a slot and a submission queue entry for a new request. Returns NULL
+ * (with error = EBUSY) when the completion ring could overflow, in which case
+ * completions have to be reaped first.
+ */
+static struct io_uring_sqe *
+new_request(Uring *r, u8 op, i32 *id)
+{
+        if (r->free < 0) {
+                error = EBUSY;
+                return NULL;
+        }
+
+        u32 tail = *r->sq_tail;
+        u32 head = atomic_load_explicit((_Atomic u32 *)r->sq_head, memory_order_acquire);
+
+        if (tail - head == r->sq_entries) {
+                int n = uring_enter(r, r->queued, 0);
+                if (n < 0) {
+                        error = errno;
+                        return NULL;
+                }
+                r->queued -= n;
+                head = atomic_load_explicit((_Atomic u32 *)r->sq_head, memory_order_acquire);
+                if (tail - head == r->sq_entries) {
+                        error = EBUSY;
+                        return NULL;
+                }
+        }
+
+        *id = r->free;
+
+        UringSlot *slot = &r->slots[*id];
+        r->free = slot->next;
+        *slot = (UringSlot){ .op = op, .busy = true, .next = -1 };
+
+        u32 idx = tail & r->sq_mask;
+        struct io_uring_sqe *sqe = &r->sqes[idx];
+
+        memset(sqe, 0, sizeof *sqe);
+        sqe->user_data = *id;
+
+        r->sq_array[idx] = idx;
+        atomic_store_explicit((_Atomic u32 *)r->sq_tail, tail + 1, memory_order_release);
+
+        r->queued += 1;
+        r->inflight += 1;
+
+        return sqe;
+}
+
+static void
+release(Uring *r, i32 id)
+{
+        UringSlot *slot = &r->slots[id];
+
+        if (slot->blob != NULL) {
+                OKGC(slot->blob);
+        }
+
+        xmF(slot->own);
+
+        *slot = (UringSlot){ .next = r->free };
+        r->free = id;
+        r->inflight -= 1;
+}
+
+inline static char *
+c_string(Value const *s)
+{
+        char *p = xmA(sN(*s) + 1);
+        memcpy(p, ss(*s), sN(*s));
+        p[sN(*s)] = '\0';
+        return p;
+}
+
+static i32
+prep_read(Ty *ty, Uring *r, int fd, Blob *b, i64 n, i64 off)
+{
+        i32 id;
+        struct io_uring_sqe *sqe = new_request(r, U_READ, &id);
+        if (sqe == NULL) {
+                return -1;
+        }
+
+        uvR(*b, vN(*b) + n);
+        NOGC(b);
+
+        r->slots[id].blob = b;
+        r->slots[id].base = vN(*b);
+
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = fd;
+        sqe->addr = (uintptr_t)(vv(*b) + vN(*b));
+        sqe->len = n;
+        sqe->off = (u64)off;
+
+        return id;
+}
+
+static i32
+prep_write(Uring *r, int fd, Value const *data, i64 off)
+{
+        i32 id;
+        struct io_uring_sqe *sqe = new_request(r, U_WRITE, &id);
+        if (sqe == NULL) {
+                return -1;
+        }
+
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->fd = fd;
+        sqe->off = (u64)off;
+
+        if (data->type == VALUE_BLOB) {
+                NOGC(data->blob);
+                r->slots[id].blob = data->blob;
+                sqe->addr = (uintptr_t)vv(*data->blob);
+                sqe->len = vN(*data->blob);
+        } else {
+                r->slots[id].own = c_string(data);
+                sqe->addr = (uintptr_t)r->slots[id].own;
+                sqe->len = sN(*data);
+        }
+
+        return id;
+}
+
+static i32
+prep_open(Uring *r, Value const *path, int flags, int mode)
+{
+        i32 id;
+        struct io_uring_sqe *sqe = new_request(r, U_OPEN, &id);
+        if (sqe == NULL) {
+                return -1;
+        }
+
+        r->slots[id].own = c_string(path);
+
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (uintptr_t)r->slots[id].own;
+        sqe->open_flags = flags | O_CLOEXEC;
+        sqe->len = mode;
+
+        return id;
+}
+
+static i32
+prep_stat(Uring *r, Value const *path)
+{
+        i32 id;
+        struct io_uring_sqe *sqe = new_request(r, U_STAT, &id);
+        if (sqe == NULL) {
+                return -1;
+        }
+
+        // The statx buffer goes right after the path so that one allocation
+        // covers both
+        usize n = (sN(*path) + 1 + 7) & ~(usize)7;
+        char *own = xmA(n + sizeof (struct statx));
+
+        memcpy(own, ss(*path), sN(*path));
+        own[sN(*path)] = '\0';
+
+        r->slots[id].own = own;
+        r->slots[id].base = n;
+
+        sqe->opcode = IORING_OP_STATX;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (uintptr_t)own;
+        sqe->len = STATX_BASIC_STATS;
+        sqe->off = (uintptr_t)(own + n);
+
+        return id;
+}
+
+static i32
+prep_close(Uring *r, int fd)
+{
+        i32 id;
+        struct io_uring_sqe *sqe = new_request(r, U_CLOSE, &id);
+        if (sqe == NULL) {
+                return -1;
+        }
+
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = fd;
+
+        return id;
+}
+
+static Value
+read_(Ty *ty, int argc, Value *kwargs)
+{
+        ASSERT_ARGC("uring.read()", 5);
+        return INTEGER(prep_read(ty, PTR_ARG(0), INT_ARG(1), ARGx(2, VALUE_BLOB).blob, INT_ARG(3), INT_ARG(4)));
+}
+
+static Value
+write_(Ty *ty, int argc, Value *kwargs)
+{
+        ASSERT_ARGC("uring.write()", 4);
+        Value data = ARGx(2, VALUE_BLOB, VALUE_STRING);
+        return INTEGER(prep_write(PTR_ARG(0), INT_ARG(1), &data, INT_ARG(3)));
+}
+
+static Value
+open_(Ty *ty, int argc, Value *kwargs)
+{
+        ASSERT_ARGC("uring.open()", 4);
+        Value path = ARGx(1, VALUE_STRING);
+        return INTEGER(prep_open(PTR_ARG(0), &path, INT_ARG(2), INT_ARG(3)));
+}
+
+static Value
+stat_(Ty *ty, int argc, Value *kwargs)
+{
+        ASSERT_ARGC("uring.stat()", 2);
+        Value path = ARGx(1, VALUE_STRING);
+        return INTEGER(prep_stat(PTR_ARG(0), &path));
+}
+
+static Value
+accept_(Ty *ty, int argc, Value *kwargs)
+{
+        ASSERT_ARGC("uring.accept()", 2);
+
+        Uring *r = PTR_ARG(0);
+
+        i32 id;
+        struct io_uring_sqe *sqe = new_request(r, U_ACCEPT, &id);
+        if (sqe == NULL) {
+                return INTEGER(-1);
+        }
+
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = INT_ARG(1);
+        sqe->accept_flags = SOCK_CLOEXEC;
+
+        return INTEGER(id);
+}
+
+static Value
+close_(Ty *ty, int argc, Value *kwargs)
+{
+        ASSERT_ARGC("uring.close()", 2);
+        return INTEGER(prep_close(PTR_ARG(0), INT_ARG(1)));
+}
+
+static Value
+fixed(Ty *ty, int argc, Value *kwargs, bool write)
+{
+        ASSERT_ARGC("uring.fixed()", 5);
+
+        Uring *r = PTR_ARG(0);
+        int fd = INT_ARG(1);
+        i64 i = INT_ARG(2);
+        i64 n = INT_ARG(3);
+        i64 off = INT_ARG(4);
+
+        if (i < 0 || i >= r->nfixed) {
+                zP("uring: no registered buffer %"PRIi64, i);
+        }
+
+        Blob *b = r->fixed[i];
+
+        if (write) {
+                n = vN(*b);
+        } else if (n < 0 || n > vC(*b)) {
+                n = vC(*b);
+        }
+
+        i32 id;
+        struct io_uring_sqe *sqe = new_request(r, write ? U_WRITE_FIXED : U_READ_FIXED, &id);
+        if (sqe == NULL) {
+                return INTEGER(-1);
+        }
+
+        r->slots[id].base = i;
+
+        sqe->opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+        sqe->fd = fd;
+        sqe->addr = (uintptr_t)vv(*b);
+        sqe->len = n;
+        sqe->off = (u64)off;
+        sqe->buf_index = i;
+
+        return INTEGER(id);
+}
+
+static Value
+read_fixed(Ty *ty, int argc, Value *kwargs)
+{
+        return fixed(ty, argc, kwargs, false);
+}
+
+static Value
+write_fixed(Ty *ty, int argc, Value *kwargs)
+{
+        return fixed(ty, argc, kwargs, true);
+}
+
+static Value
+submit(Ty *ty, int argc, Value *kwargs)
+{
+        ASSERT_ARGC("uring.submit()", 1);
+
+        Uring *r = PTR_ARG(0);
+
+        if (r->queued == 0) {
+                return INTEGER(0);
+        }
+
+        int n = uring_enter(r, r->queued, 0);
+        if (n < 0) {
+                error = errno;
+                return INTEGER(-1);
+        }
+
+        r->queued -= n;
+
+        return INTEGER(n);
+}
+
+static Value
+stat_value(Ty *ty, struct statx const *st)
+{
+        return vTn(
+                "dev", INTEGER(makedev(st->stx_dev_major, st->stx_dev_minor)),
+                "ino", INTEGER(st->stx_ino),
+                "mode", INTEGER(st->stx_mode),
+                "nlink", INTEGER(st->stx_nlink),
+                "uid", INTEGER(st->stx_uid),
+                "gid", INTEGER(st->stx_gid),
+                "rdev", INTEGER(makedev(st->stx_rdev_major, st->stx_rdev_minor)),
+                "size", INTEGER(st->stx_size),
+                "blocks", INTEGER(st->stx_blocks),
+                "blksize", INTEGER(st->stx_blksize),
+                "atime", REAL(st->stx_atime.tv_sec + st->stx_atime.tv_nsec / 1.0e9),
+                "mtime", REAL(st->stx_mtime.tv_sec + st->stx_mtime.tv_nsec / 1.0e9),
+                "ctime", REAL(st->stx_ctime.tv_sec + st->stx_ctime.tv_nsec / 1.0e9)
+        );
+}
+
+static Value
+completion(Ty *ty, Uring *r, i32 id, i32 res)
+{
+        UringSlot *slot = &r->slots[id];
+
+        switch (slot->op) {
+        case U_READ:
+                if (res >= 0) {
+                        vN(*slot->blob) = slot->base + res;
+                        return BLOB(slot->blob);
+                }
+                break;
+
+        case U_STAT:
+                if (res == 0) {
+                        return stat_value(ty, (struct statx *)((char *)slot->own + slot->base));
+                }
+                break;
+
+        case U_READ_FIXED:
+                if (res >= 0) {
+                        vN(*r->fixed[slot->base]) = res;
+                }
+                return BLOB(r->fixed[slot->base]);
+        }
+
+        return NIL;
+}
+
+/*
+ * Returns the completions that are ready, first waiting until there are at
+ * least min of them (submitting anything still queued on the way). Each one
+ * is (id, result, value): result is what the syscall would have returned, or
+ * -errno, and value is the Blob that was read into or the stat record.
+ */
+static Value
+reap(Ty *ty, int argc, Value *kwargs)
+{
+        ASSERT_ARGC("uring.reap()", 1, 2);
+
+        Uring *r = PTR_ARG(0);
+        u32 want = min((argc == 2) ? INT_ARG(1) : 0, r->inflight);
+
+        u32 head = *r->cq_head;
+        u32 tail = atomic_load_explicit((_Atomic u32 *)r->cq_tail, memory_order_acquire);
+
+        // Even when not waiting, go through the kernel if nothing has shown up
+        // yet: completions handed off to a worker thread are only posted on
+        // the way out of a syscall
+        if (tail - head < want || r->queued > 0 || (tail == head && r->inflight > 0)) {
+                u32 wait = (tail - head < want) ? want - (tail - head) : 0;
+
+                UnlockTy();
+                int n = uring_enter(r, r->queued, wait);
+                LockTy();
+
+                if (n < 0 && errno != EINTR) {
+                        error = errno;
+                        return NIL;
+                }
+
+                if (n > 0) {
+                        r->queued -= n;
+                }
+
+                tail = atomic_load_explicit((_Atomic u32 *)r->cq_tail, memory_order_acquire);
+        }
+
+        Array *done = vA();
+        gP(&ARRAY(done));
+
+        for (; head != tail; ++head) {
+                struct io_uring_cqe const *cqe = &r->cqes[head & r->cq_mask];
+                i32 id = cqe->user_data;
+                Value v = completion(ty, r, id, cqe->res);
+
+                gP(&v);
+                vAp(done, vTn("id", INTEGER(id), "result", INTEGER(cqe->res), "value", v));
+                gX();
+
+                release(r, id);
+        }
+
+        atomic_store_explicit((_Atomic u32 *)r->cq_head, head, memory_order_release);
+
+        gX();
+
+        return ARRAY(done);
+}
+
+/*
+ * Runs one request of the given kind for each element of xs and waits for
+ * all of them, keeping up to a ring's worth in flight at a time. The results
+ * come back in the same order as xs: the Blob or stat record for reads and
+ * stats (nil on failure), the syscall's result for everything else.
+ *
+ * This is the path for bulk work, where creating and matching up
+ * completions one at a time in the script would cost more than the syscalls
+ * being saved.
+ */
+static Value
+batch(Ty *ty, char const *_name__, Uring *r, u8 op, Array const *xs, i64 a, i64 b)
+{
+        if (r->inflight > 0) {
+                zP("%s: there are still requests pending on this ring", _name__);
+        }
+
+        Array *out = vA();
+        gP(&ARRAY(out));
+
+        for (usize i = 0; i < vN(*xs); ++i) {
+                vAp(out, NIL);
+        }
+
+        usize i = 0;
+
+        while (i < vN(*xs) || r->inflight > 0) {
+                for (; i < vN(*xs); ++i) {
+                        Value const *x = v_(*xs, i);
+                        i32 id;
+
+                        switch (op) {
+                        case U_READ:
+                        case U_CLOSE:
+                                if (x->type != VALUE_INTEGER) {
+                                        zP("%s: expected Int but got: %s", _name__, VSC(x));
+                                }
+                                id = (op == U_READ)
+                                   ? prep_read(ty, r, x->z, value_blob_new(ty), a, b)
+                                   : prep_close(r, x->z);
+                                break;
+
+                        default:
+                                if (x->type != VALUE_STRING) {
+                                        zP("%s: expected String but got: %s", _name__, VSC(x));
+                                }
+                                id = (op == U_OPEN)
+                                   ? prep_open(r, x, a, b)
+                                   : prep_stat(r, x);
+                        }
+
+                        if (id < 0) {
+                                break;
+                        }
+
+                        r->slots[id].index = i;
+                }
+
+                if (i < vN(*xs) && error != EBUSY) {
+                        zP("%s: io_uring_enter(): %s", _name__, strerror(error));
+                }
+
+                UnlockTy();
+                int n = uring_enter(r, r->queued, r->inflight);
+                LockTy();
+
+                if (n < 0 && errno != EINTR) {
+                        zP("%s: io_uring_enter(): %s", _name__, strerror(errno));
+                }
+
+                if (n > 0) {
+                        r->queued -= n;
+                }
+
+                u32 head = *r->cq_head;
+                u32 tail = atomic_load_explicit((_Atomic u32 *)r->cq_tail, memory_order_acquire);
+
+                for (; head != tail; ++head) {
+                        struct io_uring_cqe const *cqe = &r->cqes[head & r->cq_mask];
+                        i32 id = cqe->user_data;
+                        Value *dst = v_(*out, r->slots[id].index);
+
+                        if (op == U_READ || op == U_STAT) {
+                                *dst = completion(ty, r, id, cqe->res);
+                        } else {
+                                *dst = INTEGER(cqe->res);
+                        }
+
+                        if (cqe->res < 0) {
+                                error = -cqe->res;
+                        }
+
+                        release(r, id);
+                }
+
+                atomic_store_explicit((_Atomic u32 *)r->cq_head, head, memory_order_release);
+        }
+
+        gX();
+
+        return ARRAY(out);
+}
+
+static Value
+open_all(Ty *ty, int argc, Value *kwargs)
+{
+        ASSERT_ARGC("uring.openAll()", 4);
+        return batch(ty, _name__, PTR_ARG(0), U_OPEN, ARGx(1, VALUE_ARRAY).array, INT_ARG(2), INT_ARG(3));
+}
+
+static Value
+stat_all(Ty *ty, int argc, Value *kwargs)
+{
+        ASSERT_ARGC("uring.statAll()", 2);
+        return batch(ty, _name__, PTR_ARG(0), U_STAT, ARGx(1, VALUE_ARRAY).array, 0, 0);
+}
+
+static Value
+read_all(Ty *ty, int argc, Value *kwargs)
+{
+        ASSERT_ARGC("uring.readAll()", 4);
+        return batch(ty, _name__, PTR_ARG(0), U_READ, ARGx(1, VALUE_ARRAY).array, INT_ARG(2), INT_ARG(3));
+}
+
+static Value
+close_all(Ty *ty, int argc, Value *kwargs)
+{
+        ASSERT_ARGC("uring.closeAll()", 2);
+        return batch(ty, _name__, PTR_ARG(0), U_CLOSE, ARGx(1, VALUE_ARRAY).array, 0, 0);
+}
+
+/*
+ * Allocates n Blobs of the given capacity and registers them with the kernel,
+ * which can then read and write them without mapping the pages in for every
+ * request. The Blobs must not grow past their capacity while registered.
+ */
+static Value
+register_buffers(Ty *ty, int argc, Value *kwargs)
+{
+        ASSERT_ARGC("uring.register()", 3);
+
+        Uring *r = PTR_ARG(0);
+        i64 n = INT_ARG(1);
+        i64 size = INT_ARG(2);
+
+        if (r->nfixed > 0) {
+                zP("uring.register(): buffers are already registered");
+        }
+
+        if (n <= 0 || size <= 0) {
+                zP("uring.register(): bad buffer count or size");
+        }
+
+        SCRATCH_SAVE();
+
+        struct iovec *iov = smA(n * sizeof *iov);
+        Array *blobs = vA();
+
+        gP(&ARRAY(blobs));
+
+        r->fixed = xmA(n * sizeof *r->fixed);
+
+        for (i64 i = 0; i < n; ++i) {
+                Blob *b = value_blob_new(ty);
+                NOGC(b);
+                uvR(*b, size);
+                r->fixed[i] = b;
+                iov[i] = (struct iovec){ .iov_base = vv(*b), .iov_len = size };
+                vAp(blobs, BLOB(b));
+        }
+
+        r->nfixed = n;
+
+        int ret = syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_BUFFERS, iov, (u32)n);
+
+        SCRATCH_RESTORE();
+        gX();
+
+        if (ret < 0) {
+                error = errno;
+                for (u32 i = 0; i < r->nfixed; ++i) {
+                        OKGC(r->fixed[i]);
+                }
+                xmF(r->fixed);
+                r->fixed = NULL;
+                r->nfixed = 0;
+                return NIL;
+        }
+
+        return ARRAY(blobs);
+}
+
+static void
+unregister(Uring *r)
+{
+        if (r->nfixed == 0) {
+                return;
+        }
+
+        syscall(__NR_io_uring_register, r->fd, IORING_UNREGISTER_BUFFERS, NULL, 0);
+
+        for (u32 i = 0; i < r->nfixed; ++i) {
+                OKGC(r->fixed[i]);
+        }
+
+        xmF(r->fixed);
+        r->fixed = NULL;
+        r->nfixed = 0;
+}
+
+static Value
+unregister_buffers(Ty *ty, int argc, Value *kwargs)
+{
+        ASSERT_ARGC("uring.unregister()", 1);
+        unregister(PTR_ARG(0));
+        return NIL;
+}
+
+static Value
+pending(Ty *ty, int argc, Value *kwargs)
+{
+        ASSERT_ARGC("uring.pending()", 1);
+        return INTEGER(((Uring *)PTR_ARG(0))->inflight);
+}
+
+/*
+ * The kernel tears a ring down asynchronously, so requests still in flight
+ * may go on reading and writing their memory after close(). Their blobs stay
+ * pinned and the strings and statx buffers they own are leaked, and so are
+ * the registered buffers.
+ */
+static Value
+destroy(Ty *ty, int argc, Value *kwargs)
+{
+        ASSERT_ARGC("uring.destroy()", 1);
+
+        Uring *r = PTR_ARG(0);
+
+        if (r->inflight == 0) {
+                unregister(r);
+        }
+
+        munmap(r->sqes, r->sqes_size);
+        if (r->cq_ring != r->sq_ring) {
+                munmap(r->cq_ring, r->cq_ring_size);
+        }
+        munmap(r->sq_ring, r->sq_ring_size);
+        close(r->fd);
+
+        xmF(r->slots);
+        xmF(r);
+
+        return NIL;
+}
+
+static Value
+available(Ty *ty, int argc, Value *kwargs)
+{
+        ASSERT_ARGC("uring.available()", 0);
+
+        struct io_uring_params p = {0};
+        int fd = syscall(__NR_io_uring_setup, 1, &p);
+
+        if (fd < 0) {
+                return BOOLEAN(false);
+        }
+
+        close(fd);
+
+        return BOOLEAN(true);
+}
+
+static Value
+get_error(Ty *ty, int argc, Value *kwargs)
+{
+        ASSERT_ARGC("uring.error()", 0);
+        return INTEGER(error);
+}
+
+static struct {
+        char const *name;
+        Value value;
+} builtins[] = {
+        { .name = "available",  .value = BUILTIN(available)          },
+        { .name = "setup",      .value = BUILTIN(setup)              },
+        { .name = "destroy",    .value = BUILTIN(destroy)            },
+        { .name = "read",       .value = BUILTIN(read_)              },
+        { .name = "write",      .value = BUILTIN(write_)             },
+        { .name = "open",       .value = BUILTIN(open_)              },
+        { .name = "stat",       .value = BUILTIN(stat_)              },
+        { .name = "accept",     .value = BUILTIN(accept_)            },
+        { .name = "close",      .value = BUILTIN(close_)             },
+        { .name = "readFixed",  .value = BUILTIN(read_fixed)         },
+        { .name = "writeFixed", .value = BUILTIN(write_fixed)        },
+        { .name = "submit",     .value = BUILTIN(submit)             },
+        { .name = "reap",       .value = BUILTIN(reap)               },
+        { .name = "openAll",    .value = BUILTIN(open_all)           },
+        { .name = "statAll",    .value = BUILTIN(stat_all)           },
+        { .name = "readAll",    .value = BUILTIN(read_all)           },
+        { .name = "closeAll",   .value = BUILTIN(close_all)          },
+        { .name = "register",   .value = BUILTIN(register_buffers)   },
+        { .name = "unregister", .value = BUILTIN(unregister_buffers) },
+        { .name = "pending",    .value = BUILTIN(pending)            },
+        { .name = "error",      .value = BUILTIN(get_error)          },
+        { .name = NULL                                               }
+};
+
+#else
+
+static Value
+available(Ty *ty, int argc, Value *kwargs)
+{
+        return BOOLEAN(false);
+}
+
+static struct {
+        char const *name;
+        Value value;
+} builtins[] = {
+        { .name = "available", .value = BUILTIN(available) },
+        { .name = NULL                                     }
+};
+
+#endif
+
+void
+uring_load(Ty *ty)
+{
+        vm_load_c_module(ty, "uringc", builtins);
+}
@@ -255,8 +255,10 @@ vdump(byte_vector *b, char const *fmt, va_list ap)
                 int avail = b->capacity - b->count;
                 int need;
 
+                // stb_sprintf zero-terminates at buf[count - 1] even when count
+                // is 0, which would clobber the last byte we already have
                 va_copy(ap_, ap);
-                need = ty_vsnprintf(b->items + b->count, avail, fmt, ap_);
+                need = ty_vsnprintf((avail > 0) ? b->items + b->count : NULL, avail, fmt, ap_);
                 va_end(ap_);
 
                 if (1 + need >= avail) {
@@ -281,7 +283,7 @@ dump(byte_vector *b, char const *fmt, ...)
                 isize need;
 
                 va_start(ap, fmt);
-                need = ty_vsnprintf(b->items + b->count, avail, fmt, ap);
+                need = ty_vsnprintf((avail > 0) ? b->items + b->count : NULL, avail, fmt, ap);
                 va_end(ap);
 
                 if (1 + need >= avail) {
@@ -306,7 +308,7 @@ avdump(Ty *ty, byte_vector *str, char const *fmt, va_list ap)
                 isize need;
 
                 va_copy(ap_, ap);
-                need = ty_vsnprintf(vZ(*str), avail, fmt, ap_);
+                need = ty_vsnprintf((avail > 0) ? vZ(*str) : NULL, avail, fmt, ap_);
                 va_end(ap_);
 
                 if (1 + need >= avail) {
@@ -344,7 +346,7 @@ scvdump(Ty *ty, byte_vector *str, char const *fmt, va_list ap)
                 isize need;
 
                 va_copy(ap_, ap);
-                need = ty_vsnprintf(vZ(*str), avail, fmt, ap_);
+                need = ty_vsnprintf((avail > 0) ? vZ(*str) : NULL, avail, fmt, ap_);
                 va_end(ap_);
 
                 if (1 + need >= avail) {
@@ -1509,7 +1509,7 @@ value_apply_predicate(Ty *ty, Value *p, Value *v)
                 }
 
                 int rc = pcre2_match(
-                        p->regex->pcre2,
+                        regex_code(p->regex),
                         (PCRE2_SPTR)ss(*v),
                         sN(*v),
                         0,
@@ -1807,7 +1807,7 @@ mark_trace(Ty *ty, ThrowCtx *ctx)
         MARK(ctx);
 
         if (DetailedExceptions) {
-                for (int i = 0; i < vN(*ctx); ++i) {
+                for (int i = 0; i < vN(ctx->locals); ++i) {
                         ValueVector *locals = v_(ctx->locals, i);
                         vfor(*locals, MarkNext(ty, it));
                 }
@@ -81,6 +81,9 @@
 #include "object.h"
 #include "operators.h"
 #include "sqlite.h"
+#include "uring.h"
+#include "sampler.h"
+#include "tracer.h"
 #include "str.h"
 #include "tags.h"
 #include "test.h"
@@ -210,6 +213,11 @@ static Value NILS[512];
 #define GC_IS_WAITING \
         atomic_load_explicit(&ty->group->WantGC, memory_order_relaxed)
 
+// Kept in every build, for ty.gcStats()
+static _Atomic(u64) GCCount;
+static _Atomic(u64) GCPauseTotal;
+static _Atomic(u64) GCPauseMax;
+
 #if defined(TY_GC_STATS)
 static u64 GCTimeTotal  = 0;
 static u64 GCTimeWait   = 0;
@@ -567,6 +575,7 @@ InitThreadGroup(ThreadGroup *group)
         TySpinLockInit(&group->DLock);
         TyMutexInit(&group->GCPhaseLock);
         TyCondVarInit(&group->GCPhaseCond);
+        TyMutexInit(&group->Regexes.lock);
         group->GCPhase = GC_PHASE_NONE;
         return group;
 }
@@ -637,6 +646,8 @@ WaitGC(Ty *ty)
         u64 start = TyThreadTime();
 #endif
 
+        u64 wait = TRACING() ? tracer_now() : 0;
+
         ReleaseLock(ty, false);
         int phase = WaitForGCPhase(ty, GC_PHASE_MARK | GC_PHASE_DONE);
         TakeLock(ty);
@@ -646,6 +657,9 @@ WaitGC(Ty *ty)
 #ifdef TY_PROFILER
                 LastThreadGCTime = TyThreadTime() - start;
 #endif
+                if (wait != 0) {
+                        tracer_complete("GC wait", "gc", wait, NULL);
+                }
                 return;
         }
 
@@ -662,9 +676,23 @@ WaitGC(Ty *ty)
         LastThreadGCTime = TyThreadTime() - start;
 #endif
 
+        if (wait != 0) {
+                tracer_complete("GC wait", "gc", wait, NULL);
+        }
+
         dont_printf("Thread %-3llu: %lluus\n", TID, (TyThreadTime() - start) / 1000);
 }
 
+// How many collections there have been, and how long they stopped the world
+// for in total and at most, in nanoseconds
+void
+GCStats(u64 *count, u64 *pause, u64 *max_pause)
+{
+        *count     = atomic_load_explicit(&GCCount, memory_order_relaxed);
+        *pause     = atomic_load_explicit(&GCPauseTotal, memory_order_relaxed);
+        *max_pause = atomic_load_explicit(&GCPauseMax, memory_order_relaxed);
+}
+
 void
 DoGC(Ty *ty)
 {
@@ -681,6 +709,16 @@ DoGC(Ty *ty)
         u64 heap  = MemoryUsed;
 #endif
 
+        u64 pause_start = TyMonotonicTime();
+
+        // Decided once, so that a trace never gets half of a collection
+        bool tracing = TRACING();
+
+        if (tracing) {
+                tracer_begin("GC", "gc");
+                tracer_begin("stop", "gc");
+        }
+
         GCLOG("Doing GC: ty->group = %p, (%zu threads)", ty->group, ty->group->ThreadList.count);
 
         TySpinLockLock(&ty->group->Lock);
@@ -734,6 +772,11 @@ DoGC(Ty *ty)
 
         StartGC(ty);
 
+        if (tracing) {
+                tracer_end();
+                tracer_begin("mark", "gc");
+        }
+
 #if defined(TY_GC_STATS)
         if (heap > GCMaxHeap) {
                 GCMaxHeap = heap;
@@ -771,6 +814,11 @@ DoGC(Ty *ty)
 
         NextGCPhase(ty, GC_PHASE_SWEEP, nRunning);
 
+        if (tracing) {
+                tracer_end();
+                tracer_begin("sweep", "gc");
+        }
+
 #if defined(TY_GC_STATS)
         u64 sweep = TyMonotonicTime();
 #endif
@@ -795,6 +843,10 @@ DoGC(Ty *ty)
         NextGCPhase(ty, GC_PHASE_DONE, nRunning);
         EndGC(ty);
 
+        if (tracing) {
+                tracer_end();
+        }
+
         TySpinLockUnlock(&ty->group->GCLock);
 
         UnlockThreads(ty, blockedThreads, nBlocked);
@@ -802,6 +854,23 @@ DoGC(Ty *ty)
 
         TySpinLockUnlock(&ty->group->Lock);
 
+        if (tracing) {
+                tracer_end();
+        }
+
+        u64 pause = TyMonotonicTime() - pause_start;
+        u64 max_pause = atomic_load_explicit(&GCPauseMax, memory_order_relaxed);
+
+        atomic_fetch_add_explicit(&GCCount, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&GCPauseTotal, pause, memory_order_relaxed);
+
+        while (
+                pause > max_pause
+             && !atomic_compare_exchange_weak(&GCPauseMax, &max_pause, pause)
+        ) {
+                continue;
+        }
+
         GCLOG("Unlocked ThreadsLock and GCLock on thread %llu", TID);
 
 #if defined(TY_GC_STATS) || defined(TY_PROFILER)
@@ -1445,20 +1514,30 @@ NewGenerator(Ty *ty, Value fun)
         return gen;
 }
 
+// The live stack of st: the running coroutine's is cached in ty->stack, and
+// only written back to its co_state when it's switched out
+inline static ValueVector const *
+CoStack(Ty *ty, co_state const *st)
+{
+        return (vv(st->frames) == vv(FRAMES)) ? &STACK : &st->stack;
+}
+
 static char const *
 co_up(Ty *ty, co_state *st)
 {
-        if (vN(st->frames) == 0 || vN(STACK) == 0) {
+        ValueVector const *stack = CoStack(ty, st);
+
+        if (vN(st->frames) == 0 || vN(*stack) == 0) {
                 return NULL;
         }
 
         usize n = vv(st->frames)->fp;
 
-        if (n == 0 || v_(STACK, n - 1)->type != VALUE_GENERATOR) {
+        if (n == 0 || v_(*stack, n - 1)->type != VALUE_GENERATOR) {
                 return NULL;
         }
 
-        Generator *gen = v_(STACK, n - 1)->gen;
+        Generator *gen = v_(*stack, n - 1)->gen;
 
         *st = *gen->st;
 
@@ -1728,7 +1807,7 @@ xcall(Ty *ty, Value const *f, Value const *pSelf, int argc, Value const *pKwargs
                 *v_(STACK, fp + np) = self;
         }
 
-        xvP(FRAMES, FRAME(fp, *f, IP));
+        PushFrame(ty, FRAME(fp, *f, IP));
         xvP(CALLS, whence);
 
         // Fill in kwargs (overwriting positional args)
@@ -1899,7 +1978,7 @@ call_co_ex(Ty *ty, Value *v, int n, char *whence)
                 put(*v);
         }
 
-        xvP(FRAMES, FRAME(vN(STACK), gen->f, whence));
+        PushFrame(ty, FRAME(vN(STACK), gen->f, whence));
         xvP(CALLS, whence);
         v_(gen->st->frames, 0)->ip = whence;
 
@@ -1933,6 +2012,34 @@ call_co(Ty *ty, Value *v, int n)
         call_co_ex(ty, v, n, IP);
 }
 
+/*
+ * Whether anyone could end up looking at the locals of the frames being
+ * unwound: the exception escapes (and gets its trace printed), or the handler
+ * that catches it uses what it caught and might call trace(). When the
+ * innermost handler that's sure to catch it doesn't, the IPs are enough.
+ */
+static bool
+WantDetailedTrace(Ty *ty)
+{
+        for (isize i = (isize)vN(TRY_STACK) - 1; i >= 0; --i) {
+                struct try const *t = v__(TRY_STACK, i);
+
+                if (t->state != TRY_TRY) {
+                        continue;
+                }
+
+                if (t->need_trace) {
+                        return true;
+                }
+
+                if (t->catch_all) {
+                        return false;
+                }
+        }
+
+        return true;
+}
+
 static ThrowCtx *
 PushThrowCtx(Ty *ty)
 {
@@ -1960,7 +2067,7 @@ PushThrowCtx(Ty *ty)
         vN(ctx->locals) = 0;
         //=========================================
 
-        if (DetailedExceptions) {
+        if (DetailedExceptions && WantDetailedTrace(ty)) {
                 CaptureContextEx(ty, ctx);
         } else {
                 CaptureContext(ty, ctx);
@@ -1998,6 +2105,10 @@ TakeLock(Ty *ty)
 {
         TySpinLockLock(ty->lock);
         ty->locked = true;
+
+        if (TRACING()) {
+                tracer_locked();
+        }
 }
 
 bool
@@ -2009,6 +2120,10 @@ MaybeTakeLock(Ty *ty)
 void
 ReleaseLock(Ty *ty, bool blocked)
 {
+        if (TRACING()) {
+                tracer_unlocked(blocked);
+        }
+
         *ty->blocked = blocked;
         ty->locked = false;
         TySpinLockUnlock(ty->lock);
@@ -2041,6 +2156,8 @@ NewThread(Ty *ty, Thread *t, Value *call, Value *name, bool isolated)
         TyCondVarInit(&t->cond);
         t->alive = true;
 
+        u64 create = TRACING() ? tracer_now() : 0;
+
         int r = TyThreadCreate(&t->t, vm_run_thread, ctx);
         if (r != 0) {
                 zP("TyThreadCreate(): %s", strerror(r));
@@ -2050,6 +2167,10 @@ NewThread(Ty *ty, Thread *t, Value *call, Value *name, bool isolated)
                 continue;
         }
 
+        if (create != 0) {
+                tracer_complete("thread.create", "thread", create, NULL);
+        }
+
         LockTy();
 }
 
@@ -2074,6 +2195,8 @@ CleanupThread(void *ctx)
 {
         Ty *ty = ctx;
 
+        sampler_thread_exit();
+
         GCLOG("Cleaning up thread: %zu bytes in use. DeadUsed = %zu", MemoryUsed, ty->group->DeadUsed);
 
         TySpinLockLock(&ty->group->DLock);
@@ -2110,6 +2233,9 @@ CleanupThread(void *ctx)
         for (int i = 0; i < vC(THROW_STACK); ++i) {
                 ThrowCtx *ctx = v__(THROW_STACK, i);
                 xvF(*ctx);
+                for (int j = 0; j < vC(ctx->locals); ++j) {
+                        xvF(v__(ctx->locals, j));
+                }
                 xvF(ctx->locals);
                 xmF(ctx);
         }
@@ -2582,6 +2708,8 @@ PushTry(Ty *ty)
 #endif
         t->ss    = SaveScratch(ty);
         t->state = TRY_TRY;
+        t->need_trace = false;
+        t->catch_all  = false;
         v0(t->defer);
 
         return t;
@@ -7072,6 +7200,12 @@ TargetMember:
 
                         READVALUE(n);
                         _try->end = (n == -1) ? NULL : IP + n;
+
+                        READVALUE(b);
+                        _try->need_trace = b;
+
+                        READVALUE(b);
+                        _try->catch_all = b;
                         break;
                 }
 
@@ -8422,7 +8556,7 @@ BinaryOp:
                                 break;
                         }
                         v = pop();
-                        xvP(FRAMES, v_0(v.gen->st->frames));
+                        PushFrame(ty, v_0(v.gen->st->frames));
                         vvL(FRAMES)->fp = vN(STACK);
                         xvPn(STACK, v_(v.gen->st->stack, 1), vN(v.gen->st->stack) - 1);
                         xvP(ty->co_states, v.gen->st);
@@ -8650,6 +8784,7 @@ FormatTrace(Ty *ty, ThrowCtx const *ctx, byte_vector *out)
                         Expr const *func;
                         if (
                                 DetailedExceptions
+                             && (i < vN(ctx->locals))
                              && ((func = compiler_find_func(ty, ip - 1)) != NULL)
                              && (func->scope != NULL)
                              && (vN(func->scope->owned) > 0)
@@ -8837,18 +8972,35 @@ CaptureContextEx(Ty *ty, ThrowCtx *ctx)
                         nvar = 0;
                 }
 
-                ValueVector locals = {0};
-                xvPn(locals, vv(STACK) + fp, nvar);
+                /*
+                 * Slots past the end of a recycled context still own the
+                 * buffers from last time, so keep new ones zeroed and reuse
+                 * whatever is there.
+                 */
+                if (vN(ctx->locals) == vC(ctx->locals)) {
+                        usize cap = vC(ctx->locals);
+                        xvR(ctx->locals, max(2 * cap, 16));
+                        memset(
+                                vv(ctx->locals) + cap,
+                                0,
+                                (vC(ctx->locals) - cap) * sizeof (ValueVector)
+                        );
+                }
+
+                ValueVector *locals = vZ(ctx->locals);
+                vN(ctx->locals) += 1;
 
-                for (int i = 0; i < vN(locals); ++i) {
-                        Value *v = v_(locals, i);
+                vN(*locals) = 0;
+                xvPn(*locals, vv(*CoStack(ty, &st)) + fp, nvar);
+
+                for (int i = 0; i < vN(*locals); ++i) {
+                        Value *v = v_(*locals, i);
                         while (v->type == VALUE_REF) {
                                 *v = *v->ref;
                         }
                 }
 
                 xvP(*ctx, (void *)ip);
-                xvP(ctx->locals, locals);
 
                 if (
                         (vN(st.frames) == 1)
@@ -9608,6 +9760,7 @@ vm_init(Ty *ty, int ac, char **av)
         compiler_load_builtin_modules(ty);
 
         sqlite_load(ty);
+        uring_load(ty);
 
         GC_RESUME();
         TY_CATCH_END();
@@ -9762,6 +9915,29 @@ vm_get_frames(Ty *ty)
         return &FRAMES;
 }
 
+/*
+ * realloc() would free the old buffer, and a SIGPROF that lands while it does
+ * would have the sampler read freed (possibly unmapped) memory. Instead the
+ * frames are copied to a new buffer, which is published before the old one
+ * is freed: a handler on this thread sees one or the other, whole.
+ */
+void
+GrowFrameStack(FrameStack *frames)
+{
+        usize cap = max(16, 2 * vC(*frames));
+        Frame *old = vv(*frames);
+        Frame *new = xmA(cap * sizeof (Frame));
+
+        memcpy(new, old, vN(*frames) * sizeof (Frame));
+
+        atomic_signal_fence(memory_order_release);
+        frames->items = new;
+        atomic_signal_fence(memory_order_release);
+        frames->capacity = cap;
+
+        ty_free(old);
+}
+
 Value
 vm_call_method(Ty *ty, Value const *self, Value const *f, int argc)
 {
@@ -10383,6 +10559,8 @@ StepInstruction(char const *ip)
                 SKIPVALUE(n);
                 SKIPVALUE(n);
                 SKIPVALUE(n);
+                SKIPVALUE(b);
+                SKIPVALUE(b);
                 break;
         CASE(DROP)
         CASE(ENTER)
@@ -11326,6 +11504,8 @@ vm_push_try(Ty *ty)
        struct try *t = PushTry(ty);
        t->catch = IP;
        t->end   = IP;
+       // We can't tell what C code will do with what it catches
+       t->need_trace = true;
        return t;
 }
 
@@ -26,6 +26,8 @@
 #include "ty.h"
 #include "types.h"
 #include "highlight.h"
+#include "sampler.h"
+#include "tracer.h"
 #include "polyfill_time.h"
 
 #ifdef TY_HAVE_VERSION_INFO
@@ -87,6 +89,14 @@ bool CheckConstraints   = true;
 bool DetailedExceptions = true;
 bool NoJIT              = false;
 bool InteractiveSession = false;
+bool TypeStats          = false;
+
+static int SampleRate = 0;
+static char const *SampleOut = NULL;
+static bool PerfMap = false;
+static isize HeapSampleRate = 0;
+static char const *HeapSampleOut = NULL;
+static char const *TraceOut = NULL;
 
 static char const *HighlightTheme = NULL;
 
@@ -133,6 +143,27 @@ usage(void)
 #endif
                 "    --color=WHEN  Explicitly control when to use colored output. WHEN can be set         \0"
                 "                  to 'always', 'never', or 'auto' (default: 'auto')                      \0"
+                "    --type-stats  Print how long type checking took for each module, with fuel used and  \0"
+                "                  cache hit rates, to stderr before exiting                              \0"
+                "    --sample[=HZ] Sample the program's call stacks HZ times per second of CPU time       \0"
+                "                  (default: 1000) and print a profile to stderr before exiting           \0"
+                "    --sample-out=FILE                                                                    \0"
+                "                  Write the --sample profile to FILE instead: in pprof format if FILE    \0"
+                "                  ends in .pb or .pprof, as folded stacks (for flame graphs) if it ends  \0"
+                "                  in .folded, and as text otherwise. Implies --sample                    \0"
+                "    --perf-map    Write /tmp/perf-PID.map so that perf(1) can name JIT-compiled code     \0"
+                "    --heap-sample[=BYTES]                                                                \0"
+                "                  Sample one allocation per BYTES allocated on average (default: 512K)   \0"
+                "                  and print the sites with the most memory in use to stderr before       \0"
+                "                  exiting                                                                \0"
+                "    --heap-out=FILE                                                                      \0"
+                "                  Write the --heap-sample profile to FILE instead: in pprof format if    \0"
+                "                  FILE ends in .pb or .pprof, and as text otherwise. Implies             \0"
+                "                  --heap-sample                                                          \0"
+                "    --trace-out=FILE                                                                     \0"
+                "                  Record a timeline of GC phases, JIT compilation, blocking calls, and   \0"
+                "                  thread and channel operations, and write it to FILE as a Chrome trace  \0"
+                "                  (for Perfetto or chrome://tracing) before exiting                      \0"
                 "    --highlight[=THEME]                                                                  \0"
                 "                  Print syntax-highlighted source and exit. Available themes:            \0"
                 "                  gruvbox, gruvbox-material, github-light, github-dark, monokai,         \0"
@@ -488,6 +519,57 @@ ProcessArgs(char *argv[], bool first)
                         goto NextOption;
                 }
 
+                if (s_eq(argv[argi], "--type-stats")) {
+                        TypeStats = true;
+                        goto NextOption;
+                }
+
+                if (strncmp(argv[argi], "--sample-out=", 13) == 0) {
+                        SampleOut = argv[argi] + 13;
+                        if (SampleRate == 0) {
+                                SampleRate = SAMPLER_DEFAULT_HZ;
+                        }
+                        goto NextOption;
+                }
+
+                if (strncmp(argv[argi], "--trace-out=", 12) == 0) {
+                        TraceOut = argv[argi] + 12;
+                        goto NextOption;
+                }
+
+                if (strncmp(argv[argi], "--heap-out=", 11) == 0) {
+                        HeapSampleOut = argv[argi] + 11;
+                        if (HeapSampleRate == 0) {
+                                HeapSampleRate = SAMPLER_HEAP_DEFAULT_RATE;
+                        }
+                        goto NextOption;
+                }
+
+                if (s_eq(argv[argi], "--heap-sample") || strncmp(argv[argi], "--heap-sample=", 14) == 0) {
+                        char const *eq = strchr(argv[argi], '=');
+                        HeapSampleRate = (eq == NULL) ? SAMPLER_HEAP_DEFAULT_RATE : atoll(eq + 1);
+                        if (HeapSampleRate <= 0) {
+                                fprintf(stderr, "Invalid heap sampling interval: %s\n", eq + 1);
+                                exit(1);
+                        }
+                        goto NextOption;
+                }
+
+                if (s_eq(argv[argi], "--perf-map")) {
+                        PerfMap = true;
+                        goto NextOption;
+                }
+
+                if (s_eq(argv[argi], "--sample") || strncmp(argv[argi], "--sample=", 9) == 0) {
+                        char const *eq = strchr(argv[argi], '=');
+                        SampleRate = (eq == NULL) ? SAMPLER_DEFAULT_HZ : atoi(eq + 1);
+                        if (SampleRate <= 0 || SampleRate > 1000000) {
+                                fprintf(stderr, "Invalid sampling rate: %s\n", eq + 1);
+                                exit(1);
+                        }
+                        goto NextOption;
+                }
+
                 if (s_eq(argv[argi], "--highlight") || strncmp(argv[argi], "--highlight=", 12) == 0) {
                         HighlightOnly = true;
                         CheckTypes = false;
@@ -694,6 +776,10 @@ main(int argc, char **argv)
 
         int nopt = (argc == 0) ? 0 : ProcessArgs(argv, true);
 
+        if (TypeStats) {
+                atexit(types_stats_dump);
+        }
+
         switch (ColorMode) {
         case TY_COLOR_AUTO:   ColorStdout = isatty(1); ColorStderr = isatty(2); break;
         case TY_COLOR_ALWAYS: ColorStdout = true;      ColorStderr = true;      break;
@@ -723,6 +809,31 @@ main(int argc, char **argv)
 
         argv += ProcessArgs(argv, false);
 
+        if (PerfMap && !sampler_perf_map()) {
+                fprintf(stderr, "Failed to open perf map: %s\n", strerror(errno));
+        }
+
+        if (SampleOut != NULL) {
+                sampler_set_output(SampleOut);
+        }
+
+        if (SampleRate > 0 && sampler_start(SampleRate)) {
+                atexit(sampler_dump);
+        }
+
+        if (HeapSampleOut != NULL) {
+                sampler_heap_set_output(HeapSampleOut);
+        }
+
+        if (HeapSampleRate > 0 && sampler_heap_start(HeapSampleRate)) {
+                atexit(sampler_heap_dump);
+        }
+
+        if (TraceOut != NULL && tracer_start()) {
+                tracer_set_output(TraceOut);
+                atexit(tracer_dump);
+        }
+
         FILE *file = fopen(SourceFile, "r");
         if (file == NULL) {
                 fprintf(stderr, "Failed to open source file '%s': %s\n", SourceFile, strerror(errno));
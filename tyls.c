@@ -47,6 +47,7 @@ bool CompileOnly = true;
 bool AllowErrors = false;
 bool NoJIT = true;
 bool InteractiveSession = false;
+bool TypeStats = false;
 
 enum {
         LS_COMPILE,
@@ -71,6 +72,75 @@ enum {
         SEM_PARAMETER
 };
 
+/*
+ * tyd sends the current document text ahead of every query, so most compile
+ * requests carry a source that we've already compiled. We remember the text
+ * of the last successful compile of each file and skip the reload when it
+ * hasn't changed. Imported modules are already shared between reloads by
+ * the compiler, so this leaves only genuine edits paying for a compile.
+ *
+ * Most of those edits are typing inside a function body, so we first try
+ * CompilerPatchModule(), which re-lexes and re-checks just the one function
+ * the edit falls in. Anything it can't handle (an edit spanning lines or
+ * statements, or one that changes the function's type and so may affect its
+ * callers) falls back to recompiling the whole file.
+ *
+ * A strict compile can only be patched if the document was last compiled
+ * strictly, since patching doesn't look at the rest of the file.
+ */
+typedef struct {
+        i64   name;
+        char *source;
+        usize len;
+        bool  strict;
+} Document;
+
+static vec(Document) Documents;
+
+static Document *
+GetDocument(i64 name)
+{
+        for (usize i = 0; i < vN(Documents); ++i) {
+                if (v_(Documents, i)->name == name) {
+                        return v_(Documents, i);
+                }
+        }
+
+        xvP(Documents, ((Document) { .name = name }));
+
+        return vvL(Documents);
+}
+
+static bool
+DocumentIsCurrent(Document const *doc, char const *source, bool strict)
+{
+        usize len = strlen(source);
+
+        return doc->source != NULL
+            && doc->len == len
+            && (doc->strict || !strict)
+            && memcmp(doc->source, source, len) == 0;
+}
+
+static void
+DocumentUpdate(Document *doc, char const *source, bool strict)
+{
+        usize len = strlen(source);
+
+        mresize(doc->source, len + 1);
+        memcpy(doc->source, source, len + 1);
+        doc->len    = len;
+        doc->strict = strict;
+}
+
+static void
+DocumentInvalidate(Document *doc)
+{
+        ty_free(doc->source);
+        doc->source = NULL;
+        doc->len    = 0;
+}
+
 static bool
 is_type_name(char const *id)
 {
@@ -186,8 +256,7 @@ main(int argc, char *argv[])
                 req = builtin_json_parse_xD(ty, 1, NULL);
                 vmX();
 
-                fputs(VSC(&req), stderr);
-                fputc('\n', stderr);
+                LSLOG("%s\n", VSC(&req));
 
                 i32 what = tget_nn(&req, "what")->z;
 
@@ -199,8 +268,9 @@ main(int argc, char *argv[])
 
                 i64 name;
 
-                Symbol *sym;
-                Module *mod;
+                Symbol   *sym;
+                Module   *mod;
+                Document *doc;
 
                 Value  v;
                 Value *vp;
@@ -234,25 +304,41 @@ main(int argc, char *argv[])
                         }
 
                         source = TY_0_C_STR(v);
+                        doc    = GetDocument(name);
+
+                        if (mod != NULL && DocumentIsCurrent(doc, source, !AllowErrors)) {
+                                LSLOG("%s: unchanged, skipping compile\n", file);
+                                break;
+                        }
 
                         if (mod == NULL) {
                                 mod = compiler_compile_source(ty, source, file);
                                 if (mod != NULL) {
                                         *vp = PTR(mod);
+                                        DocumentUpdate(doc, source, !AllowErrors);
                                 } else {
+                                        DocumentInvalidate(doc);
                                         fputs(TyError(ty), stderr);
                                         result = vTn(
                                                 "error", xSz(TyError(ty))
                                         );
                                 }
+                        } else if (
+                                (AllowErrors || (doc->source != NULL && doc->strict))
+                             && CompilerPatchModule(ty, mod, source)
+                        ) {
+                                LSLOG("%s: patched in place\n", file);
+                                DocumentUpdate(doc, source, !AllowErrors);
                         } else {
                                 if (!CompilerReloadModule(ty, mod, source)) {
+                                        DocumentInvalidate(doc);
                                         fputs(TyError(ty), stderr);
                                         result = vTn(
                                                 "error", xSz(TyError(ty))
                                         );
                                         goto EndRequest;
                                 }
+                                DocumentUpdate(doc, source, !AllowErrors);
                         }
                         break;
 